@@ -0,0 +1,603 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "snapraid.h"
+#include "support.h"
+#include "util.h"
+#include "elem.h"
+#include "state.h"
+#include "search.h"
+#include "raid/raid.h"
+
+/****************************************************************************/
+/* bench */
+
+/**
+ * Number of data disks of the synthetic array.
+ */
+#define BENCH_DATA 4
+
+/**
+ * Max size of the files of the synthetic array.
+ */
+#define BENCH_FILE_MAX (16 * 1024 * 1024)
+
+/**
+ * Size of the buffer used to generate the files.
+ */
+#define BENCH_BUFFER (1024 * 1024)
+
+#define BENCH_SYNC 0
+#define BENCH_LOAD 1
+#define BENCH_SAVE 2
+#define BENCH_SCRUB 3
+#define BENCH_CHECK 4
+#define BENCH_FIX 5
+#define BENCH_MAX 6
+
+static const char* BENCH_NAME[BENCH_MAX] = {
+	"sync", "load", "save", "scrub", "check", "fix"
+};
+
+/**
+ * Measure of a stage.
+ */
+struct snapraid_bench_stage {
+	uint64_t bytes; /**< Bytes processed. */
+	double seconds; /**< Elapsed time. */
+	double user; /**< User CPU time. */
+	double system; /**< System CPU time. */
+	uint64_t rss; /**< Peak resident memory in bytes. */
+};
+
+/**
+ * Synthetic array.
+ */
+struct snapraid_bench {
+	char dir[PATH_MAX]; /**< Dir of the array. */
+	char conf[PATH_MAX]; /**< Configuration file. */
+	char content[PATH_MAX]; /**< Content file. */
+	struct snapraid_option opt; /**< Options used for the stages. */
+	uint64_t seed; /**< Generator of the file data. */
+	unsigned count; /**< Number of files. */
+	uint64_t size; /**< Size of the data. */
+	uint64_t damage; /**< Size of the data removed to be fixed. */
+	struct snapraid_bench_stage stage[BENCH_MAX];
+};
+
+#if HAVE_FORK && HAVE_GETRUSAGE && HAVE_MKDTEMP
+/**
+ * Pseudo random data.
+ */
+static uint64_t bench_rnd(struct snapraid_bench* bench)
+{
+	/* xorshift64* */
+	bench->seed ^= bench->seed >> 12;
+	bench->seed ^= bench->seed << 25;
+	bench->seed ^= bench->seed >> 27;
+
+	return bench->seed * 2685821657736338717ULL;
+}
+
+static double bench_time(struct timeval* tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+/**
+ * Remove a dir with all its content.
+ */
+static void bench_remove(const char* dir)
+{
+	DIR* d;
+	struct dirent* dd;
+
+	d = opendir(dir);
+	if (!d) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error opening the directory '%s'. %s.\n", dir, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	while ((dd = readdir(d)) != 0) {
+		char path[PATH_MAX];
+		struct stat st;
+
+		if (strcmp(dd->d_name, ".") == 0 || strcmp(dd->d_name, "..") == 0)
+			continue;
+
+		pathprint(path, sizeof(path), "%s/%s", dir, dd->d_name);
+
+		if (lstat(path, &st) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error in stat file '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			bench_remove(path);
+		} else if (remove(path) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error removing the file '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	closedir(d);
+
+	if (rmdir(dir) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error removing the directory '%s'. %s.\n", dir, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Remove the synthetic array, and exit with a failure.
+ */
+static void bench_fail(struct snapraid_bench* bench)
+{
+	bench_remove(bench->dir);
+	exit(EXIT_FAILURE);
+}
+
+static void bench_mkdir(struct snapraid_bench* bench, const char* path)
+{
+	if (mkdir(path, 0700) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating the directory '%s'. %s.\n", path, strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Write a file with random data.
+ */
+static void bench_file(struct snapraid_bench* bench, const char* path, uint64_t size, uint64_t* buffer)
+{
+	int f;
+
+	f = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0600);
+	if (f == -1) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating the file '%s'. %s.\n", path, strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+
+	while (size != 0) {
+		size_t run = size < BENCH_BUFFER ? size : BENCH_BUFFER;
+		size_t i;
+
+		/* always different data, to avoid that fix recovers from copies */
+		for (i = 0; i < BENCH_BUFFER / sizeof(uint64_t); ++i)
+			buffer[i] = bench_rnd(bench);
+
+		if (write(f, buffer, run) != (ssize_t)run) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error writing the file '%s'. %s.\n", path, strerror(errno));
+			bench_fail(bench);
+			/* LCOV_EXCL_STOP */
+		}
+
+		size -= run;
+	}
+
+	if (close(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error closing the file '%s'. %s.\n", path, strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Generate the synthetic array.
+ */
+static void bench_generate(struct snapraid_bench* bench, uint64_t size)
+{
+	char path[PATH_MAX];
+	uint64_t* buffer;
+	FILE* f;
+	int d;
+
+	buffer = malloc_nofail(BENCH_BUFFER);
+
+	pathprint(bench->conf, sizeof(bench->conf), "%s/snapraid.conf", bench->dir);
+	pathprint(bench->content, sizeof(bench->content), "%s/snapraid.content", bench->dir);
+
+	f = fopen(bench->conf, "wt");
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating the file '%s'. %s.\n", bench->conf, strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+
+	fprintf(f, "parity %s/snapraid.parity\n", bench->dir);
+	fprintf(f, "2-parity %s/snapraid.2-parity\n", bench->dir);
+	fprintf(f, "content %s\n", bench->content);
+
+	for (d = 0; d < BENCH_DATA; ++d) {
+		uint64_t disk_size = size / BENCH_DATA;
+		unsigned i;
+
+		pathprint(path, sizeof(path), "%s/d%u", bench->dir, d + 1);
+		bench_mkdir(bench, path);
+
+		fprintf(f, "disk d%u %s/\n", d + 1, path);
+
+		/* files of random size */
+		i = 0;
+		while (disk_size != 0) {
+			char file[PATH_MAX];
+			uint64_t file_size = 1 + bench_rnd(bench) % BENCH_FILE_MAX;
+
+			if (file_size > disk_size)
+				file_size = disk_size;
+
+			pathprint(file, sizeof(file), "%s/file%06u.bin", path, i);
+			bench_file(bench, file, file_size, buffer);
+
+			disk_size -= file_size;
+			bench->size += file_size;
+			if (d == 0)
+				bench->damage += file_size;
+			++bench->count;
+			++i;
+		}
+	}
+
+	if (fclose(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error closing the file '%s'. %s.\n", bench->conf, strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+
+	free(buffer);
+}
+
+/**
+ * Remove all the files of the first disk to have something to fix.
+ */
+static void bench_damage(struct snapraid_bench* bench)
+{
+	char path[PATH_MAX];
+
+	pathprint(path, sizeof(path), "%s/d1", bench->dir);
+	bench_remove(path);
+	bench_mkdir(bench, path);
+}
+
+/**
+ * Time and resources used at one point of the measure.
+ */
+struct bench_mark {
+	struct timeval tv; /**< Wall clock time. */
+	struct rusage ru; /**< CPU time and memory used by the process. */
+};
+
+/**
+ * Get the current time and resources used.
+ */
+static void bench_now(struct bench_mark* mark)
+{
+	gettimeofday(&mark->tv, 0);
+	getrusage(RUSAGE_SELF, &mark->ru);
+}
+
+/**
+ * Run the stage command in the current process.
+ *
+ * The start and stop marks include only the measured operation,
+ * and not the load of the configuration and of the content file.
+ */
+static int bench_command(struct snapraid_bench* bench, int stage, struct bench_mark* start, struct bench_mark* stop)
+{
+	struct snapraid_state state;
+	tommy_list filterlist_file;
+	tommy_list filterlist_disk;
+	int ret = 0;
+
+	tommy_list_init(&filterlist_file);
+	tommy_list_init(&filterlist_disk);
+
+	state_init(&state);
+
+	state_config(&state, bench->conf, BENCH_NAME[stage], &bench->opt, &filterlist_disk);
+
+	raid_mode(state.raid_mode);
+
+	if (stage == BENCH_LOAD) {
+		bench_now(start);
+		state_read(&state);
+		bench_now(stop);
+		return 0;
+	}
+
+	if (stage == BENCH_SYNC)
+		state.clear_past_hash = 1;
+
+	state_read(&state);
+
+	if (stage == BENCH_SAVE) {
+		bench_now(start);
+		state_write(&state);
+		bench_now(stop);
+		return 0;
+	}
+
+	bench_now(start);
+
+	switch (stage) {
+	case BENCH_SYNC :
+		state_scan(&state);
+		state_refresh(&state);
+		if (state.need_write)
+			state_write(&state);
+		ret = state_sync(&state, 0, 0);
+		if (state.need_write)
+			state_write(&state);
+		break;
+	case BENCH_SCRUB :
+		ret = state_scrub(&state, SCRUB_FULL, SCRUB_AUTO);
+		if (state.need_write)
+			state_write(&state);
+		break;
+	case BENCH_CHECK :
+	case BENCH_FIX :
+		if (!state.opt.force_nocopy)
+			state_search_array(&state);
+		state_skip(&state);
+		state_filter(&state, &filterlist_file, &filterlist_disk, 0, 0);
+		ret = state_check(&state, stage == BENCH_FIX, 0, 0);
+		break;
+	}
+
+	bench_now(stop);
+
+	return ret;
+}
+
+/**
+ * Run a stage in a child process, to measure its CPU time and memory.
+ */
+static void bench_stage(struct snapraid_bench* bench, int stage)
+{
+	struct snapraid_bench_stage* measure = &bench->stage[stage];
+	int fd[2];
+	pid_t pid;
+	int status;
+
+	if (pipe(fd) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating a pipe. %s.\n", strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+
+	log_flush();
+
+	pid = fork();
+	if (pid == -1) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating a process. %s.\n", strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (pid == 0) {
+		struct bench_mark start;
+		struct bench_mark stop;
+		int ret;
+
+		close(fd[0]);
+
+		/* keep only the fatal errors */
+		msg_level = MSG_STATUS - 1;
+
+		/* the expected errors, like the missing files in fix, go in the log */
+		if (!stdlog) {
+			char path[PATH_MAX];
+
+			pathprint(path, sizeof(path), "%s/snapraid.log", bench->dir);
+			stdlog = fopen(path, "at");
+			if (!stdlog) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error opening the log file '%s'. %s.\n", path, strerror(errno));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
+
+		ret = bench_command(bench, stage, &start, &stop);
+
+		measure->seconds = bench_time(&stop.tv) - bench_time(&start.tv);
+		measure->user = bench_time(&stop.ru.ru_utime) - bench_time(&start.ru.ru_utime);
+		measure->system = bench_time(&stop.ru.ru_stime) - bench_time(&start.ru.ru_stime);
+#ifdef __APPLE__
+		measure->rss = stop.ru.ru_maxrss; /* in bytes in Mac OS X */
+#else
+		measure->rss = stop.ru.ru_maxrss * 1024ULL; /* in KiB in Linux and BSD */
+#endif
+
+		if (write(fd[1], measure, sizeof(*measure)) != sizeof(*measure)) {
+			/* LCOV_EXCL_START */
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		exit(ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close(fd[1]);
+
+	if (read(fd[0], measure, sizeof(*measure)) != sizeof(*measure)
+		|| waitpid(pid, &status, 0) != pid
+		|| !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		/* LCOV_EXCL_START */
+		log_fatal("Failed the bench stage '%s'.\n", BENCH_NAME[stage]);
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+
+	close(fd[0]);
+}
+
+/**
+ * Write the results in JSON format.
+ */
+static void bench_json(struct snapraid_bench* bench, const char* json)
+{
+	FILE* f;
+	int i;
+
+	f = fopen(json, "wt");
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating the file '%s'. %s.\n", json, strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"version\": \"%s\",\n", PACKAGE_VERSION);
+	fprintf(f, "  \"data_disks\": %u,\n", BENCH_DATA);
+	fprintf(f, "  \"parity_disks\": 2,\n");
+	fprintf(f, "  \"files\": %u,\n", bench->count);
+	fprintf(f, "  \"data_size\": %" PRIu64 ",\n", bench->size);
+	fprintf(f, "  \"stages\": [\n");
+	for (i = 0; i < BENCH_MAX; ++i) {
+		struct snapraid_bench_stage* measure = &bench->stage[i];
+		double mbs = measure->seconds > 0 ? measure->bytes / measure->seconds / (1024 * 1024) : 0;
+
+		fprintf(f, "    { \"name\": \"%s\", \"bytes\": %" PRIu64 ", \"seconds\": %.6f, \"mbs\": %.1f, \"user_seconds\": %.6f, \"system_seconds\": %.6f, \"peak_rss\": %" PRIu64 " }%s\n",
+			BENCH_NAME[i], measure->bytes, measure->seconds, mbs, measure->user, measure->system, measure->rss,
+			i + 1 < BENCH_MAX ? "," : "");
+	}
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+
+	if (fclose(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error closing the file '%s'. %s.\n", json, strerror(errno));
+		bench_fail(bench);
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+void bench(struct snapraid_option* opt, uint64_t size, const char* json)
+{
+	struct snapraid_bench* bench;
+	const char* tmp;
+	struct stat st;
+	int i;
+
+	bench = malloc_nofail(sizeof(struct snapraid_bench));
+	memset(bench, 0, sizeof(struct snapraid_bench));
+
+	bench->opt = *opt;
+
+	/* all the disks are in the same filesystem */
+	bench->opt.skip_device = 1;
+
+	/* the memory test is a fixed cost not related at the array */
+	bench->opt.skip_self = 1;
+
+	bench->seed = 0x9E3779B97F4A7C15ULL;
+
+	tmp = getenv("TMPDIR");
+	if (!tmp || !*tmp)
+		tmp = "/tmp";
+
+	pathprint(bench->dir, sizeof(bench->dir), "%s/snapraid-bench-XXXXXX", tmp);
+	if (mkdtemp(bench->dir) == 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating the directory '%s'. %s.\n", bench->dir, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	printf(PACKAGE " v" VERSION " by Andrea Mazzoleni, " PACKAGE_URL "\n");
+
+	printf("Generating %u MiB of data in '%s'...\n", (unsigned)(size / (1024 * 1024)), bench->dir);
+	fflush(stdout);
+
+	bench_generate(bench, size);
+
+	printf("\n");
+	printf("Stage        MB/s   Time [s]   User [s]    Sys [s]   Peak RSS [MiB]\n");
+
+	for (i = 0; i < BENCH_MAX; ++i) {
+		struct snapraid_bench_stage* measure = &bench->stage[i];
+
+		if (i == BENCH_FIX)
+			bench_damage(bench);
+
+		bench_stage(bench, i);
+
+		if (i == BENCH_LOAD || i == BENCH_SAVE) {
+			if (stat(bench->content, &st) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error in stat file '%s'. %s.\n", bench->content, strerror(errno));
+				bench_fail(bench);
+				/* LCOV_EXCL_STOP */
+			}
+			measure->bytes = st.st_size;
+		} else if (i == BENCH_FIX) {
+			/* only the files removed are recovered */
+			measure->bytes = bench->damage;
+		} else {
+			measure->bytes = bench->size;
+		}
+
+		printf("%-6s %10.1f %10.3f %10.3f %10.3f %16.1f\n",
+			BENCH_NAME[i],
+			measure->seconds > 0 ? measure->bytes / measure->seconds / (1024 * 1024) : 0,
+			measure->seconds, measure->user, measure->system,
+			measure->rss / (1024.0 * 1024.0));
+		fflush(stdout);
+	}
+
+	if (json)
+		bench_json(bench, json);
+
+	bench_remove(bench->dir);
+
+	free(bench);
+}
+#else
+void bench(struct snapraid_option* opt, uint64_t size, const char* json)
+{
+	(void)opt;
+	(void)size;
+	(void)json;
+
+	/* LCOV_EXCL_START */
+	log_fatal("The 'bench' command is not supported in this platform.\n");
+	exit(EXIT_FAILURE);
+	/* LCOV_EXCL_STOP */
+}
+#endif
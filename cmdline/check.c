@@ -154,12 +154,47 @@ static int is_parity_matching(struct snapraid_state* state, unsigned diskmax, un
 	return 0;
 }
 
+/**
+ * Number of recovering contexts kept in the cache.
+ */
+#define RECOVER_CACHE_MAX 64
+
+/**
+ * Recover the data blocks using a cache of recovering contexts.
+ *
+ * When fixing, the same failed disks usually repeat for many consecutive
+ * blocks, and the same combinations of parities are tried for each one.
+ * Keeping the contexts avoids to invert the coefficients matrix every time.
+ */
+static void recover_data(struct raid_rec* rec_cache, int nr, int* id, int* ip, unsigned diskmax, unsigned block_size, void** buffer)
+{
+	struct raid_rec* rr;
+	unsigned h;
+	int i;
+
+	/* select the slot using the failed disks and the parities to use */
+	h = nr;
+	for (i = 0; i < nr; ++i)
+		h = h * 31 + id[i] * 7 + ip[i];
+	rr = &rec_cache[h % RECOVER_CACHE_MAX];
+
+	/* if it's a different combination, compute it */
+	if (rr->nr != nr
+		|| memcmp(rr->id, id, nr * sizeof(int)) != 0
+		|| memcmp(rr->ip, ip, nr * sizeof(int)) != 0
+	) {
+		raid_rec_init(rr, nr, id, ip);
+	}
+
+	raid_rec_data(rr, diskmax, block_size, buffer);
+}
+
 /**
  * Repair errors.
  * Return <0 if failure for missing strategy, >0 if data is wrong and we cannot rebuild correctly, 0 on success.
  * If success, the parity are computed in the buffer variable.
  */
-static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
+static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero, struct raid_rec* rec_cache)
 {
 	unsigned i, n;
 	int error;
@@ -217,7 +252,7 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 				memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
 
 			/* recover using one less parity, the ip[r-1] one */
-			raid_data(r - 1, id, ip, diskmax, state->block_size, buffer);
+			recover_data(rec_cache, r - 1, id, ip, diskmax, state->block_size, buffer);
 
 			/* use the remaining ip[r-1] parity to check the result */
 			if (is_parity_matching(state, diskmax, ip[r - 1], buffer, buffer_recov))
@@ -257,7 +292,7 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 				memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
 
 			/* recover */
-			raid_data(r, id, ip, diskmax, state->block_size, buffer);
+			recover_data(rec_cache, r, id, ip, diskmax, state->block_size, buffer);
 
 			/* use the hash to check the result */
 			if (is_hash_matching(state, rehash, diskmax, failed, failed_map, failed_count, buffer, buffer_zero))
@@ -284,7 +319,7 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 	return -1;
 }
 
-static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
+static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero, struct raid_rec* rec_cache)
 {
 	int ret;
 	int error;
@@ -395,7 +430,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 		return 0;
 	}
 
-	ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
+	ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero, rec_cache);
 	if (ret == 0) {
 		/* reprocess the CHG blocks, for which we don't have a hash to check */
 		/* if they were BAD we have to use some euristics to ensure that we have recovered  */
@@ -538,7 +573,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 	/* if nothing to fix, we just don't try */
 	/* if nothing unsynced we also don't retry, because it's the same try as before */
 	if (something_to_recover && something_unsynced) {
-		ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
+		ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero, rec_cache);
 		if (ret == 0) {
 			/* reprocess the REP and CHG blocks, for which we have recovered and old state */
 			/* that we don't want to save into disk */
@@ -841,6 +876,650 @@ static int block_is_enabled(struct snapraid_state* state, block_off_t i, struct
 	return 0;
 }
 
+/****************************************************************************/
+/* audit */
+
+/**
+ * Max size of a single read of the audit.
+ * Files are read in chunks of this size, rounded to the block size.
+ */
+#define AUDIT_READ_MAX (4 * 1024 * 1024)
+
+/**
+ * File to audit.
+ */
+struct snapraid_audit_file {
+	struct snapraid_file* file; /**< File to audit. */
+	uint64_t physical; /**< Physical offset used for sorting. 0 if not known. */
+	block_off_t parity_pos; /**< Parity position of the first block, used for sorting. */
+};
+
+/**
+ * State shared by all the disks in the audit.
+ */
+struct snapraid_audit {
+	struct snapraid_state* state; /**< State used. */
+
+	/**
+	 * Lock for the shared counters, for the progress, and for the log.
+	 * The log requires it because esc() uses static buffers.
+	 */
+	pthread_mutex_t lock;
+
+	block_off_t countpos; /**< Number of blocks processed. */
+	block_off_t countmax; /**< Number of blocks to process. */
+	data_off_t countsize; /**< Number of bytes processed. */
+	unsigned error; /**< Number of errors found in all the disks. */
+	int stop; /**< If the audit has to stop. */
+};
+
+/**
+ * Audit of a single disk.
+ */
+struct snapraid_audit_disk {
+	struct snapraid_audit* audit; /**< Shared audit state. */
+	struct snapraid_handle* handle; /**< Handle of the disk. */
+	struct snapraid_audit_file* filevec; /**< Files to audit in physical order. */
+	unsigned filemax; /**< Number of files to audit. */
+	unsigned error; /**< Number of errors found. */
+#if HAVE_PTHREAD_CREATE
+	pthread_t thread; /**< Thread used to audit the disk. */
+#else
+	void* retval;
+#endif
+};
+
+/**
+ * Compare files to audit by physical offset, and then by parity position.
+ */
+static int audit_file_compare(const void* void_a, const void* void_b)
+{
+	const struct snapraid_audit_file* file_a = void_a;
+	const struct snapraid_audit_file* file_b = void_b;
+
+	if (file_a->physical < file_b->physical)
+		return -1;
+	if (file_a->physical > file_b->physical)
+		return 1;
+	if (file_a->parity_pos < file_b->parity_pos)
+		return -1;
+	if (file_a->parity_pos > file_b->parity_pos)
+		return 1;
+	return 0;
+}
+
+/**
+ * Check if the audit can be done file by file.
+ *
+ * It's possible only when auditing all the blocks, as a file
+ * is always processed from the first to the last block.
+ */
+static int audit_is_enabled(struct snapraid_state* state, int fix, block_off_t blockstart, block_off_t blockmax)
+{
+	return !fix
+	       && state->opt.auditonly
+	       && !state->opt.badonly
+	       && blockstart == 0
+	       && blockmax == parity_allocated_size(state);
+}
+
+/**
+ * Read a chunk of a file.
+ * Return 0 if the full chunk is read, -1 on any error or short read.
+ * Errors are not reported, as the chunk is then read again block by block.
+ */
+static int audit_read(struct snapraid_handle* handle, data_off_t offset, unsigned char* buffer, unsigned size)
+{
+	ssize_t read_ret;
+	unsigned count;
+
+	if (offset + size > handle->valid_size)
+		return -1;
+
+#if !HAVE_PREAD
+	if (lseek(handle->f, offset, SEEK_SET) != offset)
+		return -1;
+#endif
+
+	count = 0;
+	do {
+#if HAVE_PREAD
+		read_ret = pread(handle->f, buffer + count, size - count, offset + count);
+#else
+		read_ret = read(handle->f, buffer + count, size - count);
+#endif
+		if (read_ret <= 0)
+			return -1;
+
+		count += read_ret;
+	} while (count < size);
+
+	return 0;
+}
+
+/**
+ * Audit a single file.
+ * Return -1 on a fatal error.
+ */
+static int audit_file(struct snapraid_audit_disk* ad, struct snapraid_file* file, unsigned char* buffer, block_off_t readmax, struct snapraid_chunk** fs_last)
+{
+	struct snapraid_audit* audit = ad->audit;
+	struct snapraid_state* state = audit->state;
+	struct snapraid_handle* handle = ad->handle;
+	struct snapraid_disk* disk = handle->disk;
+	unsigned block_size = state->block_size;
+	block_off_t file_pos;
+	block_off_t n;
+	int ret;
+
+	if (!file_flag_has(file, FILE_IS_MISSING))
+		ret = handle_open(handle, file, state->file_mode,
+			log_error, state->opt.expected_missing ? log_expected : 0);
+	else
+		ret = -1; /* if the file is missing, we cannot open it */
+	if (ret == -1) {
+		pthread_mutex_lock(&audit->lock);
+		for (file_pos = 0; file_pos < file->blockmax; ++file_pos) {
+			block_off_t parity_pos = fs_file2par_get_ts(disk, fs_last, file, file_pos);
+			log_tag("error:%u:%s:%s: Open error at position %u\n", parity_pos, disk->name, esc(file->sub), file_pos);
+			++ad->error;
+			++audit->error;
+		}
+		pthread_mutex_unlock(&audit->lock);
+
+		/* mark the file as missing and damaged */
+		file_flag_set(file, FILE_IS_MISSING);
+		file_flag_set(file, FILE_IS_DAMAGED);
+
+		goto status;
+	}
+
+	/* check if the file is changed */
+	if (handle->st.st_size != file->size
+		|| handle->st.st_mtime != file->mtime_sec
+		|| STAT_NSEC(&handle->st) != file->mtime_nsec
+		/* don't check the inode to support filesystem without persistent inodes */
+	) {
+		/* report that the file is not synced */
+		file_flag_set(file, FILE_IS_UNSYNCED);
+	}
+
+	/* check if the file is larger */
+	if (!(state->opt.syncedonly && file_flag_has(file, FILE_IS_UNSYNCED))
+		&& handle->st.st_size > file->size
+	) {
+		block_off_t parity_pos = fs_file2par_get_ts(disk, fs_last, file, 0);
+
+		pthread_mutex_lock(&audit->lock);
+		log_error("File '%s' is larger than expected.\n", handle->path);
+		log_tag("error:%u:%s:%s: Size error\n", parity_pos, disk->name, esc(file->sub));
+		++ad->error;
+		++audit->error;
+		pthread_mutex_unlock(&audit->lock);
+	}
+
+	file_flag_set(file, FILE_IS_OPENED);
+
+	/* read the file in large chunks */
+	for (file_pos = 0; file_pos < file->blockmax; file_pos += n) {
+		data_off_t offset = file_pos * (data_off_t)block_size;
+		unsigned chunk_size;
+		data_off_t countsize;
+		uint64_t tick_start;
+		uint64_t tick_read;
+		int by_block;
+		block_off_t k;
+
+		if (audit->stop || global_interrupt) {
+			/* LCOV_EXCL_START */
+			audit->stop = 1;
+			break;
+			/* LCOV_EXCL_STOP */
+		}
+
+		n = file->blockmax - file_pos;
+		if (n > readmax)
+			n = readmax;
+
+		if (file_pos + n == file->blockmax)
+			chunk_size = file->size - offset;
+		else
+			chunk_size = n * block_size;
+
+		/* if the chunk cannot be read in full, read it block by block */
+		/* to report the errors exactly as the block engine does */
+		tick_start = tick();
+		by_block = audit_read(handle, offset, buffer, chunk_size) != 0;
+		tick_read = tick() - tick_start;
+
+		countsize = 0;
+		for (k = 0; k < n; ++k) {
+			unsigned char hash[HASH_SIZE];
+			unsigned char* block_buffer = buffer + k * (size_t)block_size;
+			struct snapraid_block* block;
+			block_off_t parity_pos;
+			unsigned block_state;
+			int read_size;
+
+			parity_pos = fs_file2par_get_ts(disk, fs_last, file, file_pos + k);
+			block = fs_file2block_get(file, file_pos + k);
+
+			if (by_block) {
+				tick_start = tick();
+				read_size = handle_read(handle, file_pos + k, block_buffer, block_size,
+					log_error, state->opt.expected_missing ? log_expected : 0);
+				tick_read += tick() - tick_start;
+				if (read_size == -1) {
+					pthread_mutex_lock(&audit->lock);
+					log_tag("error:%u:%s:%s: Read error at position %u\n", parity_pos, disk->name, esc(file->sub), file_pos + k);
+					++ad->error;
+					++audit->error;
+					pthread_mutex_unlock(&audit->lock);
+					file_flag_set(file, FILE_IS_DAMAGED);
+					continue;
+				}
+			} else {
+				read_size = file_block_size(file, file_pos + k, block_size);
+			}
+
+			countsize += read_size;
+
+			/* CHG blocks have no hash to check */
+			block_state = block_state_get(block);
+			if (block_state != BLOCK_STATE_BLK && block_state != BLOCK_STATE_REP)
+				continue;
+
+			/* compute the hash of the block just read */
+			if (info_get_rehash(info_get(&state->infoarr, parity_pos))) {
+				memhash(state->prevhash, state->prevhashseed, hash, block_buffer, read_size);
+			} else {
+				memhash(state->hash, state->hashseed, hash, block_buffer, read_size);
+			}
+
+			/* compare the hash */
+			if (memcmp(hash, block->hash, HASH_SIZE) != 0) {
+				unsigned diff = memdiff(hash, block->hash, HASH_SIZE);
+
+				pthread_mutex_lock(&audit->lock);
+				log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u\n", parity_pos, disk->name, esc(file->sub), file_pos + k, diff);
+				++ad->error;
+				++audit->error;
+				pthread_mutex_unlock(&audit->lock);
+				file_flag_set(file, FILE_IS_DAMAGED);
+			}
+		}
+
+		/* progress */
+		pthread_mutex_lock(&audit->lock);
+		audit->countpos += n;
+		audit->countsize += countsize;
+		disk->read_bytes += countsize;
+		/* each disk has its own thread, so the chunk read is measured alone */
+		disk->tick += tick_read;
+		latency_add(&disk->latency, tick_read * 1000000 / state->tick_freq);
+		state->progress_error = audit->error;
+		if (state_progress(state, audit->countpos, audit->countpos, audit->countmax, audit->countsize)) {
+			/* LCOV_EXCL_START */
+			audit->stop = 1;
+			/* LCOV_EXCL_STOP */
+		}
+		pthread_mutex_unlock(&audit->lock);
+	}
+
+	ret = handle_close(handle);
+	if (ret == -1) {
+		/* LCOV_EXCL_START */
+		pthread_mutex_lock(&audit->lock);
+		log_tag("error:%u:%s:%s: Close error. %s\n", fs_file2par_get_ts(disk, fs_last, file, 0), disk->name, esc(file->sub), strerror(errno));
+		log_fatal("DANGER! Unexpected close error in a data disk.\n");
+		pthread_mutex_unlock(&audit->lock);
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* if interrupted, the file is not fully checked */
+	if (file_pos < file->blockmax)
+		return 0;
+
+status:
+	/* if required, print the final status */
+	if (!(state->opt.syncedonly && file_flag_has(file, FILE_IS_UNSYNCED))) {
+		char path[PATH_MAX];
+
+		pathprint(path, sizeof(path), "%s%s", disk->dir, file->sub);
+
+		pthread_mutex_lock(&audit->lock);
+		if (file_flag_has(file, FILE_IS_DAMAGED)) {
+			log_tag("status:damaged:%s:%s\n", disk->name, esc(file->sub));
+			msg_info("damaged %s\n", path);
+		} else {
+			log_tag("status:correct:%s:%s\n", disk->name, esc(file->sub));
+			/* we don't use msg_verbose() because it also goes into the log */
+			if (msg_level >= MSG_VERBOSE)
+				msg_info("correct %s\n", path);
+		}
+		pthread_mutex_unlock(&audit->lock);
+	}
+
+	return 0;
+}
+
+/**
+ * Audit all the files of a disk.
+ */
+static void* audit_disk_thread(void* arg)
+{
+	struct snapraid_audit_disk* ad = arg;
+	struct snapraid_state* state = ad->audit->state;
+	struct snapraid_chunk* fs_last = 0;
+	block_off_t readmax;
+	void* buffer_alloc;
+	unsigned char* buffer;
+	unsigned i;
+
+	readmax = AUDIT_READ_MAX / state->block_size;
+	if (readmax == 0)
+		readmax = 1;
+
+	buffer = malloc_nofail_align(readmax * (size_t)state->block_size, &buffer_alloc);
+
+	for (i = 0; i < ad->filemax && !ad->audit->stop; ++i) {
+		if (audit_file(ad, ad->filevec[i].file, buffer, readmax, &fs_last) != 0) {
+			/* LCOV_EXCL_START */
+			free(buffer_alloc);
+			return ad;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	free(buffer_alloc);
+
+	return 0;
+}
+
+/**
+ * Audit all the files, processing each disk independently.
+ *
+ * Each disk reads its files in physical order, and checks the hashes
+ * of the blocks without reading the parity.
+ * All the disks are processed in parallel.
+ * Return -1 on a fatal error.
+ */
+static int audit_process(struct snapraid_state* state, struct snapraid_handle* handle, unsigned diskmax, block_off_t* countpos, block_off_t* countmax, data_off_t* countsize, unsigned* error)
+{
+	struct snapraid_audit audit;
+	struct snapraid_audit_disk* advec;
+	unsigned j;
+	int fail;
+
+	audit.state = state;
+	pthread_mutex_init(&audit.lock, 0);
+	audit.countpos = 0;
+	audit.countmax = 0;
+	audit.countsize = 0;
+	audit.error = 0;
+	audit.stop = 0;
+
+	advec = malloc_nofail(diskmax * sizeof(struct snapraid_audit_disk));
+
+	/* collect the files of each disk */
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_audit_disk* ad = &advec[j];
+		struct snapraid_disk* disk = handle[j].disk;
+		tommy_node* node;
+		unsigned count;
+
+		ad->audit = &audit;
+		ad->handle = &handle[j];
+		ad->filevec = 0;
+		ad->filemax = 0;
+		ad->error = 0;
+
+		if (!disk)
+			continue;
+
+		count = tommy_list_count(&disk->filelist);
+		if (count == 0)
+			continue;
+
+		ad->filevec = malloc_nofail(count * sizeof(struct snapraid_audit_file));
+
+		for (node = disk->filelist; node != 0; node = node->next) {
+			struct snapraid_file* file = node->data;
+			struct snapraid_audit_file* af;
+
+			/* excluded and empty files are not read */
+			if (file_flag_has(file, FILE_IS_EXCLUDED) || file->blockmax == 0)
+				continue;
+
+			af = &ad->filevec[ad->filemax++];
+			af->file = file;
+			af->parity_pos = fs_file2par_get(disk, file, 0);
+			if (disk->has_unreliable_physical || file->physical < FILEPHY_REAL_OFFSET)
+				af->physical = 0;
+			else
+				af->physical = file->physical;
+
+			audit.countmax += file->blockmax;
+		}
+
+		qsort(ad->filevec, ad->filemax, sizeof(struct snapraid_audit_file), audit_file_compare);
+	}
+
+	state_progress_begin(state, 0, parity_allocated_size(state), audit.countmax);
+
+	/* start all the threads */
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_audit_disk* ad = &advec[j];
+
+		if (ad->filemax == 0)
+			continue;
+
+#if HAVE_PTHREAD_CREATE
+		if (pthread_create(&ad->thread, 0, audit_disk_thread, ad) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed to create thread.\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+#else
+		ad->retval = audit_disk_thread(ad);
+#endif
+	}
+
+	/* join all the threads */
+	fail = 0;
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_audit_disk* ad = &advec[j];
+		void* retval;
+
+		if (ad->filemax == 0)
+			continue;
+
+#if HAVE_PTHREAD_CREATE
+		if (pthread_join(ad->thread, &retval) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed to join thread.\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+#else
+		retval = ad->retval;
+#endif
+		if (retval) {
+			/* LCOV_EXCL_START */
+			fail = 1;
+			/* LCOV_EXCL_STOP */
+		}
+
+		*error += ad->error;
+	}
+
+	for (j = 0; j < diskmax; ++j)
+		free(advec[j].filevec);
+	free(advec);
+
+	pthread_mutex_destroy(&audit.lock);
+
+	*countpos = audit.countpos;
+	*countmax = audit.countmax;
+	*countsize = audit.countsize;
+
+	return fail ? -1 : 0;
+}
+
+/****************************************************************************/
+/* plan */
+
+/**
+ * Order of the blocks to process.
+ *
+ * When fixing a single disk, like when recovering a whole failed disk with
+ * -d, --filter-disk, the blocks are processed grouping them by the files of
+ * such disk, following the file order. This keeps sequential the writes of
+ * the recovered files also when they are fragmented in the parity, and the
+ * reads of the other disks proceed by the contiguous fragments of the file.
+ *
+ * In all the other cases, the blocks are processed in parity order.
+ */
+struct snapraid_plan {
+	struct snapraid_disk* disk; /**< Disk to fix. 0 to process in parity order. */
+	block_off_t blockstart; /**< First block to process. */
+	block_off_t blockmax; /**< Last block to process + 1. */
+	block_off_t pos; /**< Next block in parity order. */
+	struct snapraid_file* file; /**< File processed in file order. 0 if none. */
+	block_off_t file_pos; /**< Next block of the file to process. */
+	unsigned char* done; /**< Bit vector of the blocks already processed. */
+};
+
+static inline int plan_is_done(struct snapraid_plan* plan, block_off_t i)
+{
+	i -= plan->blockstart;
+	return (plan->done[i / 8] & (1 << (i % 8))) != 0;
+}
+
+static inline void plan_set_done(struct snapraid_plan* plan, block_off_t i)
+{
+	i -= plan->blockstart;
+	plan->done[i / 8] |= 1 << (i % 8);
+}
+
+/**
+ * Get the only disk with files to process, if any.
+ */
+static struct snapraid_disk* plan_disk(struct snapraid_handle* handle, unsigned diskmax)
+{
+	struct snapraid_disk* found = 0;
+	unsigned j;
+
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_disk* disk = handle[j].disk;
+		tommy_node* i;
+
+		if (!disk)
+			continue;
+
+		for (i = tommy_list_head(&disk->filelist); i != 0; i = i->next) {
+			struct snapraid_file* file = i->data;
+			if (!file_flag_has(file, FILE_IS_EXCLUDED))
+				break;
+		}
+
+		/* if no file to process in this disk */
+		if (i == 0)
+			continue;
+
+		/* if more than one disk, use the parity order */
+		if (found != 0)
+			return 0;
+
+		found = disk;
+	}
+
+	return found;
+}
+
+static void plan_init(struct snapraid_plan* plan, struct snapraid_state* state, int fix, struct snapraid_handle* handle, unsigned diskmax, block_off_t blockstart, block_off_t blockmax)
+{
+	plan->disk = 0;
+	plan->blockstart = blockstart;
+	plan->blockmax = blockmax;
+	plan->pos = blockstart;
+	plan->file = 0;
+	plan->file_pos = 0;
+	plan->done = 0;
+
+	/* only when fixing all the blocks, as with bad blocks the files are not complete anyway */
+	if (!fix || state->opt.badonly || blockstart >= blockmax)
+		return;
+
+	plan->disk = plan_disk(handle, diskmax);
+	if (plan->disk == 0)
+		return;
+
+	plan->done = malloc_nofail((blockmax - blockstart + 7) / 8);
+	memset(plan->done, 0, (blockmax - blockstart + 7) / 8);
+
+	msg_verbose("Fixing in the file order of disk '%s'\n", plan->disk->name);
+}
+
+static void plan_done(struct snapraid_plan* plan)
+{
+	free(plan->done);
+}
+
+/**
+ * Get the next block to process.
+ * Return 0 if there are no more blocks.
+ */
+static int plan_next(struct snapraid_plan* plan, block_off_t* out)
+{
+	block_off_t i;
+
+	/* in parity order */
+	if (plan->disk == 0) {
+		if (plan->pos >= plan->blockmax)
+			return 0;
+		*out = plan->pos++;
+		return 1;
+	}
+
+	while (1) {
+		/* continue with the blocks of the current file */
+		while (plan->file != 0 && plan->file_pos < plan->file->blockmax) {
+			i = fs_file2par_get(plan->disk, plan->file, plan->file_pos);
+			++plan->file_pos;
+
+			/* skip blocks outside the range, or already processed */
+			if (i < plan->blockstart || i >= plan->blockmax || plan_is_done(plan, i))
+				continue;
+
+			plan_set_done(plan, i);
+			*out = i;
+			return 1;
+		}
+		plan->file = 0;
+
+		/* get the next block in parity order not yet processed */
+		do {
+			if (plan->pos >= plan->blockmax)
+				return 0;
+			i = plan->pos++;
+		} while (plan_is_done(plan, i));
+
+		/* if it's the block of a file, process the whole file from its start */
+		if (block_has_file(fs_par2block_get(plan->disk, i))) {
+			plan->file = fs_par2file_get(plan->disk, i, 0);
+			plan->file_pos = 0;
+			continue;
+		}
+
+		plan_set_done(plan, i);
+		*out = i;
+		return 1;
+	}
+}
+
 static int state_check_process(struct snapraid_state* state, int fix, struct snapraid_parity_handle** parity, block_off_t blockstart, block_off_t blockmax)
 {
 	struct snapraid_handle* handle;
@@ -859,6 +1538,8 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	unsigned recovered_error;
 	struct failed_struct* failed;
 	unsigned* failed_map;
+	struct raid_rec* rec_cache;
+	struct snapraid_plan plan;
 	unsigned l;
 
 	handle = handle_map(state, &diskmax);
@@ -877,10 +1558,32 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	failed = malloc_nofail(diskmax * sizeof(struct failed_struct));
 	failed_map = malloc_nofail(diskmax * sizeof(unsigned));
 
+	/* the cache starts empty, as no recovering context has nr == 0 */
+	rec_cache = malloc_nofail(RECOVER_CACHE_MAX * sizeof(struct raid_rec));
+	memset(rec_cache, 0, RECOVER_CACHE_MAX * sizeof(struct raid_rec));
+
 	error = 0;
 	unrecoverable_error = 0;
 	recovered_error = 0;
 
+	/* plan the order of the blocks to process */
+	plan_init(&plan, state, fix, handle, diskmax, blockstart, blockmax);
+
+	/* if only auditing all the blocks, process each disk independently */
+	if (audit_is_enabled(state, fix, blockstart, blockmax)) {
+		ret = audit_process(state, handle, diskmax, &countpos, &countmax, &countsize, &error);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			log_fatal("Stopping\n");
+			++unrecoverable_error;
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* skip the processing of the blocks */
+		goto post;
+	}
+
 	/* first count the number of blocks to process */
 	countmax = 0;
 	for (i = blockstart; i < blockmax; ++i) {
@@ -893,7 +1596,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	countsize = 0;
 	countpos = 0;
 	state_progress_begin(state, blockstart, blockmax, countmax);
-	for (i = blockstart; i < blockmax; ++i) {
+	while (plan_next(&plan, &i)) {
 		unsigned failed_count;
 		int valid_parity;
 		snapraid_info info;
@@ -1111,6 +1814,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 			}
 
 			/* read from the file */
+			state_usage_waste(state);
 			read_size = handle_read(&handle[j], file_pos, buffer[j], state->block_size,
 				log_error, state->opt.expected_missing ? log_expected : 0);
 			if (read_size == -1) {
@@ -1130,6 +1834,9 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				continue;
 			}
 
+			state_usage_disk(state, disk);
+			disk->read_bytes += read_size;
+
 			countsize += read_size;
 
 			/* always insert CHG blocks, the repair functions needs all of them */
@@ -1213,12 +1920,15 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 			/* read the parity */
 			for (l = 0; l < state->level; ++l) {
 				if (parity[l]) {
+					state_usage_waste(state);
 					ret = parity_read(parity[l], i, buffer_recov[l], state->block_size, log_error);
 					if (ret == -1) {
 						buffer_recov[l] = 0; /* no parity to use */
 
 						log_tag("parity_error:%u:%s: Read error\n", i, lev_config_name(l));
 						++error;
+					} else {
+						state_usage_parity(state, l);
 					}
 				} else {
 					buffer_recov[l] = 0;
@@ -1226,7 +1936,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 			}
 
 			/* try all the recovering strategies */
-			ret = repair(state, rehash, i, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero);
+			ret = repair(state, rehash, i, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero, rec_cache);
 			if (ret != 0) {
 				/* increment the number of errors */
 				if (ret > 0)
@@ -1339,6 +2049,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 								/* and the parity is not excluded */
 								&& !state->parity[l].is_excluded
 							) {
+								state_usage_waste(state);
 								ret = parity_write(parity[l], i, buffer[diskmax + l], state->block_size);
 								if (ret == -1) {
 									/* LCOV_EXCL_START */
@@ -1350,6 +2061,8 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 									/* LCOV_EXCL_STOP */
 								}
 
+								state_usage_parity_write(state, l);
+
 								log_tag("parity_fixed:%u:%s: Fixed data error\n", i, lev_config_name(l));
 								++recovered_error;
 							}
@@ -1386,6 +2099,9 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 		/* count the number of processed block */
 		++countpos;
 
+		/* errors for the progress reporting */
+		state->progress_error = error;
+
 		/* progress */
 		if (state_progress(state, i, countpos, countmax, countsize)) {
 			/* LCOV_EXCL_START */
@@ -1394,6 +2110,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 		}
 	}
 
+post:
 	/* for each disk, recover empty files, symlinks and empty dirs */
 	for (i = 0; i < diskmax; ++i) {
 		tommy_node* node;
@@ -1754,6 +2471,8 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 
 	state_progress_end(state, countpos, countmax, countsize);
 
+	state_usage_log(state, 1);
+
 bail:
 	/* close all the files left open */
 	for (j = 0; j < diskmax; ++j) {
@@ -1872,8 +2591,10 @@ bail:
 	}
 	log_flush();
 
+	plan_done(&plan);
 	free(failed);
 	free(failed_map);
+	free(rec_cache);
 	free(handle);
 	free(buffer_alloc);
 	free(buffer);
@@ -118,6 +118,7 @@ static int state_dry_process(struct snapraid_state* state, struct snapraid_parit
 
 			/* until now is disk */
 			state_usage_disk(state, disk);
+			disk->read_bytes += read_size;
 
 			countsize += read_size;
 		}
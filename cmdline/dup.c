@@ -36,36 +36,56 @@ struct snapraid_hash {
 	tommy_hashdyn_node node;
 };
 
-struct snapraid_hash* hash_alloc(struct snapraid_state* state, struct snapraid_disk* disk, struct snapraid_file* file)
+/**
+ * Duplicate file found.
+ */
+struct snapraid_dup {
+	struct snapraid_hash* hash; /**< Duplicate file. */
+	struct snapraid_hash* found; /**< File found first with the same content. */
+
+	/* nodes for data structures */
+	tommy_node node;
+};
+
+/**
+ * Dup worker.
+ * Each one computes the hash of the candidate files of a single disk.
+ */
+struct snapraid_dup_worker {
+	struct snapraid_state* state; /**< State used. */
+	struct snapraid_disk* disk; /**< Disk of the files to hash. */
+	const data_off_t* sizevec; /**< Sorted sizes shared by more than one file. */
+	unsigned sizemax; /**< Number of sizes. */
+	struct snapraid_hash* hashvec; /**< Hashes of the candidate files, in the disk order. */
+	unsigned hashmax; /**< Number of hashes. */
+#if HAVE_PTHREAD_CREATE
+	pthread_t thread; /**< Thread used to hash the files. */
+#endif
+};
+
+/**
+ * Compute the hash of the whole file, from the hashes of its blocks.
+ * Return -1 if any block has not an updated hash.
+ */
+static int hash_file(struct snapraid_state* state, struct snapraid_hash* hash, struct snapraid_disk* disk, struct snapraid_file* file, unsigned char* buf)
 {
-	struct snapraid_hash* hash;
 	block_off_t i;
-	unsigned char* buf;
 
-	hash = malloc_nofail(sizeof(struct snapraid_hash));
 	hash->disk = disk;
 	hash->file = file;
 
-	buf = malloc_nofail(file->blockmax * HASH_SIZE);
-
-	/* set the back pointer */
 	for (i = 0; i < file->blockmax; ++i) {
 		struct snapraid_block* block = fs_file2block_get(file, i);
 
-		memcpy(buf + i * HASH_SIZE, block->hash, HASH_SIZE);
+		if (!block_has_updated_hash(block))
+			return -1;
 
-		if (!block_has_updated_hash(block)) {
-			free(buf);
-			free(hash);
-			return 0;
-		}
+		memcpy(buf + i * HASH_SIZE, block->hash, HASH_SIZE);
 	}
 
 	memhash(state->besthash, state->hashseed, hash->hash, buf, file->blockmax * HASH_SIZE);
 
-	free(buf);
-
-	return hash;
+	return 0;
 }
 
 static inline tommy_uint32_t hash_hash(struct snapraid_hash* hash)
@@ -73,11 +93,6 @@ static inline tommy_uint32_t hash_hash(struct snapraid_hash* hash)
 	return tommy_hash_u32(0, hash->hash, HASH_SIZE);
 }
 
-void hash_free(struct snapraid_hash* hash)
-{
-	free(hash);
-}
-
 int hash_compare(const void* void_arg, const void* void_data)
 {
 	const char* arg = void_arg;
@@ -86,58 +101,244 @@ int hash_compare(const void* void_arg, const void* void_data)
 	return memcmp(arg, hash->hash, HASH_SIZE);
 }
 
+static int size_compare(const void* void_a, const void* void_b)
+{
+	const data_off_t* a = void_a;
+	const data_off_t* b = void_b;
+
+	if (*a < *b)
+		return -1;
+	if (*a > *b)
+		return 1;
+	return 0;
+}
+
+/**
+ * Sort the duplicates by the wasted size, the biggest first.
+ * The sort is stable, so with the same size the disk order is kept.
+ */
+static int dup_compare(const void* void_a, const void* void_b)
+{
+	const struct snapraid_dup* a = void_a;
+	const struct snapraid_dup* b = void_b;
+
+	if (a->found->file->size > b->found->file->size)
+		return -1;
+	if (a->found->file->size < b->found->file->size)
+		return 1;
+	return 0;
+}
+
+/**
+ * Collect the sizes shared by more than one not empty file.
+ * Only the files with these sizes can be duplicates.
+ */
+static data_off_t* dup_size(struct snapraid_state* state, unsigned* out_count)
+{
+	data_off_t* sizevec;
+	unsigned count;
+	unsigned unique;
+	unsigned n;
+	tommy_node* i;
+
+	count = 0;
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		count += tommy_list_count(&disk->filelist);
+	}
+
+	sizevec = malloc_nofail((count + 1) * sizeof(data_off_t));
+
+	count = 0;
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		tommy_node* j;
+
+		for (j = disk->filelist; j != 0; j = j->next) {
+			struct snapraid_file* file = j->data;
+
+			/* if empty, skip it */
+			if (file->size == 0)
+				continue;
+
+			sizevec[count++] = file->size;
+		}
+	}
+
+	qsort(sizevec, count, sizeof(data_off_t), size_compare);
+
+	/* keep only one copy of the sizes present more than one time */
+	unique = 0;
+	n = 0;
+	while (n < count) {
+		unsigned m = n + 1;
+		while (m < count && sizevec[m] == sizevec[n])
+			++m;
+		if (m - n > 1)
+			sizevec[unique++] = sizevec[n];
+		n = m;
+	}
+
+	*out_count = unique;
+	return sizevec;
+}
+
+static void* dup_worker_thread(void* arg)
+{
+	struct snapraid_dup_worker* worker = arg;
+	struct snapraid_state* state = worker->state;
+	struct snapraid_disk* disk = worker->disk;
+	unsigned char* buf;
+	block_off_t bufmax;
+	unsigned count;
+	tommy_node* i;
+
+	/* count the candidates, to allocate only their hashes */
+	count = 0;
+	bufmax = 0;
+	for (i = disk->filelist; i != 0; i = i->next) {
+		struct snapraid_file* file = i->data;
+
+		if (file->size == 0)
+			continue;
+
+		if (!bsearch(&file->size, worker->sizevec, worker->sizemax, sizeof(data_off_t), size_compare))
+			continue;
+
+		++count;
+		if (file->blockmax > bufmax)
+			bufmax = file->blockmax;
+	}
+
+	worker->hashvec = malloc_nofail((count + 1) * sizeof(struct snapraid_hash));
+	worker->hashmax = 0;
+	buf = malloc_nofail((bufmax + 1) * HASH_SIZE);
+
+	for (i = disk->filelist; i != 0; i = i->next) {
+		struct snapraid_file* file = i->data;
+
+		if (file->size == 0)
+			continue;
+
+		if (!bsearch(&file->size, worker->sizevec, worker->sizemax, sizeof(data_off_t), size_compare))
+			continue;
+
+		/* if no hash, skip it */
+		if (hash_file(state, &worker->hashvec[worker->hashmax], disk, file, buf) != 0)
+			continue;
+
+		++worker->hashmax;
+	}
+
+	free(buf);
+
+	return 0;
+}
+
 void state_dup(struct snapraid_state* state)
 {
 	tommy_hashdyn hashset;
+	tommy_list duplist;
+	struct snapraid_dup_worker* workervec;
+	data_off_t* sizevec;
+	unsigned sizemax;
+	unsigned diskmax;
+	unsigned n;
 	tommy_node* i;
 	unsigned count;
 	data_off_t size;
 
 	tommy_hashdyn_init(&hashset);
+	tommy_list_init(&duplist);
 
 	count = 0;
 	size = 0;
 
 	msg_progress("Comparing...\n");
 
-	/* for each disk */
-	for (i = state->disklist; i != 0; i = i->next) {
-		tommy_node* j;
-		struct snapraid_disk* disk = i->data;
+	/* only files with the same size can be duplicates */
+	sizevec = dup_size(state, &sizemax);
+
+	/* hash the candidate files with one thread for each disk */
+	diskmax = tommy_list_count(&state->disklist);
+	workervec = malloc_nofail((diskmax + 1) * sizeof(struct snapraid_dup_worker));
+	for (n = 0, i = state->disklist; i != 0; ++n, i = i->next) {
+		struct snapraid_dup_worker* worker = &workervec[n];
+
+		worker->state = state;
+		worker->disk = i->data;
+		worker->sizevec = sizevec;
+		worker->sizemax = sizemax;
+
+#if HAVE_PTHREAD_CREATE
+		if (pthread_create(&worker->thread, 0, dup_worker_thread, worker) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed to create thread.\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+#else
+		dup_worker_thread(worker);
+#endif
+	}
 
-		/* for each file */
-		for (j = disk->filelist; j != 0; j = j->next) {
-			struct snapraid_file* file = j->data;
-			struct snapraid_hash* hash;
-			tommy_hash_t hash32;
+	for (n = 0; n < diskmax; ++n) {
+#if HAVE_PTHREAD_CREATE
+		struct snapraid_dup_worker* worker = &workervec[n];
+		void* retval;
 
-			/* if empty, skip it */
-			if (file->size == 0)
-				continue;
+		if (pthread_join(worker->thread, &retval) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed to join thread.\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+#endif
+	}
 
-			hash = hash_alloc(state, disk, file);
+	free(sizevec);
 
-			/* if no hash, skip it */
-			if (!hash)
-				continue;
+	/* search the duplicates in the disk order, so the first file found is the original one */
+	for (n = 0; n < diskmax; ++n) {
+		struct snapraid_dup_worker* worker = &workervec[n];
+		unsigned j;
 
-			hash32 = hash_hash(hash);
+		for (j = 0; j < worker->hashmax; ++j) {
+			struct snapraid_hash* hash = &worker->hashvec[j];
+			tommy_hash_t hash32 = hash_hash(hash);
 
 			struct snapraid_hash* found = tommy_hashdyn_search(&hashset, hash_compare, hash->hash, hash32);
 			if (found) {
-				++count;
-				size += found->file->size;
-				log_tag("dup:%s:%s:%s:%s:%" PRIu64 ": dup\n", disk->name, esc(file->sub), found->disk->name, esc(found->file->sub), found->file->size);
-				printf("%12" PRIu64 " %s%s = %s%s\n", file->size, disk->dir, file->sub, found->disk->dir, found->file->sub);
-				hash_free(hash);
+				struct snapraid_dup* dup = malloc_nofail(sizeof(struct snapraid_dup));
+				dup->hash = hash;
+				dup->found = found;
+				tommy_list_insert_tail(&duplist, &dup->node, dup);
 			} else {
 				tommy_hashdyn_insert(&hashset, &hash->node, hash, hash32);
 			}
 		}
 	}
 
-	tommy_hashdyn_foreach(&hashset, (tommy_foreach_func*)hash_free);
+	/* print the duplicates wasting more space first */
+	tommy_list_sort(&duplist, dup_compare);
+
+	for (i = tommy_list_head(&duplist); i != 0; i = i->next) {
+		struct snapraid_dup* dup = i->data;
+		struct snapraid_disk* disk = dup->hash->disk;
+		struct snapraid_file* file = dup->hash->file;
+		struct snapraid_hash* found = dup->found;
+
+		++count;
+		size += found->file->size;
+		log_tag("dup:%s:%s:%s:%s:%" PRIu64 ": dup\n", disk->name, esc(file->sub), found->disk->name, esc(found->file->sub), found->file->size);
+		printf("%12" PRIu64 " %s%s = %s%s\n", file->size, disk->dir, file->sub, found->disk->dir, found->file->sub);
+	}
+
+	tommy_list_foreach(&duplist, free);
 	tommy_hashdyn_done(&hashset);
+	for (n = 0; n < diskmax; ++n)
+		free(workervec[n].hashvec);
+	free(workervec);
 
 	msg_status("\n");
 	msg_status("%8u duplicates, for %" PRIu64 " GB\n", count, size / GIGA);
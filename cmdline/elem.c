@@ -166,100 +166,391 @@ const char* filter_type(struct snapraid_filter* filter, char* out, size_t out_si
 	return out;
 }
 
-static int filter_apply(struct snapraid_filter* filter, struct snapraid_filter** reason, const char* path, const char* name, int is_dir)
+/**
+ * Chars with a special meaning in the patterns.
+ */
+static int filter_is_special(char c)
 {
-	int ret = 0;
+	return c == '*' || c == '?' || c == '[' || c == '\\';
+}
 
-	/* match dirs with dirs and files with files */
-	if (filter->is_dir && !is_dir)
-		return 0;
-	if (!filter->is_dir && is_dir)
-		return 0;
+/**
+ * Fold a key as done by fnmatch() when comparing.
+ * Return the folded key, that may be the same one.
+ */
+static const char* filter_fold(char* buf, size_t size, const char* str)
+{
+#ifdef _WIN32
+	size_t i;
+
+	for (i = 0; str[i] != 0 && i + 1 < size; ++i)
+		buf[i] = tolower((unsigned char)str[i]);
+	buf[i] = 0;
+
+	return buf;
+#else
+	(void)buf;
+	(void)size;
+	return str;
+#endif
+}
 
-	if (filter->is_path) {
-		/* skip initial slash, as always missing from the path */
-		if (fnmatch(filter->pattern + 1, path, FNM_PATHNAME | FNM_CASEINSENSITIVE_FOR_WIN) == 0)
-			ret = filter->direction;
-	} else {
-		if (fnmatch(filter->pattern, name, FNM_CASEINSENSITIVE_FOR_WIN) == 0)
-			ret = filter->direction;
+static int filter_key_compare(const void* void_arg, const void* void_data)
+{
+	const char* arg = void_arg;
+	const struct snapraid_filter_key* key = void_data;
+
+	return strcmp(arg, key->key);
+}
+
+static void filter_key_free(struct snapraid_filter_key* key)
+{
+	free(key->key);
+	free(key);
+}
+
+/**
+ * Insert a key, keeping the lowest position for duplicates.
+ */
+static void filter_key_insert(tommy_hashdyn* keyset, const char* str, struct snapraid_filter* filter)
+{
+	struct snapraid_filter_key* key;
+	char buf[PATH_MAX];
+	tommy_hash_t hash;
+
+	str = filter_fold(buf, sizeof(buf), str);
+	hash = tommy_hash_u32(0, str, strlen(str));
+
+	key = tommy_hashdyn_search(keyset, filter_key_compare, str, hash);
+	if (key) {
+		/* the first one wins */
+		return;
 	}
 
-	if (reason != 0 && ret < 0)
-		*reason = filter;
+	key = malloc_nofail(sizeof(struct snapraid_filter_key));
+	key->key = strdup_nofail(str);
+	key->filter = filter;
+	tommy_hashdyn_insert(keyset, &key->node, key, hash);
+}
+
+/**
+ * Check if the filter is before the best one found.
+ */
+static inline int filter_is_better(struct snapraid_filter* filter, struct snapraid_filter* best)
+{
+	return best == 0 || filter->index < best->index;
+}
+
+/**
+ * Search a key, and update the first filter matching.
+ */
+static void filter_key_search(tommy_hashdyn* keyset, const char* str, struct snapraid_filter** best)
+{
+	struct snapraid_filter_key* key;
+	char buf[PATH_MAX];
+
+	if (tommy_hashdyn_count(keyset) == 0)
+		return;
+
+	str = filter_fold(buf, sizeof(buf), str);
 
-	return ret;
+	key = tommy_hashdyn_search(keyset, filter_key_compare, str, tommy_hash_u32(0, str, strlen(str)));
+	if (key && filter_is_better(key->filter, *best))
+		*best = key->filter;
 }
 
-static int filter_recurse(struct snapraid_filter* filter, struct snapraid_filter** reason, const char* const_path, int is_dir)
+static void filter_trie_init(struct snapraid_filter_trie* trie, char c)
 {
-	char path[PATH_MAX];
-	char* name;
-	unsigned i;
+	trie->c = c;
+	trie->child = 0;
+	trie->next = 0;
+	tommy_list_init(&trie->filterlist);
+}
 
-	pathcpy(path, sizeof(path), const_path);
+static void filter_trie_done(struct snapraid_filter_trie* trie)
+{
+	struct snapraid_filter_trie* i = trie->child;
 
-	/* filter for all the directories */
-	name = path;
-	for (i = 0; path[i] != 0; ++i) {
-		if (path[i] == '/') {
-			/* set a terminator */
-			path[i] = 0;
+	while (i) {
+		struct snapraid_filter_trie* next = i->next;
+		filter_trie_done(i);
+		free(i);
+		i = next;
+	}
+}
+
+/**
+ * Insert a filter in the trie at the node of its literal prefix.
+ */
+static void filter_trie_insert(struct snapraid_filter_trie* trie, struct snapraid_filter* filter, const char* pattern)
+{
+	char buf[PATH_MAX];
+	const char* i;
+
+	pattern = filter_fold(buf, sizeof(buf), pattern);
 
-			/* filter the directory */
-			if (filter_apply(filter, reason, path, name, 1) != 0)
-				return filter->direction;
+	for (i = pattern; *i != 0 && !filter_is_special(*i); ++i) {
+		struct snapraid_filter_trie* child;
 
-			/* restore the slash */
-			path[i] = '/';
+		for (child = trie->child; child != 0; child = child->next)
+			if (child->c == *i)
+				break;
 
-			/* next name */
-			name = path + i + 1;
+		if (!child) {
+			child = malloc_nofail(sizeof(struct snapraid_filter_trie));
+			filter_trie_init(child, *i);
+			child->next = trie->child;
+			trie->child = child;
 		}
+
+		trie = child;
 	}
 
-	/* filter the final file */
-	if (filter_apply(filter, reason, path, name, is_dir) != 0)
-		return filter->direction;
+	tommy_list_insert_tail(&trie->filterlist, &filter->setnode, filter);
+}
 
-	return 0;
+/**
+ * Match the filters of the trie with a prefix of the string.
+ * Only the filters before the best one found are checked.
+ */
+static void filter_trie_search(struct snapraid_filter_trie* trie, const char* str, int is_path, struct snapraid_filter** best)
+{
+	char buf[PATH_MAX];
+	const char* i;
+
+	i = filter_fold(buf, sizeof(buf), str);
+
+	while (1) {
+		tommy_node* j;
+
+		for (j = tommy_list_head(&trie->filterlist); j != 0; j = j->next) {
+			struct snapraid_filter* filter = j->data;
+
+			/* filters are in order, so the following ones cannot be better */
+			if (!filter_is_better(filter, *best))
+				break;
+
+			if (is_path) {
+				/* skip initial slash, as always missing from the path */
+				if (fnmatch(filter->pattern + 1, str, FNM_PATHNAME | FNM_CASEINSENSITIVE_FOR_WIN) == 0) {
+					*best = filter;
+					break;
+				}
+			} else {
+				if (fnmatch(filter->pattern, str, FNM_CASEINSENSITIVE_FOR_WIN) == 0) {
+					*best = filter;
+					break;
+				}
+			}
+		}
+
+		if (*i == 0)
+			break;
+
+		for (trie = trie->child; trie != 0; trie = trie->next)
+			if (trie->c == *i)
+				break;
+
+		if (!trie)
+			break;
+
+		++i;
+	}
+}
+
+static void filter_class_init(struct snapraid_filter_class* filterclass)
+{
+	tommy_hashdyn_init(&filterclass->literalset);
+	tommy_hashdyn_init(&filterclass->extset);
+	filter_trie_init(&filterclass->root, 0);
+}
+
+static void filter_class_done(struct snapraid_filter_class* filterclass)
+{
+	tommy_hashdyn_foreach(&filterclass->literalset, (tommy_foreach_func*)filter_key_free);
+	tommy_hashdyn_done(&filterclass->literalset);
+	tommy_hashdyn_foreach(&filterclass->extset, (tommy_foreach_func*)filter_key_free);
+	tommy_hashdyn_done(&filterclass->extset);
+	filter_trie_done(&filterclass->root);
+}
+
+/**
+ * Insert a filter in the class, selecting the fastest way to match it.
+ */
+static void filter_class_insert(struct snapraid_filter_class* filterclass, struct snapraid_filter* filter)
+{
+	const char* pattern = filter->pattern;
+	const char* i;
+	int has_special;
+	int has_dot;
+
+	/* skip initial slash, as always missing from the path */
+	if (filter->is_path)
+		++pattern;
+
+	has_special = 0;
+	for (i = pattern; *i != 0; ++i)
+		if (filter_is_special(*i))
+			has_special = 1;
+
+	/* without wildcards, it's an exact match */
+	if (!has_special) {
+		filter_key_insert(&filterclass->literalset, pattern, filter);
+		return;
+	}
+
+	/* a "*.ext" name matches all the names with the same last extension */
+	if (!filter->is_path && pattern[0] == '*' && pattern[1] == '.') {
+		has_special = 0;
+		has_dot = 0;
+		for (i = pattern + 2; *i != 0; ++i) {
+			if (filter_is_special(*i))
+				has_special = 1;
+			if (*i == '.')
+				has_dot = 1;
+		}
+
+		if (!has_special && !has_dot) {
+			filter_key_insert(&filterclass->extset, pattern + 1, filter);
+			return;
+		}
+	}
+
+	filter_trie_insert(&filterclass->root, filter, pattern);
 }
 
-static int filter_element(tommy_list* filterlist, struct snapraid_filter** reason, const char* disk, const char* sub, int is_dir)
+/**
+ * Match a name or a path with the filters of the class.
+ */
+static void filter_class_search(struct snapraid_filter_class* filterclass, const char* str, int is_path, struct snapraid_filter** best)
+{
+	filter_key_search(&filterclass->literalset, str, best);
+
+	if (!is_path) {
+		const char* ext = strrchr(str, '.');
+		if (ext)
+			filter_key_search(&filterclass->extset, ext, best);
+	}
+
+	filter_trie_search(&filterclass->root, str, is_path, best);
+}
+
+void filterset_init(struct snapraid_filterset* filterset, tommy_list* filterlist)
 {
 	tommy_node* i;
+	unsigned index;
 
-	int direction = 1; /* by default include all */
+	filterset->last = 0;
+	filterset->count_disk = 0;
+	filter_class_init(&filterset->name_file);
+	filter_class_init(&filterset->name_dir);
+	filter_class_init(&filterset->path_file);
+	filter_class_init(&filterset->path_dir);
+	tommy_list_init(&filterset->disklist);
 
-	/* for each filter */
+	index = 0;
 	for (i = tommy_list_head(filterlist); i != 0; i = i->next) {
-		int ret;
 		struct snapraid_filter* filter = i->data;
 
+		filter->index = index++;
+
 		if (filter->is_disk) {
-			if (fnmatch(filter->pattern, disk, FNM_CASEINSENSITIVE_FOR_WIN) == 0)
-				ret = filter->direction;
+			tommy_list_insert_tail(&filterset->disklist, &filter->setnode, filter);
+			++filterset->count_disk;
+		} else if (filter->is_path) {
+			if (filter->is_dir)
+				filter_class_insert(&filterset->path_dir, filter);
 			else
-				ret = 0;
-			if (reason != 0 && ret < 0)
-				*reason = filter;
+				filter_class_insert(&filterset->path_file, filter);
+		} else {
+			if (filter->is_dir)
+				filter_class_insert(&filterset->name_dir, filter);
+			else
+				filter_class_insert(&filterset->name_file, filter);
+		}
+
+		filterset->last = filter;
+	}
+
+	filterset->count = index;
+}
+
+void filterset_done(struct snapraid_filterset* filterset)
+{
+	filter_class_done(&filterset->name_file);
+	filter_class_done(&filterset->name_dir);
+	filter_class_done(&filterset->path_file);
+	filter_class_done(&filterset->path_dir);
+}
+
+static int filter_element(struct snapraid_filterset* filterset, struct snapraid_filter** reason, const char* disk, const char* sub, int is_dir)
+{
+	struct snapraid_filter* best;
+	tommy_node* i;
+
+	/* the first filter that matches wins */
+	best = 0;
+
+	/* if there are filters for files and directories */
+	if (filterset->count_disk < filterset->count) {
+		char path[PATH_MAX];
+		char* name;
+		unsigned j;
+
+		pathcpy(path, sizeof(path), sub);
+
+		/* filter for all the directories */
+		name = path;
+		for (j = 0; path[j] != 0; ++j) {
+			if (path[j] == '/') {
+				/* set a terminator */
+				path[j] = 0;
+
+				/* filter the directory */
+				filter_class_search(&filterset->path_dir, path, 1, &best);
+				filter_class_search(&filterset->name_dir, name, 0, &best);
+
+				/* restore the slash */
+				path[j] = '/';
+
+				/* next name */
+				name = path + j + 1;
+			}
+		}
+
+		/* filter the final file */
+		if (is_dir) {
+			filter_class_search(&filterset->path_dir, path, 1, &best);
+			filter_class_search(&filterset->name_dir, name, 0, &best);
 		} else {
-			ret = filter_recurse(filter, reason, sub, is_dir);
+			filter_class_search(&filterset->path_file, path, 1, &best);
+			filter_class_search(&filterset->name_file, name, 0, &best);
 		}
+	}
 
-		if (ret > 0) {
+	/* disk filters before the best one */
+	for (i = tommy_list_head(&filterset->disklist); i != 0; i = i->next) {
+		struct snapraid_filter* filter = i->data;
+
+		if (!filter_is_better(filter, best))
+			break;
+
+		if (fnmatch(filter->pattern, disk, FNM_CASEINSENSITIVE_FOR_WIN) == 0) {
+			best = filter;
+			break;
+		}
+	}
+
+	if (best != 0) {
+		if (best->direction > 0) {
 			/* include the file */
 			return 0;
-		} else if (ret < 0) {
-			/* exclude the file */
-			return -1;
-		} else {
-			/* default is opposite of the last filter */
-			direction = -filter->direction;
-			if (reason != 0 && direction < 0)
-				*reason = filter;
-			/* continue with the next one */
 		}
+
+		/* exclude the file */
+		if (reason != 0)
+			*reason = best;
+		return -1;
 	}
 
 	/* directories are always included by default, otherwise we cannot apply rules */
@@ -268,20 +559,24 @@ static int filter_element(tommy_list* filterlist, struct snapraid_filter** reaso
 		return 0;
 
 	/* files are excluded/included depending of the last rule processed */
-	if (direction < 0)
+	/* as the default is opposite of the last filter */
+	if (filterset->last != 0 && filterset->last->direction > 0) {
+		if (reason != 0)
+			*reason = filterset->last;
 		return -1;
+	}
 
 	return 0;
 }
 
-int filter_path(tommy_list* filterlist, struct snapraid_filter** reason, const char* disk, const char* sub)
+int filter_path(struct snapraid_filterset* filterset, struct snapraid_filter** reason, const char* disk, const char* sub)
 {
-	return filter_element(filterlist, reason, disk, sub, 0);
+	return filter_element(filterset, reason, disk, sub, 0);
 }
 
-int filter_dir(tommy_list* filterlist, struct snapraid_filter** reason, const char* disk, const char* sub)
+int filter_dir(struct snapraid_filterset* filterset, struct snapraid_filter** reason, const char* disk, const char* sub)
 {
-	return filter_element(filterlist, reason, disk, sub, 1);
+	return filter_element(filterset, reason, disk, sub, 1);
 }
 
 int filter_existence(int filter_missing, const char* dir, const char* sub)
@@ -350,6 +645,14 @@ int filter_content(tommy_list* contentlist, const char* path)
 		pathprint(tmp, sizeof(tmp), "%s.lock", content->content);
 		if (pathcmp(tmp, path) == 0)
 			return -1;
+
+		/* exclude also the ".status" summary, and the ".tmp" copy used to save it */
+		pathprint(tmp, sizeof(tmp), "%s.status", content->content);
+		if (pathcmp(tmp, path) == 0)
+			return -1;
+		pathprint(tmp, sizeof(tmp), "%s.status.tmp", content->content);
+		if (pathcmp(tmp, path) == 0)
+			return -1;
 	}
 
 	return 0;
@@ -420,25 +723,30 @@ void file_rename(struct snapraid_file* file, const char* sub)
 
 void file_copy(struct snapraid_file* src_file, struct snapraid_file* dst_file)
 {
-	block_off_t i;
-
-	if (src_file->size != dst_file->size) {
+	if (src_file->mtime_sec != dst_file->mtime_sec) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency in copy file with different size\n");
+		log_fatal("Internal inconsistency in copy file with different mtime_sec\n");
 		exit(EXIT_FAILURE);
 		/* LCOV_EXCL_STOP */
 	}
 
-	if (src_file->mtime_sec != dst_file->mtime_sec) {
+	if (src_file->mtime_nsec != dst_file->mtime_nsec) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency in copy file with different mtime_sec\n");
+		log_fatal("Internal inconsistency in copy file with different mtime_nsec\n");
 		exit(EXIT_FAILURE);
 		/* LCOV_EXCL_STOP */
 	}
 
-	if (src_file->mtime_nsec != dst_file->mtime_nsec) {
+	file_copy_hash(src_file, dst_file);
+}
+
+void file_copy_hash(struct snapraid_file* src_file, struct snapraid_file* dst_file)
+{
+	block_off_t i;
+
+	if (src_file->size != dst_file->size) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency in copy file with different mtime_nsec\n");
+		log_fatal("Internal inconsistency in copy file with different size\n");
 		exit(EXIT_FAILURE);
 		/* LCOV_EXCL_STOP */
 	}
@@ -712,6 +1020,33 @@ int dir_name_compare(const void* void_arg, const void* void_data)
 	return strcmp(arg, dir->sub);
 }
 
+struct snapraid_dirstamp* dirstamp_alloc(const char* sub, int64_t mtime_sec, int mtime_nsec, uint32_t count)
+{
+	struct snapraid_dirstamp* dirstamp;
+
+	dirstamp = malloc_nofail(sizeof(struct snapraid_dirstamp));
+	dirstamp->sub = strdup_nofail(sub);
+	dirstamp->mtime_sec = mtime_sec;
+	dirstamp->mtime_nsec = mtime_nsec;
+	dirstamp->count = count;
+
+	return dirstamp;
+}
+
+void dirstamp_free(struct snapraid_dirstamp* dirstamp)
+{
+	free(dirstamp->sub);
+	free(dirstamp);
+}
+
+int dirstamp_name_compare(const void* void_arg, const void* void_data)
+{
+	const char* arg = void_arg;
+	const struct snapraid_dirstamp* dirstamp = void_data;
+
+	return strcmp(arg, dirstamp->sub);
+}
+
 struct snapraid_disk* disk_alloc(const char* name, const char* dir, uint64_t dev, int skip)
 {
 	struct snapraid_disk* disk;
@@ -726,6 +1061,8 @@ struct snapraid_disk* disk_alloc(const char* name, const char* dir, uint64_t dev
 	disk->smartctl[0] = 0;
 	disk->device = dev;
 	disk->tick = 0;
+	memset(&disk->latency, 0, sizeof(disk->latency));
+	disk->read_bytes = 0;
 	disk->total_blocks = 0;
 	disk->free_blocks = 0;
 	disk->first_free_block = 0;
@@ -736,6 +1073,8 @@ struct snapraid_disk* disk_alloc(const char* name, const char* dir, uint64_t dev
 	disk->had_empty_uuid = 0;
 	disk->mapping_idx = -1;
 	disk->skip_access = skip;
+	disk->watch_session[0] = 0;
+	disk->watch_offset = 0;
 	tommy_list_init(&disk->filelist);
 	tommy_list_init(&disk->deletedlist);
 	tommy_hashdyn_init(&disk->inodeset);
@@ -745,6 +1084,8 @@ struct snapraid_disk* disk_alloc(const char* name, const char* dir, uint64_t dev
 	tommy_hashdyn_init(&disk->linkset);
 	tommy_list_init(&disk->dirlist);
 	tommy_hashdyn_init(&disk->dirset);
+	tommy_list_init(&disk->dirstamplist);
+	tommy_hashdyn_init(&disk->dirstampset);
 	tommy_tree_init(&disk->fs_parity, chunk_parity_compare);
 	tommy_tree_init(&disk->fs_file, chunk_file_compare);
 	disk->fs_last = 0;
@@ -764,6 +1105,8 @@ void disk_free(struct snapraid_disk* disk)
 	tommy_hashdyn_done(&disk->linkset);
 	tommy_list_foreach(&disk->dirlist, (tommy_foreach_func*)dir_free);
 	tommy_hashdyn_done(&disk->dirset);
+	tommy_list_foreach(&disk->dirstamplist, (tommy_foreach_func*)dirstamp_free);
+	tommy_hashdyn_done(&disk->dirstampset);
 	free(disk);
 }
 
@@ -1283,14 +1626,113 @@ void map_free(struct snapraid_map* map)
 	free(map);
 }
 
-int time_compare(const void* void_a, const void* void_b)
+static int timecount_compare(const void* void_arg, const void* void_data)
 {
-	const time_t* time_a = void_a;
-	const time_t* time_b = void_b;
+	const time_t* arg = void_arg;
+	const struct snapraid_timecount* data = void_data;
+
+	return *arg != data->time;
+}
 
-	if (*time_a < *time_b)
+static int timecount_sort(const void* void_a, const void* void_b)
+{
+	const struct snapraid_timecount* const* a = void_a;
+	const struct snapraid_timecount* const* b = void_b;
+
+	if ((*a)->time < (*b)->time)
 		return -1;
-	if (*time_a > *time_b)
+	if ((*a)->time > (*b)->time)
 		return 1;
 	return 0;
 }
+
+static tommy_uint32_t timecount_hash(time_t time)
+{
+	return (tommy_uint32_t)tommy_inthash_u64((tommy_uint64_t)time);
+}
+
+void timemap_init(struct snapraid_timemap* map)
+{
+	tommy_hashdyn_init(&map->set);
+	map->last = 0;
+	map->vec = 0;
+	map->size = 0;
+	map->count = 0;
+}
+
+void timemap_done(struct snapraid_timemap* map)
+{
+	tommy_hashdyn_foreach(&map->set, free);
+	tommy_hashdyn_done(&map->set);
+	free(map->vec);
+}
+
+void timemap_insert(struct snapraid_timemap* map, time_t time, block_off_t count)
+{
+	struct snapraid_timecount* entry = map->last;
+
+	if (!entry || entry->time != time) {
+		tommy_uint32_t hash = timecount_hash(time);
+
+		entry = tommy_hashdyn_search(&map->set, timecount_compare, &time, hash);
+		if (!entry) {
+			entry = malloc_nofail(sizeof(struct snapraid_timecount));
+			entry->time = time;
+			entry->count = 0;
+			tommy_hashdyn_insert(&map->set, &entry->node, entry, hash);
+		}
+
+		map->last = entry;
+	}
+
+	entry->count += count;
+	map->count += count;
+}
+
+static void timemap_collect(void* void_arg, void* void_data)
+{
+	struct snapraid_timemap* map = void_arg;
+	struct snapraid_timecount* entry = void_data;
+
+	map->vec[map->size++] = entry;
+}
+
+void timemap_sort(struct snapraid_timemap* map)
+{
+	free(map->vec);
+
+	map->vec = malloc_nofail((tommy_hashdyn_count(&map->set) + 1) * sizeof(struct snapraid_timecount*));
+	map->size = 0;
+	tommy_hashdyn_foreach_arg(&map->set, timemap_collect, map);
+
+	qsort(map->vec, map->size, sizeof(struct snapraid_timecount*), timecount_sort);
+}
+
+time_t timemap_nth(struct snapraid_timemap* map, block_off_t pos)
+{
+	unsigned i;
+
+	for (i = 0; i < map->size; ++i) {
+		if (pos < map->vec[i]->count)
+			return map->vec[i]->time;
+		pos -= map->vec[i]->count;
+	}
+
+	/* beyond the end, return the most recent time */
+	if (map->size != 0)
+		return map->vec[map->size - 1]->time;
+
+	return 0;
+}
+
+block_off_t timemap_rank(struct snapraid_timemap* map, time_t time)
+{
+	block_off_t count;
+	unsigned i;
+
+	count = 0;
+	for (i = 0; i < map->size && map->vec[i]->time <= time; ++i)
+		count += map->vec[i]->count;
+
+	return count;
+}
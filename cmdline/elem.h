@@ -67,7 +67,54 @@ struct snapraid_filter {
 	int is_path; /**< If the pattern is only for the complete path. */
 	int is_dir; /**< If the pattern is only for dir. */
 	int direction; /**< If it's an inclusion (=1) or an exclusion (=-1). */
+	unsigned index; /**< Position in the filter set. */
 	tommy_node node; /**< Next node in the list. */
+	tommy_node setnode; /**< Next node in the filter set. */
+};
+
+/**
+ * Key of a filter without wildcards, or of an extension.
+ */
+struct snapraid_filter_key {
+	char* key; /**< Name, path or extension with the initial dot. */
+	struct snapraid_filter* filter; /**< First filter with this key. */
+	tommy_hashdyn_node node;
+};
+
+/**
+ * Node of the trie of the literal prefixes of the filters with wildcards.
+ */
+struct snapraid_filter_trie {
+	char c; /**< Char of the prefix. */
+	struct snapraid_filter_trie* child; /**< First child. */
+	struct snapraid_filter_trie* next; /**< Next sibling. */
+	tommy_list filterlist; /**< Filters with this prefix, in set order. */
+};
+
+/**
+ * Filters applied to the same kind of element.
+ */
+struct snapraid_filter_class {
+	tommy_hashdyn literalset; /**< Filters without wildcards. */
+	tommy_hashdyn extset; /**< Filters in the "*.ext" form. Only for names. */
+	struct snapraid_filter_trie root; /**< Other filters by literal prefix. */
+};
+
+/**
+ * Compiled list of filters.
+ *
+ * The filters are indexed to call fnmatch() only for the ones that can match,
+ * keeping the result of applying all of them in order.
+ */
+struct snapraid_filterset {
+	struct snapraid_filter* last; /**< Last filter. Zero if none. */
+	unsigned count; /**< Number of filters. */
+	unsigned count_disk; /**< Number of disk filters. */
+	struct snapraid_filter_class name_file; /**< Filters for file names. */
+	struct snapraid_filter_class name_dir; /**< Filters for dir names. */
+	struct snapraid_filter_class path_file; /**< Filters for file paths. */
+	struct snapraid_filter_class path_dir; /**< Filters for dir paths. */
+	tommy_list disklist; /**< Filters for disk names. */
 };
 
 /**
@@ -253,6 +300,19 @@ struct snapraid_block {
 #define FILE_IS_JUNCTION 0x8000 /**< If it's a junction for Windows. Not yet supported. */
 #define FILE_IS_LINK_MASK 0xF000 /**< Mask for link type. */
 
+/**
+ * If the file replaces a file with the same name.
+ * It's used in scan to report later the files searched for a copy with the same content.
+ */
+#define FILE_IS_UPDATED 0x10000
+
+/**
+ * If the file has hardlinks.
+ * It's used in scan to always check it with lstat(), as it could be changed
+ * using the name of the hardlink, without changing its dir.
+ */
+#define FILE_IS_HARDLINKED 0x20000
+
 /**
  * File.
  */
@@ -299,6 +359,23 @@ struct snapraid_dir {
 	tommy_hashdyn_node nodeset;
 };
 
+/**
+ * Dir stamp.
+ *
+ * Modification time and number of entries of a directory at the last scan.
+ * It's used by the quick scan to detect directories that didn't change.
+ */
+struct snapraid_dirstamp {
+	int64_t mtime_sec; /**< Modification time of the dir. */
+	int mtime_nsec; /**< Modification time nanoseconds. In the range 0 <= x < 1,000,000,000, or STAT_NSEC_INVALID if not present. */
+	uint32_t count; /**< Number of entries in the dir, excluding "." and "..". */
+	char* sub; /**< Sub path of the dir. Without the disk dir. Empty for the disk root. */
+
+	/* nodes for data structures */
+	tommy_node nodelist;
+	tommy_hashdyn_node nodeset;
+};
+
 /**
  * Chunk.
  *
@@ -313,6 +390,51 @@ struct snapraid_chunk {
 	tommy_tree_node file_node; /**< Tree sorter by <file,file_pos>. */
 };
 
+/**
+ * Max length of the watcher session identifier.
+ */
+#define WATCH_SESSION_MAX 64
+
+/**
+ * Number of buckets of the latency histograms.
+ */
+#define LATENCY_MAX 32
+
+/**
+ * Latency histogram of the disk operations.
+ *
+ * The bucket i counts the operations taking from 2^i to 2^(i+1) - 1
+ * microseconds. The bucket 0 counts also the ones taking 0.
+ */
+struct snapraid_latency {
+	uint64_t count; /**< Number of operations. */
+	uint64_t total; /**< Total time in microseconds. */
+	uint64_t max; /**< Max time in microseconds. */
+	uint64_t last; /**< Time of the last operation in microseconds. */
+	uint64_t bucket[LATENCY_MAX]; /**< Histogram. */
+};
+
+/**
+ * Add an operation in the latency histogram.
+ */
+static inline void latency_add(struct snapraid_latency* latency, uint64_t us)
+{
+	uint64_t v = us >> 1;
+	unsigned i = 0;
+
+	while (v != 0 && i + 1 < LATENCY_MAX) {
+		v >>= 1;
+		++i;
+	}
+
+	++latency->count;
+	latency->total += us;
+	if (us > latency->max)
+		latency->max = us;
+	latency->last = us;
+	++latency->bucket[i];
+}
+
 /**
  * Disk.
  */
@@ -322,6 +444,8 @@ struct snapraid_disk {
 	char smartctl[PATH_MAX]; /**< Custom command for smartctl. Empty means auto. */
 	uint64_t device; /**< Device identifier. */
 	uint64_t tick; /**< Usage time of the disk. */
+	struct snapraid_latency latency; /**< Latency of the disk reads. */
+	uint64_t read_bytes; /**< Bytes read from the disk. */
 	block_off_t total_blocks; /**< Number of total blocks. */
 	block_off_t free_blocks; /**< Number of free blocks at the last sync. */
 
@@ -339,6 +463,8 @@ struct snapraid_disk {
 	int had_empty_uuid; /**< If the disk had an empty UUID, meaning that it's a new disk. */
 	int mapping_idx; /**< Index in the mapping vector. Used only as buffer when writing the content file. */
 	int skip_access; /**< If the disk is unaccessible and it should be skipped. */
+	char watch_session[WATCH_SESSION_MAX]; /**< Session of the watcher change log already processed. Empty if none. */
+	uint64_t watch_offset; /**< Position in the watcher change log from where to continue. */
 
 	/**
 	 * Mapping of chunks in the parity.
@@ -373,6 +499,8 @@ struct snapraid_disk {
 	tommy_hashdyn linkset; /**< Hashtable by name of all the links. */
 	tommy_list dirlist; /**< List of all the dirs. */
 	tommy_hashdyn dirset; /**< Hashtable by name of all the dirs. */
+	tommy_list dirstamplist; /**< List of all the dir stamps. Used only by the quick scan. */
+	tommy_hashdyn dirstampset; /**< Hashtable by name of all the dir stamps. */
 
 	/* nodes for data structures */
 	tommy_node node;
@@ -414,6 +542,21 @@ struct snapraid_parity {
 	 * Cumulative time used for parity disks.
 	 */
 	uint64_t tick;
+
+	/**
+	 * Cumulative time used for parity writes, included also in tick.
+	 */
+	uint64_t write_tick;
+
+	/**
+	 * Latency of the parity reads.
+	 */
+	struct snapraid_latency latency;
+
+	/**
+	 * Latency of the parity writes.
+	 */
+	struct snapraid_latency write_latency;
 };
 
 /**
@@ -446,6 +589,17 @@ struct snapraid_filter* filter_alloc_disk(int is_include, const char* pattern);
  */
 void filter_free(struct snapraid_filter* filter);
 
+/**
+ * Compile a list of filters.
+ * The list must not be changed until the set is deallocated.
+ */
+void filterset_init(struct snapraid_filterset* filterset, tommy_list* filterlist);
+
+/**
+ * Deallocate a compiled list of filters.
+ */
+void filterset_done(struct snapraid_filterset* filterset);
+
 /**
  * Filter type description.
  */
@@ -469,7 +623,7 @@ static inline int filter_hidden(int enable, struct dirent* dd)
  * For each element of the path all the filters are applied, until the first one that matches.
  * Return !=0 if it should be excluded.
  */
-int filter_path(tommy_list* filterlist, struct snapraid_filter** reason, const char* disk, const char* sub);
+int filter_path(struct snapraid_filterset* filterset, struct snapraid_filter** reason, const char* disk, const char* sub);
 
 /**
  * Filter a file/link/dir if missing.
@@ -489,7 +643,7 @@ int filter_correctness(int filter_error, tommy_arrayblkof* infoarr, struct snapr
  * For each element of the path all the filters are applied, until the first one that matches.
  * Return !=0 if should be excluded.
  */
-int filter_dir(tommy_list* filterlist, struct snapraid_filter** reason, const char* disk, const char* sub);
+int filter_dir(struct snapraid_filterset* filterset, struct snapraid_filter** reason, const char* disk, const char* sub);
 
 /**
  * Filter a path if it's a content file.
@@ -678,6 +832,11 @@ void file_rename(struct snapraid_file* file, const char* sub);
  */
 void file_copy(struct snapraid_file* src_file, struct snapraid_file* dest_file);
 
+/**
+ * Copy the hash of a file with the same content, but not necessarily the same time stamp.
+ */
+void file_copy_hash(struct snapraid_file* src_file, struct snapraid_file* dest_file);
+
 /**
  * Return the name of the file, without the dir.
  */
@@ -863,6 +1022,21 @@ static inline tommy_uint32_t dir_name_hash(const char* name)
 	return tommy_hash_u32(0, name, strlen(name));
 }
 
+/**
+ * Allocate a dir stamp.
+ */
+struct snapraid_dirstamp* dirstamp_alloc(const char* sub, int64_t mtime_sec, int mtime_nsec, uint32_t count);
+
+/**
+ * Deallocate a dir stamp.
+ */
+void dirstamp_free(struct snapraid_dirstamp* dirstamp);
+
+/**
+ * Compare a dir stamp with a name.
+ */
+int dirstamp_name_compare(const void* void_arg, const void* void_data);
+
 /**
  * Allocate a disk.
  */
@@ -1095,9 +1269,52 @@ static inline snapraid_info info_get(tommy_arrayblkof* array, unsigned pos)
 }
 
 /**
- * Compare times
+ * Number of blocks with the same time.
+ */
+struct snapraid_timecount {
+	time_t time; /**< Time of the blocks. */
+	block_off_t count; /**< Number of blocks with this time. */
+	tommy_hashdyn_node node;
+};
+
+/**
+ * Histogram of the block times.
+ *
+ * It uses memory proportional to the number of distinct times, and not to the
+ * number of blocks, as all the blocks synced or scrubbed by the same command
+ * share the same time.
+ */
+struct snapraid_timemap {
+	tommy_hashdyn set; /**< Counts by time. */
+	struct snapraid_timecount* last; /**< Last count used. Consecutive blocks usually share the time. */
+	struct snapraid_timecount** vec; /**< Counts sorted by time. Valid after timemap_sort(). */
+	unsigned size; /**< Number of distinct times. Valid after timemap_sort(). */
+	block_off_t count; /**< Total number of blocks. */
+};
+
+void timemap_init(struct snapraid_timemap* map);
+void timemap_done(struct snapraid_timemap* map);
+
+/**
+ * Add the specified number of blocks with the specified time.
+ */
+void timemap_insert(struct snapraid_timemap* map, time_t time, block_off_t count);
+
+/**
+ * Sort the distinct times.
+ * It has to be called after all the inserts, and before the queries.
+ */
+void timemap_sort(struct snapraid_timemap* map);
+
+/**
+ * Get the time of the block at the specified position, as if all the block times were sorted.
+ */
+time_t timemap_nth(struct snapraid_timemap* map, block_off_t pos);
+
+/**
+ * Get the number of blocks with a time less or equal than the specified one.
  */
-int time_compare(const void* void_a, const void* void_b);
+block_off_t timemap_rank(struct snapraid_timemap* map, time_t time);
 
 #endif
 
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2013 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "support.h"
+#include "fetch.h"
+
+/****************************************************************************/
+/* fetch */
+
+void fetch_init(struct snapraid_fetch* fetch)
+{
+	tommy_list_init(&fetch->filelist);
+	fetch->count = 0;
+	fetch->ahead = 0;
+	fetch->ahead_file = 0;
+	fetch->ahead_offset = 0;
+	fetch->ahead_size = 0;
+	fetch->buffer = 0;
+	fetch->block_size = 0;
+}
+
+static void fetch_file_close(struct snapraid_fetch_file* file)
+{
+	if (close(file->f) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error closing file '%s'. %s.\n", file->path, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	free(file->path);
+	free(file);
+}
+
+void fetch_done(struct snapraid_fetch* fetch)
+{
+	tommy_list_foreach(&fetch->filelist, (tommy_foreach_func*)fetch_file_close);
+	free(fetch->buffer);
+}
+
+/**
+ * Get the open file from the cache, or open it.
+ */
+static struct snapraid_fetch_file* fetch_open(struct snapraid_fetch* fetch, const char* path)
+{
+	struct snapraid_fetch_file* file;
+	tommy_node* i;
+
+	/* search the file, with a linear search as the list is small */
+	for (i = tommy_list_head(&fetch->filelist); i != 0; i = i->next) {
+		file = i->data;
+		if (strcmp(file->path, path) == 0) {
+			/* move it as the most recently used */
+			tommy_list_remove_existing(&fetch->filelist, &file->node);
+			tommy_list_insert_head(&fetch->filelist, &file->node, file);
+			return file;
+		}
+	}
+
+	/* close the least recently used */
+	if (fetch->count >= FETCH_MAX) {
+		file = tommy_list_tail(&fetch->filelist)->data;
+		tommy_list_remove_existing(&fetch->filelist, &file->node);
+		if (fetch->ahead_file == file)
+			fetch->ahead_file = 0;
+		fetch_file_close(file);
+		--fetch->count;
+	}
+
+	file = malloc_nofail(sizeof(struct snapraid_fetch_file));
+	file->path = strdup_nofail(path);
+	file->f = open(path, O_RDONLY | O_BINARY);
+	if (file->f == -1) {
+		/* LCOV_EXCL_START */
+		if (errno == ENOENT) {
+			log_fatal("DANGER! file '%s' disappeared.\n", path);
+			log_fatal("If you moved it, please rerun the same command.\n");
+		} else {
+			log_fatal("Error opening file '%s'. %s.\n", path, strerror(errno));
+		}
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	tommy_list_insert_head(&fetch->filelist, &file->node, file);
+	++fetch->count;
+
+	return file;
+}
+
+void fetch_read(struct snapraid_fetch* fetch, const char* path, data_off_t offset, unsigned char* buffer, unsigned read_size, unsigned block_size, data_off_t size)
+{
+	struct snapraid_fetch_file* file;
+	unsigned ahead_size;
+	unsigned total_size;
+	unsigned count;
+	ssize_t read_ret;
+
+	file = fetch_open(fetch, path);
+
+	/* if the block is the read-ahead one, it's already in memory */
+	if (fetch->ahead_file == file && fetch->ahead_offset == offset && fetch->ahead_size == read_size) {
+		memcpy(buffer, fetch->ahead, read_size);
+		fetch->ahead_file = 0;
+		return;
+	}
+
+	/* allocate a buffer for the block and the read-ahead */
+	if (fetch->block_size != block_size) {
+		free(fetch->buffer);
+		fetch->buffer = malloc_nofail(2 * (size_t)block_size);
+		fetch->block_size = block_size;
+	}
+
+	/* size of the next block in the file, if any */
+	ahead_size = 0;
+	if (offset + read_size < size) {
+		if (size - (offset + read_size) > block_size)
+			ahead_size = block_size;
+		else
+			ahead_size = size - (offset + read_size);
+	}
+
+	total_size = read_size + ahead_size;
+
+#if !HAVE_PREAD
+	if (lseek(file->f, offset, SEEK_SET) != offset) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error seeking file '%s'. %s.\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+#endif
+
+	count = 0;
+	do {
+#if HAVE_PREAD
+		read_ret = pread(file->f, fetch->buffer + count, total_size - count, offset + count);
+#else
+		read_ret = read(file->f, fetch->buffer + count, total_size - count);
+#endif
+		if (read_ret < 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+		if (read_ret == 0)
+			break;
+
+		count += read_ret;
+	} while (count < total_size);
+
+	if (count < read_size) {
+		/* LCOV_EXCL_START */
+		log_fatal("Unexpected end of file '%s' at offset %" PRIu64 ".\n", path, offset);
+		log_fatal("Please don't change imported files while running.\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	memcpy(buffer, fetch->buffer, read_size);
+
+	/* keep the read-ahead, only if complete */
+	if (count == total_size && ahead_size != 0) {
+		fetch->ahead = fetch->buffer + read_size;
+		fetch->ahead_file = file;
+		fetch->ahead_offset = offset + read_size;
+		fetch->ahead_size = ahead_size;
+	} else {
+		fetch->ahead_file = 0;
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FETCH_H
+#define __FETCH_H
+
+#include "elem.h"
+
+/****************************************************************************/
+/* fetch */
+
+/**
+ * Max number of files kept open by the fetch cache.
+ */
+#define FETCH_MAX 64
+
+/**
+ * Open file of the fetch cache.
+ */
+struct snapraid_fetch_file {
+	char* path; /**< Path of the file. */
+	int f; /**< Handle of the file. */
+
+	/* nodes for data structures */
+	tommy_node node;
+};
+
+/**
+ * Fetch cache.
+ * Files kept open to read the blocks used to recover, from the import
+ * files and from the search files.
+ */
+struct snapraid_fetch {
+	tommy_list filelist; /**< Open files, from the most to the least recently used. */
+	unsigned count; /**< Number of open files. */
+
+	/**
+	 * Read-ahead of the block following the last one read.
+	 * The blocks of a file are usually requested in order, so when a block
+	 * is read, the next one is read in the same call.
+	 */
+	unsigned char* ahead;
+	struct snapraid_fetch_file* ahead_file; /**< File of the read-ahead. 0 if none. */
+	data_off_t ahead_offset; /**< Offset of the read-ahead data. */
+	unsigned ahead_size; /**< Size of the read-ahead data. */
+	unsigned char* buffer; /**< Buffer of two blocks, with the block read and the read-ahead. */
+	unsigned block_size; /**< Block size of the buffer. */
+};
+
+/**
+ * Initialize the fetch cache.
+ */
+void fetch_init(struct snapraid_fetch* fetch);
+
+/**
+ * Close all the files of the fetch cache.
+ */
+void fetch_done(struct snapraid_fetch* fetch);
+
+/**
+ * Read a block of a file, using the fetch cache.
+ *
+ * The file is kept open for the next reads, and the next block of the same
+ * file is read ahead, up to the specified file size.
+ * On error it aborts the program, like when the file is changed while running.
+ */
+void fetch_read(struct snapraid_fetch* fetch, const char* path, data_off_t offset, unsigned char* buffer, unsigned read_size, unsigned block_size, data_off_t size);
+
+#endif
+
@@ -152,8 +152,6 @@ void import_file_free(struct snapraid_import_file* file)
 int state_import_fetch(struct snapraid_state* state, int rehash, struct snapraid_block* missing_block, unsigned char* buffer)
 {
 	struct snapraid_import_block* block;
-	int ret;
-	int f;
 	const unsigned char* hash = missing_block->hash;
 	unsigned block_size = state->block_size;
 	unsigned read_size;
@@ -171,41 +169,8 @@ int state_import_fetch(struct snapraid_state* state, int rehash, struct snapraid
 	path = block->file->path;
 	read_size = block->size;
 
-	f = open(path, O_RDONLY | O_BINARY);
-	if (f == -1) {
-		/* LCOV_EXCL_START */
-		if (errno == ENOENT) {
-			log_fatal("DANGER! file '%s' disappeared.\n", path);
-			log_fatal("If you moved it, please rerun the same command.\n");
-		} else {
-			log_fatal("Error opening file '%s'. %s.\n", path, strerror(errno));
-		}
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
-
-	if (lseek(f, block->offset, SEEK_SET) != block->offset) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error seeking file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
-
-	ret = read(f, buffer, read_size);
-	if (ret < 0 || (unsigned)ret != read_size) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
-
-	ret = close(f);
-	if (ret != 0) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error closing file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
+	/* read using the open files cache, with read-ahead of the next block */
+	fetch_read(&state->fetch, path, block->offset, buffer, read_size, block_size, block->file->size);
 
 	if (read_size != block_size) {
 		/* fill the remaining with 0 */
@@ -1819,12 +1819,27 @@ uint64_t tick(void)
 	return t.QuadPart;
 }
 
+uint64_t tick_freq(void)
+{
+	LARGE_INTEGER f;
+
+	if (!QueryPerformanceFrequency(&f) || f.QuadPart == 0)
+		return 1000000ULL;
+
+	return f.QuadPart;
+}
+
 uint64_t tick_ms(void)
 {
 	/* GetTickCount64() isn't supported in Windows XP */
 	return GetTickCount();
 }
 
+void sleep_us(uint64_t us)
+{
+	Sleep((DWORD)((us + 999) / 1000));
+}
+
 int randomize(void* ptr, size_t size)
 {
 	if (!ptr_RtlGenRandom(ptr, size)) {
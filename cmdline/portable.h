@@ -117,6 +117,10 @@
 #include <linux/fiemap.h>
 #endif
 
+#if HAVE_SYS_FANOTIFY_H
+#include <sys/fanotify.h>
+#endif
+
 /**
  * Includes some standard headers.
  */
@@ -186,6 +190,13 @@
 #if HAVE_SYS_WAIT_H
 #include <sys/wait.h>
 #endif
+
+#if HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #ifndef WEXITSTATUS
 #define WEXITSTATUS(stat_val) ((unsigned)(stat_val) >> 8)
 #endif
@@ -307,11 +318,21 @@ int fsinfo(const char* path, int* has_persistent_inode, uint64_t* total_space, u
  */
 uint64_t tick(void);
 
+/**
+ * Get the frequency of the tick counter, in ticks for second.
+ */
+uint64_t tick_freq(void);
+
 /**
  * Get the tick counter value in millisecond.
  */
 uint64_t tick_ms(void);
 
+/**
+ * Wait the specified number of microseconds.
+ */
+void sleep_us(uint64_t us);
+
 /**
  * Initializes the system.
  */
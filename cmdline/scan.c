@@ -21,10 +21,43 @@
 #include "elem.h"
 #include "state.h"
 #include "parity.h"
+#include "watch.h"
+
+/**
+ * If the quick scan is supported.
+ *
+ * It requires the inode and the type in the dir entries to avoid the lstat() calls,
+ * and it's useless if the dir entries already contain the stat info, like in Windows.
+ */
+#if HAVE_STRUCT_DIRENT_D_INO && HAVE_STRUCT_DIRENT_D_TYPE && !HAVE_STRUCT_DIRENT_D_STAT
+#define HAVE_QUICKSCAN 1
+#endif
+
+/**
+ * Directory reading used by the scan.
+ *
+ * In Linux use getdents64() with big buffers to reduce the number of syscalls.
+ */
+#if HAVE_GETDENTS64
+#define SCAN_DIR linux_dir
+#define scan_opendir linux_opendir
+#define scan_readdir linux_readdir
+#define scan_closedir linux_closedir
+#else
+#define SCAN_DIR DIR
+#define scan_opendir opendir
+#define scan_readdir readdir
+#define scan_closedir closedir
+#endif
 
 struct snapraid_scan {
 	struct snapraid_state* state; /**< State used. */
 	struct snapraid_disk* disk; /**< Disk used. */
+#if HAVE_PTHREAD_CREATE
+	pthread_t thread; /**< Thread used to read the physical offsets. */
+#else
+	void* retval;
+#endif
 
 	/**
 	 * Counters of changes.
@@ -36,11 +69,26 @@ struct snapraid_scan {
 	unsigned count_copy; /**< Files new, with same name size and timestamp of a file in a different disk. */
 	unsigned count_insert; /**< Files new. */
 	unsigned count_remove; /**< Files removed. */
+	unsigned count_quick; /**< Dirs not changed and processed without lstat(). */
 
 	tommy_list file_insert_list; /**< Files to insert. */
 	tommy_list link_insert_list; /**< Links to insert. */
 	tommy_list dir_insert_list; /**< Dirs to insert. */
 
+	/**
+	 * Quick scan state.
+	 */
+	int is_quick_record; /**< If the dir stamps have to be collected. */
+	int is_quick_use; /**< If the stored dir stamps can be used to skip the lstat() calls. */
+	int64_t quick_time; /**< Time of the scan start. Dirs modified after it are not recorded. */
+	tommy_list dirstamp_list; /**< New dir stamps. */
+
+	/**
+	 * Watch state.
+	 */
+	int is_watch; /**< If the change log of the watcher can be used to skip the lstat() calls. */
+	tommy_hashdyn watch_dirset; /**< Dirs changed from the last scan. */
+
 	/* nodes for data structures */
 	tommy_node node;
 };
@@ -326,27 +374,96 @@ static void scan_file_deallocate(struct snapraid_scan* scan, struct snapraid_fil
 
 static void scan_file_delayed_allocate(struct snapraid_scan* scan, struct snapraid_file* file)
 {
-	struct snapraid_state* state = scan->state;
+	/* insert in the delayed list */
+	/* the physical offset, if required, is read later for all the files together */
+	tommy_list_insert_tail(&scan->file_insert_list, &file->nodelist, file);
+}
+
+/**
+ * Read the physical offsets of all the files to insert.
+ */
+static void* scan_physical_thread(void* arg)
+{
+	struct snapraid_scan* scan = arg;
 	struct snapraid_disk* disk = scan->disk;
+	tommy_node* node;
 
-	/* if we sort for physical offsets we have to read them for new files */
-	if (state->opt.force_order == SORT_PHYSICAL
-		&& file->physical == FILEPHY_UNREAD_OFFSET
-	) {
+	for (node = scan->file_insert_list; node != 0; node = node->next) {
+		struct snapraid_file* file = node->data;
 		char path_next[PATH_MAX];
 
+		if (file->physical != FILEPHY_UNREAD_OFFSET)
+			continue;
+
 		pathprint(path_next, sizeof(path_next), "%s%s", disk->dir, file->sub);
 
 		if (filephy(path_next, file->size, &file->physical) != 0) {
 			/* LCOV_EXCL_START */
 			log_fatal("Error in getting the physical offset of file '%s'. %s.\n", path_next, strerror(errno));
+			return scan;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Read the physical offsets of the new files of all the disks.
+ *
+ * Each disk is processed by a different thread, to overlap the
+ * latency of the FIEMAP calls in different disks.
+ */
+static void scan_physical(tommy_list* scanlist)
+{
+	tommy_node* i;
+	int fail;
+
+	/* start all the threads */
+	for (i = tommy_list_head(scanlist); i != 0; i = i->next) {
+		struct snapraid_scan* scan = i->data;
+
+#if HAVE_PTHREAD_CREATE
+		if (pthread_create(&scan->thread, 0, scan_physical_thread, scan) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed to create thread.\n");
 			exit(EXIT_FAILURE);
 			/* LCOV_EXCL_STOP */
 		}
+#else
+		scan->retval = scan_physical_thread(scan);
+#endif
 	}
 
-	/* insert in the delayed list */
-	tommy_list_insert_tail(&scan->file_insert_list, &file->nodelist, file);
+	/* join all the threads */
+	fail = 0;
+	for (i = tommy_list_head(scanlist); i != 0; i = i->next) {
+		struct snapraid_scan* scan = i->data;
+		void* retval;
+
+#if HAVE_PTHREAD_CREATE
+		if (pthread_join(scan->thread, &retval) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed to join thread.\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+#else
+		retval = scan->retval;
+#endif
+		if (retval) {
+			/* LCOV_EXCL_START */
+			fail = 1;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	/* abort on failure */
+	if (fail) {
+		/* LCOV_EXCL_START */
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
 }
 
 /**
@@ -583,6 +700,30 @@ static void scan_file_keep(struct snapraid_scan* scan, struct snapraid_file* fil
 	}
 }
 
+/**
+ * Report a new or updated file.
+ */
+static void scan_file_report(struct snapraid_scan* scan, int is_diff, struct snapraid_file* file, int is_update)
+{
+	struct snapraid_disk* disk = scan->disk;
+
+	if (is_update) {
+		++scan->count_change;
+
+		log_tag("scan:update:%s:%s\n", disk->name, esc(file->sub));
+		if (is_diff) {
+			printf("update %s%s\n", disk->dir, file->sub);
+		}
+	} else {
+		++scan->count_insert;
+
+		log_tag("scan:add:%s:%s\n", disk->name, esc(file->sub));
+		if (is_diff) {
+			printf("add %s%s\n", disk->dir, file->sub);
+		}
+	}
+}
+
 /**
  * Process a file.
  */
@@ -928,20 +1069,12 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 
 	/* if not yet reported, do it now */
 	if (!is_file_reported) {
-		if (is_file_already_present) {
-			++scan->count_change;
-
-			log_tag("scan:update:%s:%s\n", disk->name, esc(sub));
-			if (is_diff) {
-				printf("update %s%s\n", disk->dir, sub);
-			}
+		if (state->opt.copy_content && file->size != 0) {
+			/* report it later, after searching a copy with the same content */
+			if (is_file_already_present)
+				file_flag_set(file, FILE_IS_UPDATED);
 		} else {
-			++scan->count_insert;
-
-			log_tag("scan:add:%s:%s\n", disk->name, esc(sub));
-			if (is_diff) {
-				printf("add %s%s\n", disk->dir, sub);
-			}
+			scan_file_report(scan, is_diff, file, is_file_already_present);
 		}
 	}
 
@@ -1022,6 +1155,175 @@ static void scan_emptydir(struct snapraid_scan* scan, const char* sub)
 	tommy_list_insert_tail(&scan->dir_insert_list, &dir->nodelist, dir);
 }
 
+/**
+ * Process a file in a dir not changed since the last scan, without calling lstat().
+ * Return != 0 if the file is recognized as the same one of the last scan.
+ */
+static int scan_file_quick(struct snapraid_scan* scan, const char* sub, uint64_t inode)
+{
+	struct snapraid_state* state = scan->state;
+	struct snapraid_disk* disk = scan->disk;
+	struct snapraid_file* file;
+
+	file = tommy_hashdyn_search(&disk->inodeset, file_inode_compare_to_arg, &inode, file_inode_hash(inode));
+
+	/* hardlinks, moved and restored files need the full processing */
+	if (!file || file_flag_has(file, FILE_IS_PRESENT) || strcmp(file->sub, sub) != 0)
+		return 0;
+
+	/* files with hardlinks could be changed without changing this dir */
+	if (file_flag_has(file, FILE_IS_HARDLINKED))
+		return 0;
+
+	/* mark as present */
+	file_flag_set(file, FILE_IS_PRESENT);
+
+	/* assume it's equal, as the same inode is still in the same dir */
+	++scan->count_equal;
+
+	if (state->opt.gui) {
+		log_tag("scan:equal:%s:%s\n", disk->name, esc(file->sub));
+	}
+
+	/* mark the file as kept */
+	scan_file_keep(scan, file);
+
+	return 1;
+}
+
+/**
+ * Mark the files with hardlinks, to exclude them from the quick processing.
+ */
+static void scan_file_hardlinked(struct snapraid_scan* scan)
+{
+	struct snapraid_disk* disk = scan->disk;
+	tommy_node* node;
+
+	for (node = disk->linklist; node != 0; node = node->next) {
+		struct snapraid_link* slink = node->data;
+		struct snapraid_file* file;
+
+		if (link_flag_get(slink, FILE_IS_LINK_MASK) != FILE_IS_HARDLINK)
+			continue;
+
+		file = tommy_hashdyn_search(&disk->pathset, file_path_compare_to_arg, slink->linkto, file_path_hash(slink->linkto));
+		if (file)
+			file_flag_set(file, FILE_IS_HARDLINKED);
+	}
+}
+
+/**
+ * Process a symlink in a dir not changed since the last scan, without calling readlink().
+ * Return != 0 if the symlink is recognized as the same one of the last scan.
+ */
+static int scan_link_quick(struct snapraid_scan* scan, const char* sub)
+{
+	struct snapraid_state* state = scan->state;
+	struct snapraid_disk* disk = scan->disk;
+	struct snapraid_link* slink;
+
+	slink = tommy_hashdyn_search(&disk->linkset, link_name_compare_to_arg, sub, link_name_hash(sub));
+	if (!slink || link_flag_has(slink, FILE_IS_PRESENT) || link_flag_get(slink, FILE_IS_LINK_MASK) != FILE_IS_SYMLINK)
+		return 0;
+
+	/* mark as present */
+	link_flag_set(slink, FILE_IS_PRESENT);
+
+	/* a symlink cannot be changed in place, so it's equal */
+	++scan->count_equal;
+
+	if (state->opt.gui) {
+		log_tag("scan:equal:%s:%s\n", disk->name, esc(slink->sub));
+	}
+
+	return 1;
+}
+
+/**
+ * Record the stamp of a dir, and check if it's not changed since the last scan.
+ * Return != 0 if the dir is unchanged, and its entries can be processed without lstat().
+ */
+static int scan_dirstamp(struct snapraid_scan* scan, const char* sub, const struct stat* st, uint32_t count)
+{
+	struct snapraid_disk* disk = scan->disk;
+	struct snapraid_dirstamp* dirstamp;
+	int is_unchanged;
+
+	is_unchanged = 0;
+	if (scan->is_quick_use) {
+		dirstamp = tommy_hashdyn_search(&disk->dirstampset, dirstamp_name_compare, sub, dir_name_hash(sub));
+		if (dirstamp
+			&& dirstamp->mtime_sec == st->st_mtime
+			&& dirstamp->mtime_nsec == STAT_NSEC(st)
+			&& dirstamp->count == count
+		) {
+			is_unchanged = 1;
+		}
+	}
+
+	/* don't record dirs modified in the same second of the scan */
+	/* because a following modification may not change the mtime */
+	if (st->st_mtime < scan->quick_time) {
+		dirstamp = dirstamp_alloc(sub, st->st_mtime, STAT_NSEC(st), count);
+		tommy_list_insert_tail(&scan->dirstamp_list, &dirstamp->nodelist, dirstamp);
+	}
+
+	return is_unchanged;
+}
+
+/**
+ * Replace the dir stamps of the disk with the ones collected in the scan.
+ */
+static void scan_dirstamp_update(struct snapraid_scan* scan)
+{
+	struct snapraid_state* state = scan->state;
+	struct snapraid_disk* disk = scan->disk;
+	tommy_node* node;
+	unsigned count;
+	int is_changed;
+
+	/* check if something changed */
+	is_changed = 0;
+	count = 0;
+	for (node = scan->dirstamp_list; node != 0; node = node->next) {
+		struct snapraid_dirstamp* dirstamp = node->data;
+		struct snapraid_dirstamp* prev;
+
+		prev = tommy_hashdyn_search(&disk->dirstampset, dirstamp_name_compare, dirstamp->sub, dir_name_hash(dirstamp->sub));
+		if (!prev
+			|| prev->mtime_sec != dirstamp->mtime_sec
+			|| prev->mtime_nsec != dirstamp->mtime_nsec
+			|| prev->count != dirstamp->count
+		) {
+			is_changed = 1;
+		}
+		++count;
+	}
+	if (count != tommy_hashdyn_count(&disk->dirstampset))
+		is_changed = 1;
+
+	/* the new dir stamps have to be saved */
+	if (is_changed)
+		state->need_write = 1;
+
+	/* replace the old stamps */
+	tommy_list_foreach(&disk->dirstamplist, (tommy_foreach_func*)dirstamp_free);
+	tommy_hashdyn_done(&disk->dirstampset);
+	tommy_hashdyn_init(&disk->dirstampset);
+	tommy_list_init(&disk->dirstamplist);
+
+	node = scan->dirstamp_list;
+	while (node) {
+		struct snapraid_dirstamp* dirstamp = node->data;
+
+		/* next node */
+		node = node->next;
+
+		tommy_hashdyn_insert(&disk->dirstampset, &dirstamp->nodeset, dirstamp, dir_name_hash(dirstamp->sub));
+		tommy_list_insert_tail(&disk->dirstamplist, &dirstamp->nodelist, dirstamp);
+	}
+}
+
 struct dirent_sorted {
 	/* node for data structures */
 	tommy_node node;
@@ -1074,7 +1376,7 @@ struct stat* dstat(struct dirent_sorted* dd)
 #define DSTAT(file, dd, buf) dstat(file, buf)
 struct stat* dstat(const char* file, struct stat* st)
 {
-	if (lstat(file, st) != 0) {
+	if (lstat_scan(file, st) != 0) {
 		/* LCOV_EXCL_START */
 		log_fatal("Error in stat file/directory '%s'. %s.\n", file, strerror(errno));
 		exit(EXIT_FAILURE);
@@ -1086,20 +1388,23 @@ struct stat* dstat(const char* file, struct stat* st)
 
 /**
  * Process a directory.
+ * The stat info of the directory is optional, and it's used only by the quick scan.
  * Return != 0 if at least one file or link is processed.
  */
-static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const char* dir, const char* sub)
+static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const char* dir, const char* sub, const struct stat* st_dir)
 {
 	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
 	int processed = 0;
-	DIR* d;
+	int is_quick = 0;
+	uint32_t count = 0;
+	SCAN_DIR* d;
 	tommy_list list;
 	tommy_node* node;
 
 	tommy_list_init(&list);
 
-	d = opendir(dir);
+	d = scan_opendir(dir);
 	if (!d) {
 		/* LCOV_EXCL_START */
 		log_fatal("Error opening directory '%s'. %s.\n", dir, strerror(errno));
@@ -1122,7 +1427,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 
 		/* clear errno to detect erroneous conditions */
 		errno = 0;
-		dd = readdir(d);
+		dd = scan_readdir(d);
 		if (dd == 0 && errno != 0) {
 			/* LCOV_EXCL_START */
 			log_fatal("Error reading directory '%s'. %s.\n", dir, strerror(errno));
@@ -1139,6 +1444,9 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 		if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
 			continue;
 
+		/* count all the entries, also the ones excluded */
+		++count;
+
 		pathprint(path_next, sizeof(path_next), "%s%s", dir, name);
 		pathprint(sub_next, sizeof(sub_next), "%s%s", sub, name);
 
@@ -1184,13 +1492,29 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 		tommy_list_insert_tail(&list, &entry->node, entry);
 	}
 
-	if (closedir(d) != 0) {
+	if (scan_closedir(d) != 0) {
 		/* LCOV_EXCL_START */
 		log_fatal("Error closing directory '%s'. %s.\n", dir, strerror(errno));
 		exit(EXIT_FAILURE);
 		/* LCOV_EXCL_STOP */
 	}
 
+#if HAVE_QUICKSCAN
+	/* check if the dir is changed since the last scan */
+	if (scan->is_quick_record && st_dir)
+		is_quick = scan_dirstamp(scan, sub, st_dir, count);
+
+	/* the change log of the watcher, if available, knows better */
+	if (scan->is_watch)
+		is_quick = !watch_is_changed(&scan->watch_dirset, sub);
+
+	if (is_quick)
+		++scan->count_quick;
+#else
+	(void)st_dir;
+	(void)count;
+#endif
+
 	if (state->opt.force_order == SORT_ALPHA) {
 		/* if requested sort alphabetically */
 		/* this is mainly done for testing to ensure to always */
@@ -1271,7 +1595,14 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 		}
 
 		if (type == 0) { /* REG */
-			if (filter_path(&state->filterlist, &reason, disk->name, sub_next) == 0) {
+			if (filter_path(&state->filterset, &reason, disk->name, sub_next) == 0) {
+#if HAVE_QUICKSCAN
+				/* in an unchanged dir, recognize the file by inode */
+				if (is_quick && scan_file_quick(scan, sub_next, dd->d_ino)) {
+					processed = 1;
+					goto next;
+				}
+#endif
 
 				/* late stat, if not yet called */
 				if (!st)
@@ -1296,10 +1627,18 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 				msg_verbose("Excluding file '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		} else if (type == 1) { /* LNK */
-			if (filter_path(&state->filterlist, &reason, disk->name, sub_next) == 0) {
+			if (filter_path(&state->filterset, &reason, disk->name, sub_next) == 0) {
 				char subnew[PATH_MAX];
 				int ret;
 
+#if HAVE_QUICKSCAN
+				/* in an unchanged dir, recognize the symlink by name */
+				if (is_quick && scan_link_quick(scan, sub_next)) {
+					processed = 1;
+					goto next;
+				}
+#endif
+
 				ret = readlink(path_next, subnew, sizeof(subnew));
 				if (ret >= PATH_MAX) {
 					/* LCOV_EXCL_START */
@@ -1324,7 +1663,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 				msg_verbose("Excluding link '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		} else if (type == 2) { /* DIR */
-			if (filter_dir(&state->filterlist, &reason, disk->name, sub_next) == 0) {
+			if (filter_dir(&state->filterset, &reason, disk->name, sub_next) == 0) {
 #ifndef _WIN32
 				/* late stat, if not yet called */
 				if (!st)
@@ -1343,7 +1682,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 					pathslash(path_next, sizeof(path_next));
 					pathcpy(sub_dir, sizeof(sub_dir), sub_next);
 					pathslash(sub_dir, sizeof(sub_dir));
-					if (scan_dir(scan, level + 1, is_diff, path_next, sub_dir) == 0) {
+					if (scan_dir(scan, level + 1, is_diff, path_next, sub_dir, st) == 0) {
 						/* scan the directory as empty dir */
 						scan_emptydir(scan, sub_next);
 					}
@@ -1354,7 +1693,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 				msg_verbose("Excluding directory '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		} else {
-			if (filter_path(&state->filterlist, &reason, disk->name, sub_next) == 0) {
+			if (filter_path(&state->filterset, &reason, disk->name, sub_next) == 0) {
 				/* late stat, if not yet called */
 				if (!st)
 					st = DSTAT(path_next, dd, &st_buf);
@@ -1365,6 +1704,9 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 			}
 		}
 
+#if HAVE_QUICKSCAN
+next:
+#endif
 		/* next entry */
 		node = node->next;
 
@@ -1375,6 +1717,250 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 	return processed;
 }
 
+/**
+ * File removed from the array, indexed by size and hash of the first block.
+ */
+struct snapraid_scan_gone {
+	struct snapraid_disk* disk; /**< Disk of the file. */
+	struct snapraid_file* file; /**< File removed. */
+
+	/* nodes for data structures */
+	tommy_hashdyn_node node;
+};
+
+/**
+ * Key used to search a removed file.
+ */
+struct snapraid_scan_gone_key {
+	data_off_t size; /**< Size of the file. */
+	const unsigned char* hash; /**< Hash of the first block. */
+};
+
+static inline tommy_uint32_t gone_hash(data_off_t size, const unsigned char* hash)
+{
+	return tommy_hash_u32((tommy_uint32_t)size, hash, HASH_SIZE);
+}
+
+static int gone_compare(const void* void_arg, const void* void_data)
+{
+	const struct snapraid_scan_gone_key* arg = void_arg;
+	const struct snapraid_scan_gone* gone = void_data;
+
+	if (arg->size != gone->file->size)
+		return 1;
+
+	return memcmp(arg->hash, fs_file2block_get(gone->file, 0)->hash, HASH_SIZE);
+}
+
+/**
+ * Size of a removed file.
+ * Used to read the first block of the new files only if a removed file has the same size.
+ */
+struct snapraid_scan_gone_size {
+	data_off_t size; /**< Size of the file. */
+
+	/* nodes for data structures */
+	tommy_hashdyn_node node;
+};
+
+static inline tommy_uint32_t gone_size_hash(data_off_t size)
+{
+	return (tommy_uint32_t)tommy_inthash_u64((tommy_uint64_t)size);
+}
+
+static int gone_size_compare(const void* void_arg, const void* void_data)
+{
+	const data_off_t* arg = void_arg;
+	const struct snapraid_scan_gone_size* gone_size = void_data;
+
+	return *arg != gone_size->size;
+}
+
+/**
+ * Hash the first blocks of a file.
+ * Return -1 if the file cannot be read, or it's changed.
+ */
+static int scan_content_hash(struct snapraid_state* state, struct snapraid_disk* disk, struct snapraid_file* file, block_off_t count, unsigned char* hashvec, void* buffer)
+{
+	char path[PATH_MAX];
+	block_off_t i;
+	int f;
+
+	pathprint(path, sizeof(path), "%s%s", disk->dir, file->sub);
+
+	f = open(path, O_RDONLY | O_BINARY);
+	if (f == -1)
+		return -1;
+
+	for (i = 0; i < count; ++i) {
+		unsigned read_size = file_block_size(file, i, state->block_size);
+		unsigned done = 0;
+
+		while (done < read_size) {
+			ssize_t ret = read(f, (unsigned char*)buffer + done, read_size - done);
+			if (ret <= 0) {
+				close(f);
+				return -1;
+			}
+			done += ret;
+		}
+
+		memhash(state->hash, state->hashseed, hashvec + i * HASH_SIZE, buffer, read_size);
+	}
+
+	close(f);
+
+	return 0;
+}
+
+/**
+ * Search the new files with the same content of a removed file.
+ *
+ * The files copied or moved from one disk to another without keeping the
+ * time stamp are not found by the copy detection. Here the hash of the
+ * first block of each new file is searched in the removed files, and if
+ * found, the whole file is read to verify that all the hashes match.
+ * The first block is read only if a removed file has the same size.
+ * The matching files reuse the hash like the copy detection does.
+ */
+static void scan_content(struct snapraid_state* state, tommy_list* scanlist, int is_diff)
+{
+	tommy_hashdyn goneset;
+	tommy_hashdyn sizeset;
+	tommy_node* i;
+	void* buffer;
+	unsigned char* hashvec;
+	block_off_t hashmax;
+	unsigned count;
+
+	tommy_hashdyn_init(&goneset);
+	tommy_hashdyn_init(&sizeset);
+
+	/* index the removed files with a valid hash */
+	for (i = tommy_list_head(&state->disklist); i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		tommy_node* j;
+
+		for (j = disk->filelist; j != 0; j = j->next) {
+			struct snapraid_file* file = j->data;
+			struct snapraid_scan_gone* gone;
+			tommy_uint32_t size_hash;
+
+			if (file_flag_has(file, FILE_IS_PRESENT))
+				continue;
+
+			if (!file_is_full_hashed_and_stable(state, disk, file))
+				continue;
+
+			gone = malloc_nofail(sizeof(struct snapraid_scan_gone));
+			gone->disk = disk;
+			gone->file = file;
+			tommy_hashdyn_insert(&goneset, &gone->node, gone, gone_hash(file->size, fs_file2block_get(file, 0)->hash));
+
+			/* insert the size only once */
+			size_hash = gone_size_hash(file->size);
+			if (tommy_hashdyn_search(&sizeset, gone_size_compare, &file->size, size_hash) == 0) {
+				struct snapraid_scan_gone_size* gone_size;
+
+				gone_size = malloc_nofail(sizeof(struct snapraid_scan_gone_size));
+				gone_size->size = file->size;
+				tommy_hashdyn_insert(&sizeset, &gone_size->node, gone_size, size_hash);
+			}
+		}
+	}
+
+	buffer = malloc_nofail(state->block_size);
+	hashmax = 0;
+	hashvec = 0;
+	count = 0;
+
+	for (i = tommy_list_head(scanlist); i != 0; i = i->next) {
+		struct snapraid_scan* scan = i->data;
+		struct snapraid_disk* disk = scan->disk;
+		tommy_node* j;
+
+		for (j = scan->file_insert_list; j != 0; j = j->next) {
+			struct snapraid_file* file = j->data;
+			struct snapraid_scan_gone_key key;
+			tommy_hashdyn_node* bucket;
+			struct snapraid_scan_gone* found;
+			unsigned char first[HASH_SIZE];
+
+			/* only the files not yet reported */
+			if (file->size == 0 || file_flag_has(file, FILE_IS_COPY))
+				continue;
+
+			found = 0;
+			if (tommy_hashdyn_search(&sizeset, gone_size_compare, &file->size, gone_size_hash(file->size)) != 0
+				&& scan_content_hash(state, disk, file, 1, first, buffer) == 0) {
+				int is_hashed = 0;
+
+				key.size = file->size;
+				key.hash = first;
+
+				/* verify all the removed files with the same first block */
+				bucket = tommy_hashdyn_bucket(&goneset, gone_hash(key.size, key.hash));
+				while (bucket) {
+					struct snapraid_scan_gone* gone = bucket->data;
+					block_off_t k;
+
+					bucket = bucket->next;
+
+					if (gone_compare(&key, gone) != 0)
+						continue;
+
+					/* hash the whole file only once */
+					if (!is_hashed) {
+						if (file->blockmax > hashmax) {
+							free(hashvec);
+							hashmax = file->blockmax;
+							hashvec = malloc_nofail(hashmax * HASH_SIZE);
+						}
+						if (scan_content_hash(state, disk, file, file->blockmax, hashvec, buffer) != 0)
+							break;
+						is_hashed = 1;
+					}
+
+					for (k = 0; k < file->blockmax; ++k) {
+						if (memcmp(hashvec + k * HASH_SIZE, fs_file2block_get(gone->file, k)->hash, HASH_SIZE) != 0)
+							break;
+					}
+
+					if (k == file->blockmax) {
+						found = gone;
+						break;
+					}
+				}
+			}
+
+			if (found) {
+				/* reuse the hash */
+				file_copy_hash(found->file, file);
+
+				++scan->count_copy;
+				++count;
+
+				log_tag("scan:copy:%s:%s:%s:%s\n", found->disk->name, esc(found->file->sub), disk->name, esc(file->sub));
+				if (is_diff) {
+					printf("copy %s%s -> %s%s\n", found->disk->dir, found->file->sub, disk->dir, file->sub);
+				}
+			} else {
+				scan_file_report(scan, is_diff, file, file_flag_has(file, FILE_IS_UPDATED));
+			}
+		}
+	}
+
+	if (count)
+		msg_verbose("%8u files found as copy by content\n", count);
+
+	free(hashvec);
+	free(buffer);
+	tommy_hashdyn_foreach(&goneset, free);
+	tommy_hashdyn_done(&goneset);
+	tommy_hashdyn_foreach(&sizeset, free);
+	tommy_hashdyn_done(&sizeset);
+}
+
 static int state_diffscan(struct snapraid_state* state, int is_diff)
 {
 	tommy_node* i;
@@ -1384,9 +1970,22 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 	fptr* msg;
 	struct snapraid_scan total;
 	int no_difference;
+	int64_t now;
+	int is_full;
 
 	tommy_list_init(&scanlist);
 
+	/* check if a full scan is required by the quick scan */
+	now = time(0);
+	is_full = state->quickscan_last == 0
+		|| now < state->quickscan_last
+		|| now - state->quickscan_last >= (int64_t)state->quickscan * 24 * 60 * 60;
+	if (state->quickscan != 0 && is_full) {
+		/* save the time of the full scan */
+		state->quickscan_last = now;
+		state->need_write = 1;
+	}
+
 	if (is_diff)
 		msg_progress("Comparing...\n");
 
@@ -1408,9 +2007,16 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 		scan->count_change = 0;
 		scan->count_remove = 0;
 		scan->count_insert = 0;
+		scan->count_quick = 0;
 		tommy_list_init(&scan->file_insert_list);
 		tommy_list_init(&scan->link_insert_list);
 		tommy_list_init(&scan->dir_insert_list);
+		tommy_list_init(&scan->dirstamp_list);
+		scan->quick_time = now;
+		scan->is_quick_record = 0;
+		scan->is_quick_use = 0;
+		scan->is_watch = 0;
+		tommy_hashdyn_init(&scan->watch_dirset);
 
 		tommy_list_insert_tail(&scanlist, &scan->node, scan);
 
@@ -1452,9 +2058,58 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 			}
 		}
 
-		scan_dir(scan, 0, is_diff, disk->dir, "");
+#if HAVE_QUICKSCAN
+		/* the quick scan relies on persistent inodes to recognize files */
+		if (state->quickscan != 0 && !disk->has_volatile_inodes && !disk->has_unsupported_uuid) {
+			scan->is_quick_record = 1;
+			if (!is_full && !disk->has_different_uuid)
+				scan->is_quick_use = 1;
+		}
+#endif
+
+		/* always read the change log to keep its position updated */
+		ret = watch_load(state, disk, &scan->watch_dirset);
+#if HAVE_QUICKSCAN
+		/* use it only if files can be recognized by inode, and no full scan is requested */
+		if (ret == 0
+			&& !disk->has_volatile_inodes && !disk->has_different_uuid && !disk->has_unsupported_uuid
+			&& !(state->quickscan != 0 && is_full)
+		) {
+			scan->is_watch = 1;
+		}
+#endif
+
+		/* the hardlinks of a file can be in a different dir */
+		if (scan->is_quick_use || scan->is_watch)
+			scan_file_hardlinked(scan);
+
+		if (scan->is_quick_record) {
+			struct stat st;
+
+			if (lstat(disk->dir, &st) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error in stat directory '%s'. %s.\n", disk->dir, strerror(errno));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			scan_dir(scan, 0, is_diff, disk->dir, "", &st);
+		} else {
+			scan_dir(scan, 0, is_diff, disk->dir, "", 0);
+		}
+
+		if (scan->is_quick_use || scan->is_watch)
+			msg_verbose("%8u unchanged dirs in disk %s\n", scan->count_quick, disk->name);
 	}
 
+	/* if we sort for physical offsets we have to read them for new files */
+	if (state->opt.force_order == SORT_PHYSICAL)
+		scan_physical(&scanlist);
+
+	/* search the new files with the same content of a removed one */
+	if (state->opt.copy_content)
+		scan_content(state, &scanlist, is_diff);
+
 	/* we split the search in two phases because to detect files */
 	/* moved from one disk to another we have to start deletion */
 	/* only when all disks have all the new files found */
@@ -1608,6 +2263,12 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 			/* insert it */
 			scan_emptydir_insert(scan, dir);
 		}
+
+		/* save the new dir stamps */
+		if (scan->is_quick_record)
+			scan_dirstamp_update(scan);
+
+		watch_done(&scan->watch_dirset);
 	}
 
 	/* check for disks where all the previously existing files where removed */
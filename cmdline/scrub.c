@@ -82,6 +82,151 @@ static int block_is_enabled(struct snapraid_state* state, block_off_t i, time_t
 	return 1;
 }
 
+/**
+ * Time of burst allowed by the rate limits, in microseconds.
+ * The reads are delayed only when they are ahead of the limit by more than this time.
+ */
+#define LIMIT_BURST 1000000
+
+/**
+ * Initial and max delay of the reads of a disk over the latency limit, in microseconds.
+ */
+#define LIMIT_DELAY_MIN 1000
+#define LIMIT_DELAY_MAX 1000000
+
+/**
+ * Token bucket.
+ * Instead of counting the tokens, it keeps the time when the bucket becomes
+ * full again, that is the same, but without requiring a periodic refill.
+ */
+struct snapraid_bucket {
+	uint64_t rate; /**< Tokens for second. 0 for no limit. */
+	uint64_t full; /**< Time in microseconds when the bucket is full again. */
+};
+
+/**
+ * Take tokens from the bucket.
+ * Return the time to wait in microseconds to respect the rate.
+ */
+static uint64_t bucket_take(struct snapraid_bucket* bucket, uint64_t now, uint64_t count)
+{
+	if (bucket->rate == 0)
+		return 0;
+
+	if (bucket->full < now)
+		bucket->full = now;
+
+	bucket->full += count * 1000000 / bucket->rate;
+
+	if (bucket->full <= now + LIMIT_BURST)
+		return 0;
+
+	return bucket->full - now - LIMIT_BURST;
+}
+
+/**
+ * Limits of the scrub reads.
+ * The per disk limits have an entry for each data disk, followed by the parity ones.
+ */
+struct snapraid_limit {
+	int enabled; /**< If any limit is enabled. */
+	struct snapraid_bucket speed; /**< Global limit of bytes for second. */
+	struct snapraid_bucket iops; /**< Global limit of reads for second. */
+	struct snapraid_bucket* disk_speed; /**< Limit of bytes for second of each disk. */
+	struct snapraid_bucket* disk_iops; /**< Limit of reads for second of each disk. */
+	uint64_t* delay; /**< Delay of the reads of each disk, for the latency limit. */
+};
+
+static void limit_init(struct snapraid_limit* limit, struct snapraid_state* state, unsigned diskmax)
+{
+	unsigned count = diskmax + state->level;
+	unsigned j;
+
+	limit->enabled = state->opt.limit_speed != 0
+		|| state->opt.limit_disk_speed != 0
+		|| state->opt.limit_iops != 0
+		|| state->opt.limit_disk_iops != 0
+		|| state->opt.limit_latency != 0;
+
+	limit->speed.rate = state->opt.limit_speed * (uint64_t)MEGA;
+	limit->speed.full = 0;
+	limit->iops.rate = state->opt.limit_iops;
+	limit->iops.full = 0;
+
+	limit->disk_speed = malloc_nofail(count * sizeof(struct snapraid_bucket));
+	limit->disk_iops = malloc_nofail(count * sizeof(struct snapraid_bucket));
+	limit->delay = malloc_nofail(count * sizeof(uint64_t));
+	for (j = 0; j < count; ++j) {
+		limit->disk_speed[j].rate = state->opt.limit_disk_speed * (uint64_t)MEGA;
+		limit->disk_speed[j].full = 0;
+		limit->disk_iops[j].rate = state->opt.limit_disk_iops;
+		limit->disk_iops[j].full = 0;
+		limit->delay[j] = 0;
+	}
+}
+
+static void limit_done(struct snapraid_limit* limit)
+{
+	free(limit->disk_speed);
+	free(limit->disk_iops);
+	free(limit->delay);
+}
+
+/**
+ * Wait before a read, to respect the limits.
+ *
+ * @index Index of the disk, with the parity after the data disks.
+ * @latency Latency of the last read of the disk in microseconds.
+ */
+static void limit_wait(struct snapraid_state* state, struct snapraid_limit* limit, unsigned index, unsigned size, uint64_t latency)
+{
+	uint64_t now;
+	uint64_t wait;
+	uint64_t w;
+
+	if (!limit->enabled)
+		return;
+
+	/* current time in microseconds */
+	if (state->tick_freq >= 1000000)
+		now = tick() / (state->tick_freq / 1000000);
+	else
+		now = tick() * 1000000 / state->tick_freq;
+
+	wait = bucket_take(&limit->speed, now, size);
+	w = bucket_take(&limit->iops, now, 1);
+	if (w > wait)
+		wait = w;
+	w = bucket_take(&limit->disk_speed[index], now, size);
+	if (w > wait)
+		wait = w;
+	w = bucket_take(&limit->disk_iops[index], now, 1);
+	if (w > wait)
+		wait = w;
+
+	/* if the disk is slow, likely because used by someone else, */
+	/* increase the delay of its reads, otherwise decrease it */
+	if (state->opt.limit_latency != 0) {
+		if (latency > state->opt.limit_latency * 1000ULL) {
+			if (limit->delay[index] == 0)
+				limit->delay[index] = LIMIT_DELAY_MIN;
+			else if (limit->delay[index] < LIMIT_DELAY_MAX)
+				limit->delay[index] *= 2;
+		} else {
+			limit->delay[index] /= 2;
+		}
+		if (limit->delay[index] > wait)
+			wait = limit->delay[index];
+	}
+
+	if (wait != 0) {
+		sleep_us(wait);
+
+		/* the waiting time is not accounted as disk or cpu usage */
+		state_usage_waste(state);
+	}
+}
+
 static int state_scrub_process(struct snapraid_state* state, struct snapraid_parity_handle** parity, block_off_t blockstart, block_off_t blockmax, time_t timelimit, block_off_t lastlimit, time_t now)
 {
 	struct snapraid_handle* handle;
@@ -105,10 +250,15 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	unsigned silent_error;
 	unsigned io_error;
 	unsigned l;
+	struct snapraid_limit limit;
+	time_t start;
 
 	/* maps the disks to handles */
 	handle = handle_map(state, &diskmax);
 
+	/* limits of the reads */
+	limit_init(&limit, state, diskmax);
+
 	/* rehash buffers */
 	rehandle = malloc_nofail_align(diskmax * sizeof(struct snapraid_rehash), &rehandle_alloc);
 
@@ -146,6 +296,7 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	countsize = 0;
 	countpos = 0;
 	countlast = 0;
+	start = time(0);
 	state_progress_begin(state, blockstart, blockmax, countmax);
 	for (i = blockstart; i < blockmax; ++i) {
 		snapraid_info info;
@@ -223,6 +374,9 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 			/* until now is CPU */
 			state_usage_cpu(state);
 
+			/* wait to respect the limits */
+			limit_wait(state, &limit, j, file_block_size(file, file_pos, state->block_size), disk->latency.last);
+
 			/* if the file is different than the current one, close it */
 			if (handle[j].file != 0 && handle[j].file != file) {
 				/* keep a pointer at the file we are going to close for error reporting */
@@ -314,6 +468,7 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 
 			/* until now is disk */
 			state_usage_disk(state, disk);
+			disk->read_bytes += read_size;
 
 			countsize += read_size;
 
@@ -328,6 +483,9 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 				memhash(state->hash, state->hashseed, hash, buffer[j], read_size);
 			}
 
+			/* until now is hash */
+			state_usage_hash(state);
+
 			if (block_has_updated_hash(block)) {
 				/* compare the hash */
 				if (memcmp(hash, block->hash, HASH_SIZE) != 0) {
@@ -364,6 +522,9 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 
 			/* read the parity */
 			for (l = 0; l < state->level; ++l) {
+				/* wait to respect the limits */
+				limit_wait(state, &limit, diskmax + l, state->block_size, state->parity[l].latency.last);
+
 				ret = parity_read(parity[l], i, buffer_recov[l], state->block_size, log_error);
 				if (ret == -1) {
 					buffer_recov[l] = 0;
@@ -399,6 +560,9 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 			/* compute the parity */
 			raid_gen(diskmax, state->level, state->block_size, buffer);
 
+			/* until now is parity */
+			state_usage_raid(state);
+
 			/* compare the parity */
 			for (l = 0; l < state->level; ++l) {
 				if (buffer_recov[l] && memcmp(buffer[diskmax + l], buffer_recov[l], state->block_size) != 0) {
@@ -446,6 +610,11 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		/* count the number of processed block */
 		++countpos;
 
+		/* errors for the progress reporting */
+		state->progress_error = error;
+		state->progress_io_error = io_error;
+		state->progress_silent_error = silent_error;
+
 		/* progress */
 		if (state_progress(state, i, countpos, countmax, countsize)) {
 			/* LCOV_EXCL_START */
@@ -473,6 +642,15 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 			/* drop until now */
 			state_usage_waste(state);
 		}
+
+		/* stop if the time limit is reached, the state is then saved as usual */
+		if ((state->opt.time_limit != 0 && time(0) - start >= (time_t)state->opt.time_limit * 60)
+			|| (state->opt.force_time_limit_at != 0 && countpos >= state->opt.force_time_limit_at)) {
+			state_progress_stop(state);
+			msg_progress("Stopping for the time limit at block %u\n", i);
+			log_tag("time_limit:%u: Time limit reached\n", i);
+			break;
+		}
 	}
 
 	state_progress_end(state, countpos, countmax, countsize);
@@ -525,6 +703,7 @@ bail:
 		}
 	}
 
+	limit_done(&limit);
 	free(handle);
 	free(buffer_alloc);
 	free(buffer);
@@ -561,13 +740,14 @@ int state_scrub(struct snapraid_state* state, int percentage, int olderthan)
 	block_off_t lastlimit;
 	block_off_t i;
 	block_off_t count_unscrubbed;
+	block_off_t count_recent;
 	block_off_t count;
 	time_t timelimit;
 	time_t recentlimit;
 	int ret;
 	struct snapraid_parity_handle parity[LEV_MAX];
 	struct snapraid_parity_handle* parity_ptr[LEV_MAX];
-	time_t* timemap;
+	struct snapraid_timemap timemap;
 	unsigned error;
 	time_t now;
 	unsigned l;
@@ -618,11 +798,11 @@ int state_scrub(struct snapraid_state* state, int percentage, int olderthan)
 	}
 
 	/* identify the time limit */
-	/* we sort all the block times, and we identify the time limit for which we reach the quota */
+	/* we count the blocks for each distinct time, and we identify the time limit for which we reach the quota */
 	/* this allow to process first the oldest blocks */
-	timemap = malloc_nofail(blockmax * sizeof(time_t));
+	timemap_init(&timemap);
 
-	/* copy the info in the temp vector */
+	/* collect the info in the histogram */
 	count = 0;
 	count_unscrubbed = 0;
 	log_tag("block_count:%u\n", blockmax);
@@ -639,7 +819,8 @@ int state_scrub(struct snapraid_state* state, int percentage, int olderthan)
 		if (scrub_time == 0)
 			++count_unscrubbed;
 
-		timemap[count++] = scrub_time;
+		timemap_insert(&timemap, scrub_time, 1);
+		++count;
 	}
 
 	if (!count) {
@@ -649,19 +830,13 @@ int state_scrub(struct snapraid_state* state, int percentage, int olderthan)
 		/* LCOV_EXCL_STOP */
 	}
 
-	/* sort it */
-	qsort(timemap, count, sizeof(time_t), time_compare);
+	/* sort the distinct times */
+	timemap_sort(&timemap);
 
 	/* output the info map */
-	i = 0;
 	log_tag("info_count:%u\n", count);
-	while (i < count) {
-		unsigned j = i + 1;
-		while (j < count && timemap[i] == timemap[j])
-			++j;
-		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)timemap[i], j - i);
-		i = j;
-	}
+	for (i = 0; i < timemap.size; ++i)
+		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)timemap.vec[i]->time, timemap.vec[i]->count);
 
 	/* scrub the number of sync block if required */
 	if (percentage == SCRUB_SYNC) {
@@ -673,20 +848,19 @@ int state_scrub(struct snapraid_state* state, int percentage, int olderthan)
 	if (countlimit > count)
 		countlimit = count;
 
-	/* decrease until we reach the specific recentlimit */
-	while (countlimit > 0 && timemap[countlimit - 1] > recentlimit)
-		--countlimit;
+	/* no more than the blocks older than the specific recentlimit */
+	count_recent = timemap_rank(&timemap, recentlimit);
+	if (countlimit > count_recent)
+		countlimit = count_recent;
 
 	/* if there is something to scrub */
 	if (countlimit > 0) {
 		/* get the most recent time we want to scrub */
-		timelimit = timemap[countlimit - 1];
+		timelimit = timemap_nth(&timemap, countlimit - 1);
 
 		/* count how many entries for this exact time we have to scrub */
 		/* if the blocks have all the same time, we end with countlimit == lastlimit */
-		lastlimit = 1;
-		while (countlimit > lastlimit && timemap[countlimit - lastlimit - 1] == timelimit)
-			++lastlimit;
+		lastlimit = countlimit - timemap_rank(&timemap, timelimit - 1);
 	} else {
 		/* if nothing to scrub, disable also other limits */
 		timelimit = 0;
@@ -697,8 +871,8 @@ int state_scrub(struct snapraid_state* state, int percentage, int olderthan)
 	log_tag("time_limit:%" PRIu64 "\n", (uint64_t)timelimit);
 	log_tag("last_limit:%u\n", lastlimit);
 
-	/* free the temp vector */
-	free(timemap);
+	/* free the histogram */
+	timemap_done(&timemap);
 
 	/* open the file for reading */
 	for (l = 0; l < state->level; ++l) {
@@ -46,7 +46,7 @@ void search_file_free(struct snapraid_search_file* file)
 }
 
 struct search_file_compare_arg {
-	const struct snapraid_state* state;
+	struct snapraid_state* state;
 	const struct snapraid_block* block;
 	const struct snapraid_file* file;
 	unsigned char* buffer;
@@ -59,11 +59,8 @@ int search_file_compare(const void* void_arg, const void* void_data)
 {
 	const struct search_file_compare_arg* arg = void_arg;
 	const struct snapraid_search_file* file = void_data;
-	const struct snapraid_state* state = arg->state;
+	struct snapraid_state* state = arg->state;
 	unsigned char buffer_hash[HASH_SIZE];
-	const char* path = file->path;
-	int f;
-	ssize_t ret;
 
 	/* compare file info */
 	if (arg->file->size != file->size)
@@ -75,42 +72,8 @@ int search_file_compare(const void* void_arg, const void* void_data)
 	if (arg->file->mtime_nsec != file->mtime_nsec)
 		return -1;
 
-	/* read the block and compare the hash */
-	f = open(path, O_RDONLY | O_BINARY);
-	if (f == -1) {
-		/* LCOV_EXCL_START */
-		if (errno == ENOENT) {
-			log_fatal("DANGER! file '%s' disappeared.\n", path);
-			log_fatal("If you moved it, please rerun the same command.\n");
-		} else {
-			log_fatal("Error opening file '%s'. %s.\n", path, strerror(errno));
-		}
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
-
-	if (lseek(f, arg->offset, SEEK_SET) != arg->offset) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error seeking file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
-
-	ret = read(f, arg->buffer, arg->read_size);
-	if (ret < 0 || (unsigned)ret != arg->read_size) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
-
-	ret = close(f);
-	if (ret != 0) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error closing file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
-	}
+	/* read the block using the open files cache, and compare the hash */
+	fetch_read(&state->fetch, file->path, arg->offset, arg->buffer, arg->read_size, state->block_size, file->size);
 
 	/* compute the hash */
 	if (arg->prevhash)
@@ -237,13 +200,13 @@ static void search_dir(struct snapraid_state* state, struct snapraid_disk* disk,
 #endif
 
 		if (S_ISREG(st.st_mode)) {
-			if (disk == 0 || filter_path(&state->filterlist, &reason, disk->name, sub_next) == 0) {
+			if (disk == 0 || filter_path(&state->filterset, &reason, disk->name, sub_next) == 0) {
 				search_file(state, path_next, st.st_size, st.st_mtime, STAT_NSEC(&st));
 			} else {
 				msg_verbose("Excluding link '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		} else if (S_ISDIR(st.st_mode)) {
-			if (disk == 0 || filter_dir(&state->filterlist, &reason, disk->name, sub_next) == 0) {
+			if (disk == 0 || filter_dir(&state->filterset, &reason, disk->name, sub_next) == 0) {
 				pathslash(path_next, sizeof(path_next));
 				pathslash(sub_next, sizeof(sub_next));
 				search_dir(state, disk, path_next, sub_next);
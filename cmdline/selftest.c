@@ -119,7 +119,50 @@ static struct hash_test_vector TEST_SPOOKY2[] = {
 	{ 0, 0, { 0 } }
 };
 
+/**
+ * Test vectors for XXH3_128
+ */
+static struct hash_test_vector TEST_XXH3[] = {
+#include "xxh3test.c"
+	{ 0, 0, { 0 } }
+};
+
+struct hash_long_test_vector {
+	int len;
+	unsigned char digest[HASH_SIZE];
+};
+
+/**
+ * Test vectors for XXH3_128 with long data, covering the stripes and the scrambling.
+ * The data is generated as (i * 251 + i / 256) & 0xff.
+ */
+static struct hash_long_test_vector TEST_XXH3_LONG[] = {
+	{ 257, { 0xe2, 0xa9, 0x1e, 0xc4, 0xd1, 0xa3, 0x43, 0x32, 0x00, 0x6e, 0x06, 0xcf, 0xf8, 0x93, 0xca, 0x86 } },
+	{ 1024, { 0xb8, 0x29, 0x8c, 0xd0, 0xeb, 0x9b, 0x9d, 0x4d, 0xf8, 0xf5, 0x18, 0x0c, 0xdf, 0xa9, 0xde, 0x0a } },
+	{ 1025, { 0x5e, 0x6b, 0x39, 0x4d, 0x64, 0x99, 0x05, 0x2d, 0xa0, 0xdb, 0x4f, 0xa1, 0x54, 0x6e, 0x02, 0xd0 } },
+	{ 2048, { 0x71, 0xa9, 0x61, 0xd3, 0x94, 0xa7, 0xe6, 0x24, 0x40, 0x23, 0x5c, 0xf7, 0xec, 0xa9, 0x76, 0x75 } },
+	{ 4113, { 0x39, 0xa7, 0xea, 0x00, 0x3a, 0x8c, 0x3b, 0x5e, 0x57, 0x47, 0x8f, 0x72, 0x6e, 0xfb, 0x57, 0x3d } },
+	{ 0, { 0 } }
+};
+
 #define HASH_TEST_MAX 512 /* tests are never longer than 512 bytes */
+#define HASH_TEST_LONG_MAX 4113 /* long tests are never longer than 4113 bytes */
+
+static void test_hash_xxh3_long(const unsigned char* seed, const unsigned char* buffer)
+{
+	unsigned i;
+
+	for (i = 0; TEST_XXH3_LONG[i].len; ++i) {
+		unsigned char digest[HASH_SIZE];
+		memhash(HASH_XXH3, seed, digest, buffer, TEST_XXH3_LONG[i].len);
+		if (memcmp(digest, TEST_XXH3_LONG[i].digest, HASH_SIZE) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed XXH3 long test\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+}
 
 static void test_hash(void)
 {
@@ -203,6 +246,36 @@ static void test_hash(void)
 		}
 	}
 
+	for (i = 0; TEST_XXH3[i].data; ++i) {
+		unsigned char digest[HASH_SIZE];
+		memcpy(buffer_aligned, TEST_XXH3[i].data, TEST_XXH3[i].len);
+		memhash(HASH_XXH3, seed_aligned, digest, buffer_aligned, TEST_XXH3[i].len);
+		if (memcmp(digest, TEST_XXH3[i].digest, HASH_SIZE) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed XXH3 test\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	free(buffer_alloc);
+
+	buffer_aligned = malloc_nofail_align(HASH_TEST_LONG_MAX, &buffer_alloc);
+
+	for (i = 0; i < HASH_TEST_LONG_MAX; ++i)
+		buffer_aligned[i] = i * 251 + i / 256;
+
+	test_hash_xxh3_long(seed_aligned, buffer_aligned);
+
+#if HAVE_AVX2
+	/* test also without AVX2 */
+	if (hash_avx2) {
+		hash_avx2 = 0;
+		test_hash_xxh3_long(seed_aligned, buffer_aligned);
+		hash_avx2 = 1;
+	}
+#endif
+
 	free(buffer_alloc);
 	free(seed_alloc);
 }
@@ -443,6 +516,185 @@ bail:
 	/* LCOV_EXCL_STOP */
 }
 
+/**
+ * Filters for the filter test, applied in order.
+ */
+static struct filter_test_vector {
+	int direction;
+	int is_disk;
+	const char* pattern;
+} TEST_FILTER[] = {
+	{ -1, 0, "*.tmp" },
+	{ -1, 0, "*.tar.gz" },
+	{ 1, 0, "keep.tmp" },
+	{ -1, 0, "/lost+found/" },
+	{ -1, 0, "Thumbs.db" },
+	{ -1, 0, "/data/cache/" },
+	{ 1, 0, "/data/*.txt" },
+	{ -1, 0, "/data/*/" },
+	{ -1, 0, "tmp/" },
+	{ -1, 0, "*.bak*" },
+	{ -1, 0, "build*/" },
+	{ -1, 0, "/root?file" },
+	{ 1, 0, "[ab]*.c" },
+	{ -1, 0, "*.c" },
+	{ -1, 1, "d2" },
+	{ 1, 0, "*." },
+	{ -1, 0, "/x/y/z" },
+	{ 1, 0, "*.txt" },
+	{ -1, 0, "*" },
+	{ 0, 0, 0 }
+};
+
+/**
+ * Paths for the filter test.
+ */
+static const char* TEST_FILTER_PATH[] = {
+	"file", "file.tmp", "keep.tmp", "dir/keep.tmp", "a.tar.gz", "a.gz",
+	"lost+found", "lost+found/file", "dir/lost+found", "Thumbs.db", "dir/Thumbs.db",
+	"data", "data/cache", "data/cache/file", "data/file.txt", "data/sub/file.txt",
+	"data/sub", "tmp", "dir/tmp", "dir/tmp/file", "file.bak", "file.bak1", "file.bak.txt",
+	"build", "build-1/file", "dir/build", "rootXfile", "root/file", "dir/rootXfile",
+	"a.c", "b.c", "c.c", "dir/a.c", "x.", "x/y/z", "x/y/z/w", "x.txt", "", ".", ".c",
+	0
+};
+
+/**
+ * Reference filter implementation, applying all the filters in order.
+ */
+static int test_filter_reference(tommy_list* filterlist, struct snapraid_filter** reason, const char* disk, const char* sub, int is_dir)
+{
+	tommy_node* i;
+	int direction = 1;
+
+	for (i = tommy_list_head(filterlist); i != 0; i = i->next) {
+		struct snapraid_filter* filter = i->data;
+		char path[PATH_MAX];
+		char* name;
+		unsigned j;
+		int ret = 0;
+
+		if (filter->is_disk) {
+			if (fnmatch(filter->pattern, disk, FNM_CASEINSENSITIVE_FOR_WIN) == 0)
+				ret = filter->direction;
+		} else {
+			pathcpy(path, sizeof(path), sub);
+			name = path;
+			for (j = 0; ret == 0; ++j) {
+				int is_last = path[j] == 0;
+				int is_element_dir = is_last ? is_dir : 1;
+
+				if (!is_last && path[j] != '/')
+					continue;
+
+				path[j] = 0;
+				if (filter->is_dir == is_element_dir) {
+					if (filter->is_path) {
+						if (fnmatch(filter->pattern + 1, path, FNM_PATHNAME | FNM_CASEINSENSITIVE_FOR_WIN) == 0)
+							ret = filter->direction;
+					} else {
+						if (fnmatch(filter->pattern, name, FNM_CASEINSENSITIVE_FOR_WIN) == 0)
+							ret = filter->direction;
+					}
+				}
+
+				if (is_last)
+					break;
+
+				path[j] = '/';
+				name = path + j + 1;
+			}
+		}
+
+		if (ret > 0)
+			return 0;
+		if (ret < 0) {
+			*reason = filter;
+			return -1;
+		}
+
+		direction = -filter->direction;
+		if (direction < 0)
+			*reason = filter;
+	}
+
+	if (is_dir || direction > 0)
+		return 0;
+
+	return -1;
+}
+
+static void test_filter(void)
+{
+	tommy_list filterlist;
+	struct snapraid_filterset filterset;
+	unsigned i, j, k, d;
+
+	/* test all the prefixes of the filter list, to change the last one */
+	for (k = 0; TEST_FILTER[k].pattern; ++k) {
+		tommy_list_init(&filterlist);
+
+		for (i = 0; i <= k; ++i) {
+			struct snapraid_filter* filter;
+
+			if (TEST_FILTER[i].is_disk)
+				filter = filter_alloc_disk(TEST_FILTER[i].direction, TEST_FILTER[i].pattern);
+			else
+				filter = filter_alloc_file(TEST_FILTER[i].direction, TEST_FILTER[i].pattern);
+			if (!filter) {
+				/* LCOV_EXCL_START */
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+
+			tommy_list_insert_tail(&filterlist, &filter->node, filter);
+		}
+
+		filterset_init(&filterset, &filterlist);
+
+		for (j = 0; TEST_FILTER_PATH[j]; ++j) {
+			for (d = 0; d < 2; ++d) {
+				const char* disk = d == 0 ? "d1" : "d2";
+				struct snapraid_filter* reason;
+				struct snapraid_filter* reason_ref;
+				int ret;
+				int ret_ref;
+
+				reason = 0;
+				reason_ref = 0;
+				ret = filter_path(&filterset, &reason, disk, TEST_FILTER_PATH[j]);
+				ret_ref = test_filter_reference(&filterlist, &reason_ref, disk, TEST_FILTER_PATH[j], 0);
+				if (ret != ret_ref || (ret != 0 && reason != reason_ref)) {
+					/* LCOV_EXCL_START */
+					goto bail;
+					/* LCOV_EXCL_STOP */
+				}
+
+				reason = 0;
+				reason_ref = 0;
+				ret = filter_dir(&filterset, &reason, disk, TEST_FILTER_PATH[j]);
+				ret_ref = test_filter_reference(&filterlist, &reason_ref, disk, TEST_FILTER_PATH[j], 1);
+				if (ret != ret_ref || (ret != 0 && reason != reason_ref)) {
+					/* LCOV_EXCL_START */
+					goto bail;
+					/* LCOV_EXCL_STOP */
+				}
+			}
+		}
+
+		filterset_done(&filterset);
+		tommy_list_foreach(&filterlist, (tommy_foreach_func*)filter_free);
+	}
+
+	return;
+
+bail:
+	/* LCOV_EXCL_START */
+	log_fatal("Failed FILTER test\n");
+	exit(EXIT_FAILURE);
+	/* LCOV_EXCL_STOP */
+}
+
 void selftest(void)
 {
 	log_tag("selftest:\n");
@@ -461,6 +713,7 @@ void selftest(void)
 	test_hash();
 	test_crc32c();
 	test_tommy();
+	test_filter();
 	if (raid_selftest() != 0) {
 		/* LCOV_EXCL_START */
 		log_fatal("Failed SELF test\n");
@@ -25,6 +25,25 @@
 #include "state.h"
 #include "raid/raid.h"
 
+/**
+ * Parse the value of a scrub limit.
+ */
+static unsigned limit_parse(const char* arg, const char* name)
+{
+	unsigned long value;
+	char* e;
+
+	value = strtoul(arg, &e, 10);
+	if (!e || *e || value == 0 || value > 1000000) {
+		/* LCOV_EXCL_START */
+		log_fatal("Invalid %s limit '%s'\n", name, arg);
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	return value;
+}
+
 /****************************************************************************/
 /* main */
 
@@ -37,7 +56,7 @@ void usage(void)
 {
 	version();
 
-	printf("Usage: " PACKAGE " status|diff|sync|scrub|list|dup|up|down|smart|pool|check|fix [options]\n");
+	printf("Usage: " PACKAGE " status|diff|sync|scrub|list|dup|up|down|smart|pool|watch|check|fix|bench [options]\n");
 	printf("\n");
 	printf("Commands:\n");
 	printf("  status Print the status of the array\n");
@@ -50,8 +69,10 @@ void usage(void)
 	printf("  down   Spindown the array\n");
 	printf("  smart  SMART attributes of the array\n");
 	printf("  pool   Create or update the virtual view of the array\n");
+	printf("  watch  Log the changes in the array to speed up the next scan\n");
 	printf("  check  Check the array\n");
 	printf("  fix    Fix the array\n");
+	printf("  bench  Benchmark a synthetic array\n");
 	printf("\n");
 	printf("Options:\n");
 	printf("  " SWITCH_GETOPT_LONG("-c, --conf FILE       ", "-c") "  Configuration file\n");
@@ -245,6 +266,18 @@ void config(char* conf, size_t conf_size, const char* argv0)
 #define OPT_TEST_FORCE_AUTOSAVE_AT 283
 #define OPT_TEST_FAKE_DEVICE 284
 #define OPT_TEST_EXPECT_NEED_SYNC 285
+#define OPT_TEST_FORCE_XXH3 286
+#define OPT_BENCH_SIZE 287
+#define OPT_BENCH_JSON 288
+#define OPT_LIMIT_SPEED 289
+#define OPT_LIMIT_DISK_SPEED 290
+#define OPT_LIMIT_IOPS 291
+#define OPT_LIMIT_DISK_IOPS 292
+#define OPT_LIMIT_LATENCY 293
+#define OPT_TIME_LIMIT 294
+#define OPT_COPY_BY_CONTENT 295
+#define OPT_TEST_FORCE_TIME_LIMIT_AT 296
+#define OPT_TEST_SKIP_WATCH_LOCK 297
 
 #if HAVE_GETOPT_LONG
 struct option long_options[] = {
@@ -270,6 +303,15 @@ struct option long_options[] = {
 	{ "pre-hash", 0, 0, 'h' },
 	{ "speed-test", 0, 0, 'T' }, /* undocumented speed test command */
 	{ "gen-conf", 1, 0, 'C' },
+	{ "bench-size", 1, 0, OPT_BENCH_SIZE },
+	{ "bench-json", 1, 0, OPT_BENCH_JSON },
+	{ "limit-speed", 1, 0, OPT_LIMIT_SPEED },
+	{ "limit-disk-speed", 1, 0, OPT_LIMIT_DISK_SPEED },
+	{ "limit-iops", 1, 0, OPT_LIMIT_IOPS },
+	{ "limit-disk-iops", 1, 0, OPT_LIMIT_DISK_IOPS },
+	{ "limit-latency", 1, 0, OPT_LIMIT_LATENCY },
+	{ "time-limit", 1, 0, OPT_TIME_LIMIT },
+	{ "copy-by-content", 0, 0, OPT_COPY_BY_CONTENT },
 	{ "verbose", 0, 0, 'v' },
 	{ "quiet", 0, 0, 'q' }, /* undocumented quiet option */
 	{ "gui", 0, 0, 'G' }, /* undocumented GUI interface option */
@@ -307,10 +349,14 @@ struct option long_options[] = {
 
 	/* Force Spooky2 hash */
 	{ "test-force-spooky2", 0, 0, OPT_TEST_FORCE_SPOOKY2 },
+	{ "test-force-xxh3", 0, 0, OPT_TEST_FORCE_XXH3 },
 
 	/* Skip the use of lock file */
 	{ "test-skip-lock", 0, 0, OPT_TEST_SKIP_LOCK },
 
+	/* Trust the change log of the watcher even if not locked */
+	{ "test-skip-watch-lock", 0, 0, OPT_TEST_SKIP_WATCH_LOCK },
+
 	/* Force a sort order for files */
 	{ "test-force-order-physical", 0, 0, OPT_TEST_FORCE_ORDER_PHYSICAL },
 	{ "test-force-order-inode", 0, 0, OPT_TEST_FORCE_ORDER_INODE },
@@ -323,6 +369,9 @@ struct option long_options[] = {
 	/* Force scrub of all the even blocks. This is really for testing, don't try it */
 	{ "test-force-scrub-even", 0, 0, OPT_TEST_FORCE_SCRUB_EVEN },
 
+	/* Force the scrub time limit after the specified number of blocks */
+	{ "test-force-time-limit-at", 1, 0, OPT_TEST_FORCE_TIME_LIMIT_AT },
+
 	/* Force write of the content file even if no modification is done */
 	{ "test-force-content-write", 0, 0, OPT_TEST_FORCE_CONTENT_WRITE },
 
@@ -415,6 +464,8 @@ void signal_init(void)
 #define OPERATION_SPINDOWN 15
 #define OPERATION_DEVICES 16
 #define OPERATION_SMART 17
+#define OPERATION_WATCH 18
+#define OPERATION_BENCH 19
 
 int main(int argc, char* argv[])
 {
@@ -442,6 +493,8 @@ int main(int argc, char* argv[])
 	const char* run;
 	int speedtest;
 	int period;
+	uint64_t bench_size;
+	const char* bench_json;
 	time_t t;
 	struct tm* tm;
 	int i;
@@ -455,6 +508,8 @@ int main(int argc, char* argv[])
 	tommy_list_init(&filterlist_file);
 	tommy_list_init(&filterlist_disk);
 	period = 1000;
+	bench_size = 0;
+	bench_json = 0;
 	filter_missing = 0;
 	filter_error = 0;
 	percentage = SCRUB_AUTO;
@@ -676,9 +731,15 @@ int main(int argc, char* argv[])
 		case OPT_TEST_FORCE_SPOOKY2 :
 			opt.force_spooky2 = 1;
 			break;
+		case OPT_TEST_FORCE_XXH3 :
+			opt.force_xxh3 = 1;
+			break;
 		case OPT_TEST_SKIP_LOCK :
 			opt.skip_lock = 1;
 			break;
+		case OPT_TEST_SKIP_WATCH_LOCK :
+			opt.skip_watch_lock = 1;
+			break;
 		case OPT_TEST_FORCE_ORDER_PHYSICAL :
 			opt.force_order = SORT_PHYSICAL;
 			break;
@@ -697,6 +758,9 @@ int main(int argc, char* argv[])
 		case OPT_TEST_FORCE_SCRUB_EVEN :
 			opt.force_scrub_even = 1;
 			break;
+		case OPT_TEST_FORCE_TIME_LIMIT_AT :
+			opt.force_time_limit_at = atoi(optarg);
+			break;
 		case OPT_TEST_FORCE_CONTENT_WRITE :
 			opt.force_content_write = 1;
 			break;
@@ -725,6 +789,40 @@ int main(int argc, char* argv[])
 		case OPT_TEST_FAKE_DEVICE :
 			opt.fake_device = 1;
 			break;
+		case OPT_BENCH_SIZE :
+			bench_size = strtoul(optarg, &e, 10);
+			if (!e || *e || bench_size == 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid bench size '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			bench_size *= 1024 * 1024;
+			break;
+		case OPT_BENCH_JSON :
+			bench_json = optarg;
+			break;
+		case OPT_LIMIT_SPEED :
+			opt.limit_speed = limit_parse(optarg, "speed");
+			break;
+		case OPT_LIMIT_DISK_SPEED :
+			opt.limit_disk_speed = limit_parse(optarg, "disk speed");
+			break;
+		case OPT_LIMIT_IOPS :
+			opt.limit_iops = limit_parse(optarg, "iops");
+			break;
+		case OPT_LIMIT_DISK_IOPS :
+			opt.limit_disk_iops = limit_parse(optarg, "disk iops");
+			break;
+		case OPT_LIMIT_LATENCY :
+			opt.limit_latency = limit_parse(optarg, "latency");
+			break;
+		case OPT_TIME_LIMIT :
+			opt.time_limit = limit_parse(optarg, "time");
+			break;
+		case OPT_COPY_BY_CONTENT :
+			opt.copy_content = 1;
+			break;
 		default :
 			/* LCOV_EXCL_START */
 			log_fatal("Unknown option '%c'\n", (char)c);
@@ -736,6 +834,7 @@ int main(int argc, char* argv[])
 	os_init(opt.force_scan_winfind);
 	raid_init();
 	crc32c_init();
+	memhash_init();
 
 	if (speedtest != 0) {
 		speed(period);
@@ -793,6 +892,10 @@ int main(int argc, char* argv[])
 		operation = OPERATION_DEVICES;
 	} else if (strcmp(argv[optind], "smart") == 0) {
 		operation = OPERATION_SMART;
+	} else if (strcmp(argv[optind], "watch") == 0) {
+		operation = OPERATION_WATCH;
+	} else if (strcmp(argv[optind], "bench") == 0) {
+		operation = OPERATION_BENCH;
 	} else {
 		/* LCOV_EXCL_START */
 		log_fatal("Unknown command '%s'\n", argv[optind]);
@@ -839,6 +942,18 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	switch (operation) {
+	case OPERATION_SCRUB :
+		break;
+	default :
+		if (opt.limit_speed || opt.limit_disk_speed || opt.limit_iops || opt.limit_disk_iops || opt.limit_latency || opt.time_limit) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use the --limit and --time-limit options with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
 	switch (operation) {
 	case OPERATION_SYNC :
 		break;
@@ -872,6 +987,26 @@ int main(int argc, char* argv[])
 		/* LCOV_EXCL_STOP */
 	}
 
+	switch (operation) {
+	case OPERATION_SYNC :
+	case OPERATION_DIFF :
+		break;
+	default :
+		if (opt.copy_content) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use --copy-by-content with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	if (opt.copy_content && opt.force_nocopy) {
+		/* LCOV_EXCL_START */
+		log_fatal("You cannot use the --copy-by-content and -N, --force-nocopy options at the same time\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
 	switch (operation) {
 	case OPERATION_CHECK :
 	case OPERATION_FIX :
@@ -949,6 +1084,7 @@ int main(int argc, char* argv[])
 	case OPERATION_READ :
 	case OPERATION_REHASH :
 	case OPERATION_NANO :
+	case OPERATION_WATCH :
 	case OPERATION_SPINUP : /* we want to do it in different threads to avoid blocking */
 		/* avoid to check and access parity disks if not needed */
 		opt.skip_parity_access = 1;
@@ -973,6 +1109,7 @@ int main(int argc, char* argv[])
 	case OPERATION_SPINDOWN :
 	case OPERATION_DEVICES :
 	case OPERATION_SMART :
+	case OPERATION_WATCH :
 		opt.skip_self = 1;
 		break;
 	}
@@ -980,6 +1117,7 @@ int main(int argc, char* argv[])
 	switch (operation) {
 	case OPERATION_DEVICES :
 	case OPERATION_SMART :
+	case OPERATION_WATCH :
 		/* we may need to use these commands during operations */
 		opt.skip_lock = 1;
 		break;
@@ -1006,6 +1144,19 @@ int main(int argc, char* argv[])
 	if (!opt.skip_self)
 		selftest();
 
+	if (operation == OPERATION_BENCH) {
+		if (bench_size == 0) {
+			if (opt.skip_device)
+				bench_size = 16 * 1024 * 1024; /* reduce size of the bench */
+			else
+				bench_size = 1024 * 1024 * 1024;
+		}
+		bench(&opt, bench_size, bench_json);
+		log_close(log_file);
+		os_done();
+		exit(EXIT_SUCCESS);
+	}
+
 	state_init(&state);
 
 	/* read the configuration file */
@@ -1210,12 +1361,17 @@ int main(int argc, char* argv[])
 		state_device(&state, DEVICE_LIST);
 	} else if (operation == OPERATION_SMART) {
 		state_device(&state, DEVICE_SMART);
+	} else if (operation == OPERATION_WATCH) {
+		state_watch(&state);
 	} else if (operation == OPERATION_STATUS) {
-		state_read(&state);
+		/* if the summary is up to date, avoid to read the content file */
+		if (state_status_summary(&state) != 0) {
+			state_read(&state);
 
-		memory();
+			memory();
 
-		state_status(&state);
+			state_status(&state);
+		}
 	} else if (operation == OPERATION_DUP) {
 		state_read(&state);
 
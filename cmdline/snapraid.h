@@ -21,7 +21,10 @@
 /****************************************************************************/
 /* snapraid */
 
+struct snapraid_option;
+
 void speed(int period);
+void bench(struct snapraid_option* opt, uint64_t size, const char* json);
 void selftest(void);
 
 #endif
@@ -67,6 +67,390 @@ static int64_t diffgettimeofday(struct timeval *start, struct timeval *stop)
 	ds = size * (int64_t)count * nd; \
 	dt = diffgettimeofday(&start, &stop);
 
+/*
+ * Number of filters to test.
+ */
+#define TEST_FILTER_COUNT (200)
+
+/*
+ * Number of paths to test.
+ */
+#define TEST_FILTER_PATH (64)
+
+/**
+ * Speed of the filters applied in the scan.
+ */
+static void speed_filter(int period)
+{
+	struct timeval start;
+	struct timeval stop;
+	int64_t ds;
+	int64_t dt;
+	int i, j;
+	int count;
+	int delta = period >= 1000 ? 10 : 1;
+	int size = 1;
+	int nd = TEST_FILTER_PATH;
+	tommy_list filterlist;
+	struct snapraid_filterset filterset;
+	char path[TEST_FILTER_PATH][PATH_MAX];
+
+	/* a mix of extensions, names, paths and generic patterns */
+	tommy_list_init(&filterlist);
+	for (i = 0; i < TEST_FILTER_COUNT; ++i) {
+		struct snapraid_filter* filter;
+		char pattern[PATH_MAX];
+
+		switch (i % 4) {
+		case 0 : snprintf(pattern, sizeof(pattern), "*.ext%d", i); break;
+		case 1 : snprintf(pattern, sizeof(pattern), "name%d", i); break;
+		case 2 : snprintf(pattern, sizeof(pattern), "/dir%d/", i); break;
+		default : snprintf(pattern, sizeof(pattern), "cache%d*/", i); break;
+		}
+
+		filter = filter_alloc_file(-1, pattern);
+		if (!filter) {
+			/* LCOV_EXCL_START */
+			log_fatal("Invalid filter '%s'\n", pattern);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+		tommy_list_insert_tail(&filterlist, &filter->node, filter);
+	}
+
+	for (i = 0; i < TEST_FILTER_PATH; ++i)
+		snprintf(path[i], sizeof(path[i]), "dir%d/sub%d/file%d.ext%d", i * 3, i, i, i * 7);
+
+	filterset_init(&filterset, &filterlist);
+
+	printf("Filters used to include/exclude files in 'sync', in thousands of paths/s:\n");
+	printf("%8s", "");
+	printf("%8d", TEST_FILTER_COUNT);
+	printf("\n");
+
+	printf("%8s", "filter");
+	fflush(stdout);
+
+	SPEED_START {
+		for (j = 0; j < nd; ++j)
+			filter_path(&filterset, 0, "d1", path[j]);
+	} SPEED_STOP
+
+	printf("%8" PRIu64, ds * 1000 / dt);
+	printf("\n");
+	printf("\n");
+
+	filterset_done(&filterset);
+	tommy_list_foreach(&filterlist, (tommy_foreach_func*)filter_free);
+}
+
+/*
+ * Block sizes of the sweep, in KiB.
+ */
+static const unsigned SWEEP_SIZE[] = { 64, 128, 256, 512, 1024 };
+#define SWEEP_SIZE_MAX (sizeof(SWEEP_SIZE) / sizeof(SWEEP_SIZE[0]))
+
+/*
+ * Number of data disks of the sweep.
+ */
+static const unsigned SWEEP_DATA[] = { 4, 8, 16, 32, 60 };
+#define SWEEP_DATA_MAX (sizeof(SWEEP_DATA) / sizeof(SWEEP_DATA[0]))
+
+/*
+ * Max number of threads of the sweep.
+ */
+#define SWEEP_THREAD_MAX 64
+
+/**
+ * State of a thread of the sweep.
+ */
+struct speed_thread {
+	int period; /**< Period of the measure in ms. */
+	int64_t ds; /**< Bytes processed. */
+	int64_t dt; /**< Time used in us. */
+#if HAVE_PTHREAD_CREATE
+	pthread_t thread;
+#endif
+};
+
+/**
+ * Compute hash and parity like 'sync', with 8 data disks, 2 parities
+ * and blocks of 256 KiB.
+ */
+static void* speed_thread(void* arg)
+{
+	struct speed_thread* thread = arg;
+	struct timeval start;
+	struct timeval stop;
+	unsigned char digest[HASH_SIZE];
+	unsigned char seed[HASH_SIZE];
+	unsigned hash = memhash_best();
+	int64_t ds;
+	int64_t dt;
+	int i, j;
+	int count;
+	int delta = 1;
+	int period = thread->period;
+	int size = TEST_SIZE;
+	int nd = TEST_COUNT;
+	int np = 2;
+	void *v_alloc;
+	void **v;
+
+	v = malloc_nofail_vector_align(nd, nd + np, size, &v_alloc);
+
+	for (i = 0; i < nd; ++i)
+		memset(v[i], i, size);
+
+	for (i = 0; i < HASH_SIZE; ++i)
+		seed[i] = i;
+
+	SPEED_START {
+		for (j = 0; j < nd; ++j)
+			memhash(hash, seed, digest, v[j], size);
+		raid_gen(nd, np, size, v);
+	} SPEED_STOP
+
+	thread->ds = ds;
+	thread->dt = dt;
+
+	free(v_alloc);
+	free(v);
+
+	return 0;
+}
+
+/**
+ * Sweep of block size, number of data disks, parity level and threads.
+ */
+static void speed_sweep(int period)
+{
+	struct timeval start;
+	struct timeval stop;
+	int64_t ds;
+	int64_t dt;
+	int i, j;
+	unsigned char digest[HASH_SIZE];
+	unsigned char seed[HASH_SIZE];
+	unsigned hash = memhash_best();
+	uint64_t gen[SWEEP_DATA_MAX][RAID_PARITY_MAX][SWEEP_SIZE_MAX];
+	uint64_t rec[SWEEP_DATA_MAX][RAID_PARITY_MAX][SWEEP_SIZE_MAX];
+	uint64_t hashed[SWEEP_SIZE_MAX];
+	struct speed_thread thread[SWEEP_THREAD_MAX];
+	int ir[RAID_PARITY_MAX];
+	unsigned s, d, t, n;
+	int np;
+	int count;
+	int delta = 1;
+	int nd_max = SWEEP_DATA[SWEEP_DATA_MAX - 1];
+	int nd;
+	int nv;
+	void *v_alloc;
+	void **v;
+	void *w[RAID_DATA_MAX + RAID_PARITY_MAX];
+
+	/* each measure is shorter, as they are a lot */
+	period /= 10;
+	if (period == 0)
+		period = 1;
+
+	nv = nd_max + RAID_PARITY_MAX + 1;
+
+	for (i = 0; i < HASH_SIZE; ++i)
+		seed[i] = i;
+
+	/* the failed blocks start from the first data disk */
+	for (i = 0; i < RAID_PARITY_MAX; ++i)
+		ir[i] = i;
+
+	printf("Sweep of the block size, number of data disks and parity level.\n");
+	printf("It can be used to select the best 'blocksize' and number of parities.\n");
+	printf("Rows are data disks 'd' and parities 'p', and columns are the block size in KiB.\n");
+	printf("Values are in MiB/s of data. It takes some time...\n");
+	printf("\n");
+	fflush(stdout);
+
+	for (s = 0; s < SWEEP_SIZE_MAX; ++s) {
+		int size = SWEEP_SIZE[s] * 1024;
+
+		v = malloc_nofail_vector_align(nd_max, nv, size, &v_alloc);
+
+		for (i = 0; i < nd_max; ++i)
+			memset(v[i], i, size);
+
+		/* zero buffer of the size of the block */
+		memset(v[nv - 1], 0, size);
+		raid_zero(v[nv - 1]);
+
+		nd = TEST_COUNT;
+
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				memhash(hash, seed, digest, v[j], size);
+		} SPEED_STOP
+
+		hashed[s] = ds / dt;
+
+		for (d = 0; d < SWEEP_DATA_MAX; ++d) {
+			nd = SWEEP_DATA[d];
+
+			/* data followed by parity */
+			for (i = 0; i < nd; ++i)
+				w[i] = v[i];
+			for (i = 0; i < RAID_PARITY_MAX; ++i)
+				w[nd + i] = v[nd_max + i];
+
+			for (np = 1; np <= RAID_PARITY_MAX; ++np) {
+				SPEED_START {
+					raid_gen(nd, np, size, w);
+				} SPEED_STOP
+
+				gen[d][np - 1][s] = ds / dt;
+
+				SPEED_START {
+					raid_rec(np, ir, nd, np, size, w);
+				} SPEED_STOP
+
+				rec[d][np - 1][s] = ds / dt;
+			}
+		}
+
+		free(v_alloc);
+		free(v);
+	}
+
+	printf("%8s", "");
+	for (s = 0; s < SWEEP_SIZE_MAX; ++s)
+		printf("%8u", SWEEP_SIZE[s]);
+	printf("\n");
+
+	printf("%8s", "hash");
+	for (s = 0; s < SWEEP_SIZE_MAX; ++s)
+		printf("%8" PRIu64, hashed[s]);
+	printf("\n");
+	printf("\n");
+
+	printf("Parity computation with 'sync':\n");
+	for (d = 0; d < SWEEP_DATA_MAX; ++d) {
+		for (np = 1; np <= RAID_PARITY_MAX; ++np) {
+			printf("%5ud%up", SWEEP_DATA[d], np);
+			for (s = 0; s < SWEEP_SIZE_MAX; ++s)
+				printf("%8" PRIu64, gen[d][np - 1][s]);
+			printf("\n");
+		}
+	}
+	printf("\n");
+
+	printf("Recovering of all the parity level failures with 'fix':\n");
+	for (d = 0; d < SWEEP_DATA_MAX; ++d) {
+		for (np = 1; np <= RAID_PARITY_MAX; ++np) {
+			printf("%5ud%up", SWEEP_DATA[d], np);
+			for (s = 0; s < SWEEP_SIZE_MAX; ++s)
+				printf("%8" PRIu64, rec[d][np - 1][s]);
+			printf("\n");
+		}
+	}
+	printf("\n");
+
+	/* sync computes the hash and the parity in sequence for each block */
+	printf("Max 'sync' speed from hash and parity, without considering the disks speed:\n");
+	for (d = 0; d < SWEEP_DATA_MAX; ++d) {
+		for (np = 1; np <= RAID_PARITY_MAX; ++np) {
+			printf("%5ud%up", SWEEP_DATA[d], np);
+			for (s = 0; s < SWEEP_SIZE_MAX; ++s) {
+				uint64_t g = gen[d][np - 1][s];
+				uint64_t h = hashed[s];
+				printf("%8" PRIu64, g && h ? g * h / (g + h) : 0);
+			}
+			printf("\n");
+		}
+	}
+	printf("\n");
+
+	/* threads scaling */
+	n = 1;
+#if HAVE_PTHREAD_CREATE && defined(_SC_NPROCESSORS_ONLN)
+	{
+		long cpu = sysconf(_SC_NPROCESSORS_ONLN);
+		if (cpu > SWEEP_THREAD_MAX)
+			cpu = SWEEP_THREAD_MAX;
+		if (cpu > 1)
+			n = cpu;
+	}
+#endif
+
+	printf("Hash and parity in multiple threads, with %u data disks, 2 parities and\n", TEST_COUNT);
+	printf("blocks of %u KiB, in aggregate MiB/s of data:\n", TEST_SIZE / 1024);
+	printf("%8s", "threads");
+	for (t = 1; t <= n; t *= 2)
+		printf("%8u", t);
+	printf("\n");
+
+	printf("%8s", "sync");
+	fflush(stdout);
+	for (t = 1; t <= n; t *= 2) {
+		int64_t bw = 0;
+
+		for (i = 0; i < (int)t; ++i) {
+			thread[i].period = period;
+#if HAVE_PTHREAD_CREATE
+			if (pthread_create(&thread[i].thread, 0, speed_thread, &thread[i]) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Failed to create thread.\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+#else
+			speed_thread(&thread[i]);
+#endif
+		}
+
+		for (i = 0; i < (int)t; ++i) {
+#if HAVE_PTHREAD_CREATE
+			if (pthread_join(thread[i].thread, 0) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Failed to join thread.\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+#endif
+			bw += thread[i].ds / thread[i].dt;
+		}
+
+		printf("%8" PRIi64, bw);
+		fflush(stdout);
+	}
+	printf("\n");
+	printf("\n");
+}
+
+#if defined(CONFIG_X86) && defined(CONFIG_AVX2)
+/**
+ * Measure a recovering function forcing the non-temporal stores.
+ */
+static void speed_rec_nt(void (*rec)(struct raid_rec* rr, int nd, size_t size, void** vv), struct raid_rec* rr, int nd, int size, void** v, int period)
+{
+	struct timeval start;
+	struct timeval stop;
+	int64_t ds;
+	int64_t dt;
+	int i, j;
+	int count;
+	int delta = period >= 1000 ? 10 : 1;
+
+	raid_rec_nt_size = 0;
+
+	SPEED_START {
+		for (j = 0; j < nd; ++j)
+			rec(rr, nd, size, v);
+	} SPEED_STOP
+
+	raid_rec_nt_size = RAID_REC_NT_SIZE;
+
+	printf("%8" PRIu64, ds / dt);
+}
+#endif
+
 void speed(int period)
 {
 	struct timeval start;
@@ -78,6 +462,7 @@ void speed(int period)
 	unsigned char seed[HASH_SIZE];
 	int id[RAID_PARITY_MAX];
 	int ip[RAID_PARITY_MAX];
+	struct raid_rec rr;
 	int count;
 	int delta = period >= 1000 ? 10 : 1;
 	int size = TEST_SIZE;
@@ -208,20 +593,11 @@ void speed(int period)
 	printf("%8s", "best");
 	printf("%8s", "murmur3");
 	printf("%8s", "spooky2");
+	printf("%8s", "xxh3");
 	printf("\n");
 
 	printf("%8s", "hash");
-#ifdef CONFIG_X86
-	if (sizeof(void *) == 4 && !raid_cpu_has_slowmult())
-		printf("%8s", "murmur3");
-	else
-		printf("%8s", "spooky2");
-#else
-	if (sizeof(void *) == 4)
-		printf("%8s", "murmur3");
-	else
-		printf("%8s", "spooky2");
-#endif
+	printf("%8s", hash_config_name(memhash_best()));
 	fflush(stdout);
 
 	SPEED_START {
@@ -237,6 +613,14 @@ void speed(int period)
 			memhash(HASH_SPOOKY2, seed, digest, v[j], size);
 	} SPEED_STOP
 
+	printf("%8" PRIu64, ds / dt);
+	fflush(stdout);
+
+	SPEED_START {
+		for (j = 0; j < nd; ++j)
+			memhash(HASH_XXH3, seed, digest, v[j], size);
+	} SPEED_STOP
+
 	printf("%8" PRIu64, ds / dt);
 	printf("\n");
 	printf("\n");
@@ -706,6 +1090,7 @@ void speed(int period)
 #ifdef CONFIG_X86
 	printf("%8s", "ssse3");
 	printf("%8s", "avx2");
+	printf("%8s", "avx2nt");
 #endif
 	printf("\n");
 
@@ -713,10 +1098,12 @@ void speed(int period)
 	printf("%8s", raid_rec1_tag());
 	fflush(stdout);
 
+	/* +1 to avoid GEN1 optimized case */
+	raid_rec_init(&rr, 1, id, ip + 1);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			/* +1 to avoid GEN1 optimized case */
-			raid_rec1_int8(1, id, ip + 1, nd, size, v);
+			raid_rec1_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -727,8 +1114,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_ssse3(1, id, ip + 1, nd, size, v);
+				raid_rec1_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -738,11 +1124,12 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_avx2(1, id, ip + 1, nd, size, v);
+				raid_rec1_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_rec1_avx2, &rr, nd, size, v, period);
 	}
 #endif
 #endif
@@ -752,10 +1139,12 @@ void speed(int period)
 	printf("%8s", raid_rec2_tag());
 	fflush(stdout);
 
+	/* +1 to avoid GEN2 optimized case */
+	raid_rec_init(&rr, 2, id, ip + 1);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			/* +1 to avoid GEN2 optimized case */
-			raid_rec2_int8(2, id, ip + 1, nd, size, v);
+			raid_rec2_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -766,8 +1155,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN2 optimized case */
-				raid_rec2_ssse3(2, id, ip + 1, nd, size, v);
+				raid_rec2_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -777,11 +1165,12 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN1 optimized case */
-				raid_rec2_avx2(2, id, ip + 1, nd, size, v);
+				raid_rec2_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_rec2_avx2, &rr, nd, size, v, period);
 	}
 #endif
 #endif
@@ -791,9 +1180,11 @@ void speed(int period)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 3, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(3, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -804,7 +1195,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(3, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -814,10 +1205,12 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(3, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v, period);
 	}
 #endif
 #endif
@@ -827,9 +1220,11 @@ void speed(int period)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 4, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(4, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -840,7 +1235,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(4, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -850,10 +1245,12 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(4, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v, period);
 	}
 #endif
 #endif
@@ -863,9 +1260,11 @@ void speed(int period)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 5, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(5, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -876,7 +1275,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(5, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -886,10 +1285,12 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(5, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v, period);
 	}
 #endif
 #endif
@@ -899,9 +1300,11 @@ void speed(int period)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 6, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(6, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -912,7 +1315,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(6, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -922,16 +1325,22 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(6, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v, period);
 	}
 #endif
 #endif
 	printf("\n");
 	printf("\n");
 
+	speed_filter(period);
+
+	speed_sweep(period);
+
 	printf("If the 'best' expectations are wrong, please report it in the SnapRAID forum\n\n");
 
 	free(v_alloc);
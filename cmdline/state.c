@@ -121,6 +121,8 @@ void state_init(struct snapraid_state* state)
 	memset(&state->opt, 0, sizeof(state->opt));
 	state->filter_hidden = 0;
 	state->autosave = 0;
+	state->quickscan = 0;
+	state->quickscan_last = 0;
 	state->need_write = 0;
 	state->checked_read = 0;
 	state->block_size = 256 * 1024; /* default 256 KiB */
@@ -134,16 +136,29 @@ void state_init(struct snapraid_state* state)
 		state->parity[l].total_blocks = 0;
 		state->parity[l].free_blocks = 0;
 		state->parity[l].tick = 0;
+		state->parity[l].write_tick = 0;
+		memset(&state->parity[l].latency, 0, sizeof(state->parity[l].latency));
+		memset(&state->parity[l].write_latency, 0, sizeof(state->parity[l].write_latency));
 		state->parity[l].skip_access = 0;
 		state->parity[l].is_excluded = 0;
 	}
 	state->tick_io = 0;
 	state->tick_cpu = 0;
+	state->tick_hash = 0;
+	state->tick_raid = 0;
 	state->tick_last = tick();
+	state->tick_freq = tick_freq();
+	state->usage_last = 0;
 	state->share[0] = 0;
 	state->pool[0] = 0;
 	state->pool_device = 0;
 	state->lockfile[0] = 0;
+	state->prometheus[0] = 0;
+	state->prometheus_last = 0;
+	state->content_write_ms = 0;
+	state->progress_error = 0;
+	state->progress_io_error = 0;
+	state->progress_silent_error = 0;
 	state->level = 1; /* default is the lowest protection */
 	state->clear_past_hash = 0;
 	state->no_conf = 0;
@@ -152,9 +167,11 @@ void state_init(struct snapraid_state* state)
 	tommy_list_init(&state->maplist);
 	tommy_list_init(&state->contentlist);
 	tommy_list_init(&state->filterlist);
+	filterset_init(&state->filterset, &state->filterlist);
 	tommy_list_init(&state->importlist);
 	tommy_hashdyn_init(&state->importset);
 	tommy_hashdyn_init(&state->previmportset);
+	fetch_init(&state->fetch);
 	tommy_hashdyn_init(&state->searchset);
 	tommy_arrayblkof_init(&state->infoarr, sizeof(snapraid_info));
 }
@@ -164,11 +181,13 @@ void state_done(struct snapraid_state* state)
 	tommy_list_foreach(&state->disklist, (tommy_foreach_func*)disk_free);
 	tommy_list_foreach(&state->maplist, (tommy_foreach_func*)map_free);
 	tommy_list_foreach(&state->contentlist, (tommy_foreach_func*)content_free);
+	filterset_done(&state->filterset);
 	tommy_list_foreach(&state->filterlist, (tommy_foreach_func*)filter_free);
 	tommy_list_foreach(&state->importlist, (tommy_foreach_func*)import_file_free);
 	tommy_hashdyn_foreach(&state->searchset, (tommy_foreach_func*)search_file_free);
 	tommy_hashdyn_done(&state->importset);
 	tommy_hashdyn_done(&state->previmportset);
+	fetch_done(&state->fetch);
 	tommy_hashdyn_done(&state->searchset);
 	tommy_arrayblkof_done(&state->infoarr);
 }
@@ -707,6 +726,30 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 			}
 
 			state->pool_device = st.st_dev;
+		} else if (strcmp(tag, "prometheus") == 0) {
+			if (*state->prometheus) {
+				/* LCOV_EXCL_START */
+				log_fatal("Multiple 'prometheus' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			ret = sgetlasttok(f, buffer, sizeof(buffer));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'prometheus' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (!*buffer) {
+				/* LCOV_EXCL_START */
+				log_fatal("Empty 'prometheus' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			pathimport(state->prometheus, sizeof(state->prometheus), buffer);
 		} else if (strcmp(tag, "content") == 0) {
 			struct snapraid_content* content;
 			char device[PATH_MAX];
@@ -1029,6 +1072,33 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 
 			/* convert to GB */
 			state->autosave *= GIGA;
+		} else if (strcmp(tag, "quickscan") == 0) {
+			char* e;
+
+			ret = sgetlasttok(f, buffer, sizeof(buffer));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'quickscan' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (!*buffer) {
+				/* LCOV_EXCL_START */
+				log_fatal("Empty 'quickscan' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			state->quickscan = strtoul(buffer, &e, 0);
+
+			if (!e || *e || state->quickscan == 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'quickscan' specification in '%s' at line %u\n", path, line);
+				log_fatal("Specify the max number of days between full scans\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
 		} else if (tag[0] == 0) {
 			/* allow empty lines */
 		} else if (tag[0] == '#') {
@@ -1074,23 +1144,19 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 
 	state_config_check(state, path, filterlist_disk);
 
+	/* compile the filters */
+	filterset_done(&state->filterset);
+	filterset_init(&state->filterset, &state->filterlist);
+
 	/* select the default hash */
 	if (state->opt.force_murmur3) {
 		state->besthash = HASH_MURMUR3;
 	} else if (state->opt.force_spooky2) {
 		state->besthash = HASH_SPOOKY2;
+	} else if (state->opt.force_xxh3) {
+		state->besthash = HASH_XXH3;
 	} else {
-#ifdef CONFIG_X86
-		if (sizeof(void*) == 4 && !raid_cpu_has_slowmult())
-			state->besthash = HASH_MURMUR3;
-		else
-			state->besthash = HASH_SPOOKY2;
-#else
-		if (sizeof(void*) == 4)
-			state->besthash = HASH_MURMUR3;
-		else
-			state->besthash = HASH_SPOOKY2;
-#endif
+		state->besthash = memhash_best();
 	}
 
 	/* by default use the best hash */
@@ -1124,6 +1190,8 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 		log_tag("share:%s\n", state->share);
 	if (state->autosave != 0)
 		log_tag("autosave:%" PRIu64 "\n", state->autosave);
+	if (state->quickscan != 0)
+		log_tag("quickscan:%u\n", state->quickscan);
 	for (i = tommy_list_head(&state->filterlist); i != 0; i = i->next) {
 		char out[PATH_MAX];
 		struct snapraid_filter* filter = i->data;
@@ -1601,8 +1669,10 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 	int ret;
 	tommy_array disk_mapping;
 	uint32_t mapping_max;
+	struct snapraid_file* last_file;
 
 	blockmax = 0;
+	last_file = 0;
 	count_file = 0;
 	count_hardlink = 0;
 	count_symlink = 0;
@@ -1626,9 +1696,14 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 	 *  - SNAPCNT2/SnapRAID 7.0 Adds entries 'M' and 'P', to add free_blocks support.
 	 *    The previous 'm' entry is now deprecated, but supported for importing.
 	 *    Similarly for text file, we add 'mapping' and 'parity' deprecating 'map'.
+	 *  - SNAPCNT3/SnapRAID 9.0 Adds the optional entries 'd' and 'Q' for the quick scan,
+	 *    'o' to store the physical offset of the previous file, and 'w' for the
+	 *    position in the change log of the watch command.
+	 *    The version is increased because older versions fail on the new entries.
 	 */
 	if (memcmp(buffer, "SNAPCNT1\n\3\0\0", 12) != 0
-		&& memcmp(buffer, "SNAPCNT2\n\3\0\0", 12) != 0) {
+		&& memcmp(buffer, "SNAPCNT2\n\3\0\0", 12) != 0
+		&& memcmp(buffer, "SNAPCNT3\n\3\0\0", 12) != 0) {
 		/* LCOV_EXCL_START */
 		if (memcmp(buffer, "SNAPCNT", 7) != 0) {
 			decoding_error(path, f);
@@ -1741,6 +1816,9 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 			tommy_hashdyn_insert(&disk->stampset, &file->stampset, file, file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec));
 			tommy_list_insert_tail(&disk->filelist, &file->nodelist, file);
 
+			/* it may be followed by its physical offset */
+			last_file = file;
+
 			/* read all the blocks */
 			v_idx = 0;
 			while (v_idx < file->blockmax) {
@@ -2205,6 +2283,139 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 
 			/* stat */
 			++count_dir;
+		} else if (c == 'o') {
+			/* physical offset of the previous file */
+			uint64_t v_physical;
+
+			ret = sgetb64(f, &v_physical);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (!last_file) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				log_fatal("Internal inconsistency in physical offset without file!\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			last_file->physical = v_physical;
+		} else if (c == 'd') {
+			/* dir stamp */
+			char sub[PATH_MAX];
+			uint64_t v_mtime_sec;
+			uint32_t v_mtime_nsec;
+			uint32_t v_count;
+			struct snapraid_dirstamp* dirstamp;
+			struct snapraid_disk* disk;
+			uint32_t mapping;
+
+			ret = sgetb32(f, &mapping);
+			if (ret < 0 || mapping >= mapping_max) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				log_fatal("Internal inconsistency in mapping index!\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			disk = tommy_array_get(&disk_mapping, mapping);
+
+			/* the disk root has an empty name */
+			ret = sgetbs(f, sub, sizeof(sub));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			ret = sgetb64(f, &v_mtime_sec);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			ret = sgetb32(f, &v_mtime_nsec);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* STAT_NSEC_INVALID is encoded as 0 */
+			if (v_mtime_nsec == 0)
+				v_mtime_nsec = STAT_NSEC_INVALID;
+			else
+				--v_mtime_nsec;
+
+			ret = sgetb32(f, &v_count);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* allocate the dir stamp */
+			dirstamp = dirstamp_alloc(sub, v_mtime_sec, v_mtime_nsec, v_count);
+
+			/* insert the dir stamp in the containers */
+			tommy_hashdyn_insert(&disk->dirstampset, &dirstamp->nodeset, dirstamp, dir_name_hash(dirstamp->sub));
+			tommy_list_insert_tail(&disk->dirstamplist, &dirstamp->nodelist, dirstamp);
+		} else if (c == 'w') {
+			/* watch position */
+			char session[WATCH_SESSION_MAX];
+			uint64_t v_offset;
+			struct snapraid_disk* disk;
+			uint32_t mapping;
+
+			ret = sgetb32(f, &mapping);
+			if (ret < 0 || mapping >= mapping_max) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				log_fatal("Internal inconsistency in mapping index!\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			disk = tommy_array_get(&disk_mapping, mapping);
+
+			ret = sgetbs(f, session, sizeof(session));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			ret = sgetb64(f, &v_offset);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			pathcpy(disk->watch_session, sizeof(disk->watch_session), session);
+			disk->watch_offset = v_offset;
+		} else if (c == 'Q') {
+			uint64_t v_time;
+
+			ret = sgetb64(f, &v_time);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			state->quickscan_last = v_time;
 		} else if (c == 'c') {
 			/* get the subcommand */
 			c = sgetc(f);
@@ -2216,6 +2427,9 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 			case 'k' :
 				state->hash = HASH_SPOOKY2;
 				break;
+			case 'x' :
+				state->hash = HASH_XXH3;
+				break;
 			default :
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
@@ -2243,6 +2457,9 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 			case 'k' :
 				state->prevhash = HASH_SPOOKY2;
 				break;
+			case 'x' :
+				state->prevhash = HASH_XXH3;
+				break;
 			default :
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
@@ -2510,6 +2727,26 @@ struct state_write_thread_context {
 	unsigned count_dir;
 };
 
+/**
+ * Check if all the blocks of the file are without parity.
+ * These are the files reinserted in the parity at the next scan.
+ */
+static int file_is_full_invalid_parity(struct snapraid_file* file)
+{
+	block_off_t i;
+
+	/* with no block, it never has an invalid parity */
+	if (file->blockmax == 0)
+		return 0;
+
+	for (i = 0; i < file->blockmax; ++i) {
+		if (!block_has_invalid_parity(fs_file2block_get(file, i)))
+			return 0;
+	}
+
+	return 1;
+}
+
 static void* state_write_thread(void* arg)
 {
 	struct state_write_thread_context* context = arg;
@@ -2545,7 +2782,7 @@ static void* state_write_thread(void* arg)
 	}
 
 	/* write header */
-	swrite("SNAPCNT2\n\3\0\0", 12, f);
+	swrite("SNAPCNT3\n\3\0\0", 12, f);
 
 	/* write block size and block max */
 	sputc('z', f);
@@ -2564,6 +2801,8 @@ static void* state_write_thread(void* arg)
 		sputc('u', f);
 	} else if (state->hash == HASH_SPOOKY2) {
 		sputc('k', f);
+	} else if (state->hash == HASH_XXH3) {
+		sputc('x', f);
 	} else {
 		/* LCOV_EXCL_START */
 		log_fatal("Unexpected hash when writing the content file '%s'.\n", serrorfile(f));
@@ -2587,6 +2826,8 @@ static void* state_write_thread(void* arg)
 				sputc('u', f);
 			} else if (state->prevhash == HASH_SPOOKY2) {
 				sputc('k', f);
+			} else if (state->prevhash == HASH_XXH3) {
+				sputc('x', f);
 			} else {
 				/* LCOV_EXCL_START */
 				log_fatal("Unexpected prevhash when writing the content file '%s'.\n", serrorfile(f));
@@ -2603,6 +2844,18 @@ static void* state_write_thread(void* arg)
 		}
 	}
 
+	/* time of the last full scan, saved only if the quick scan is enabled */
+	if (state->quickscan != 0) {
+		sputc('Q', f);
+		sputb64(state->quickscan_last, f);
+		if (serror(f)) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
 	/* for each map */
 	for (i = state->maplist; i != 0; i = i->next) {
 		struct snapraid_map* map = i->data;
@@ -2756,6 +3009,21 @@ static void* state_write_thread(void* arg)
 				begin = end;
 			}
 
+			/* save the physical offset, if already read, to avoid to read it again */
+			/* when the file is reinserted in the parity, like after an interrupted first sync */
+			if (file->physical != FILEPHY_UNREAD_OFFSET
+				&& file_is_full_invalid_parity(file)
+			) {
+				sputc('o', f);
+				sputb64(file->physical, f);
+				if (serror(f)) {
+					/* LCOV_EXCL_START */
+					log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
+					goto bail;
+					/* LCOV_EXCL_STOP */
+				}
+			}
+
 			++count_file;
 		}
 
@@ -2802,6 +3070,47 @@ static void* state_write_thread(void* arg)
 			++count_dir;
 		}
 
+		/* for each dir stamp, saved only if the quick scan is enabled */
+		if (state->quickscan != 0) {
+			for (j = disk->dirstamplist; j != 0; j = j->next) {
+				struct snapraid_dirstamp* dirstamp = j->data;
+				int32_t mtime_nsec = dirstamp->mtime_nsec;
+
+				/* encode STAT_NSEC_INVALID as 0 */
+				if (mtime_nsec == STAT_NSEC_INVALID)
+					mtime_nsec = 0;
+				else
+					++mtime_nsec;
+
+				sputc('d', f);
+				sputb32(disk->mapping_idx, f);
+				sputbs(dirstamp->sub, f);
+				sputb64(dirstamp->mtime_sec, f);
+				sputb32(mtime_nsec, f);
+				sputb32(dirstamp->count, f);
+				if (serror(f)) {
+					/* LCOV_EXCL_START */
+					log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
+					goto bail;
+					/* LCOV_EXCL_STOP */
+				}
+			}
+		}
+
+		/* position in the change log of the watch command */
+		if (disk->watch_session[0] != 0) {
+			sputc('w', f);
+			sputb32(disk->mapping_idx, f);
+			sputbs(disk->watch_session, f);
+			sputb64(disk->watch_offset, f);
+			if (serror(f)) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+		}
+
 		/* deleted blocks of the disk */
 		sputc('h', f);
 		sputb32(disk->mapping_idx, f);
@@ -3489,6 +3798,9 @@ static void state_rename_content(struct snapraid_state* state)
 void state_write(struct snapraid_state* state)
 {
 	uint32_t crc;
+	uint64_t start;
+
+	start = tick();
 
 	/* write all the content files */
 	state_write_content(state, &crc);
@@ -3499,8 +3811,14 @@ void state_write(struct snapraid_state* state)
 	/* rename the new files, over the old ones */
 	state_rename_content(state);
 
+	/* write the summary for a fast "status" */
+	state_summary_write(state, crc);
+
 	state->need_write = 0; /* no write needed anymore */
 	state->checked_read = 0; /* what we wrote is not checked in read */
+
+	/* the duration is exported in the Prometheus textfile */
+	state->content_write_ms = (tick() - start) * 1000 / state->tick_freq;
 }
 
 void state_skip(struct snapraid_state* state)
@@ -3537,6 +3855,8 @@ void state_skip(struct snapraid_state* state)
 
 void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tommy_list* filterlist_disk, int filter_missing, int filter_error)
 {
+	struct snapraid_filterset filterset_file;
+	struct snapraid_filterset filterset_disk;
 	tommy_node* i;
 	unsigned l;
 
@@ -3544,6 +3864,9 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 	if (!filter_missing && !filter_error && tommy_list_empty(filterlist_file) && tommy_list_empty(filterlist_disk))
 		return;
 
+	filterset_init(&filterset_file, filterlist_file);
+	filterset_init(&filterset_disk, filterlist_disk);
+
 	msg_progress("Filtering...\n");
 
 	for (i = tommy_list_head(filterlist_disk); i != 0; i = i->next) {
@@ -3572,8 +3895,8 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 		for (j = tommy_list_head(&disk->filelist); j != 0; j = j->next) {
 			struct snapraid_file* file = j->data;
 
-			if (filter_path(filterlist_disk, 0, disk->name, file->sub) != 0
-				|| filter_path(filterlist_file, 0, disk->name, file->sub) != 0
+			if (filter_path(&filterset_disk, 0, disk->name, file->sub) != 0
+				|| filter_path(&filterset_file, 0, disk->name, file->sub) != 0
 				|| filter_existence(filter_missing, disk->dir, file->sub) != 0
 				|| filter_correctness(filter_error, &state->infoarr, disk, file) != 0
 			) {
@@ -3585,8 +3908,8 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 		for (j = tommy_list_head(&disk->linklist); j != 0; j = j->next) {
 			struct snapraid_link* slink = j->data;
 
-			if (filter_path(filterlist_disk, 0, disk->name, slink->sub) != 0
-				|| filter_path(filterlist_file, 0, disk->name, slink->sub) != 0
+			if (filter_path(&filterset_disk, 0, disk->name, slink->sub) != 0
+				|| filter_path(&filterset_file, 0, disk->name, slink->sub) != 0
 				|| filter_existence(filter_missing, disk->dir, slink->sub) != 0
 			) {
 				link_flag_set(slink, FILE_IS_EXCLUDED);
@@ -3597,8 +3920,8 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 		for (j = tommy_list_head(&disk->dirlist); j != 0; j = j->next) {
 			struct snapraid_dir* dir = j->data;
 
-			if (filter_dir(filterlist_disk, 0, disk->name, dir->sub) != 0
-				|| filter_dir(filterlist_file, 0, disk->name, dir->sub) != 0
+			if (filter_dir(&filterset_disk, 0, disk->name, dir->sub) != 0
+				|| filter_dir(&filterset_file, 0, disk->name, dir->sub) != 0
 				|| filter_existence(filter_missing, disk->dir, dir->sub) != 0
 			) {
 				dir_flag_set(dir, FILE_IS_EXCLUDED);
@@ -3611,7 +3934,7 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 		/* for each parity disk */
 		for (l = 0; l < state->level; ++l) {
 			/* check if the parity is excluded by name */
-			if (filter_path(filterlist_disk, 0, lev_config_name(l), 0) != 0) {
+			if (filter_path(&filterset_disk, 0, lev_config_name(l), 0) != 0) {
 				/* excluded the parity from further operation */
 				state->parity[l].is_excluded = 1;
 			}
@@ -3625,6 +3948,132 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 			}
 		}
 	}
+
+	filterset_done(&filterset_file);
+	filterset_done(&filterset_disk);
+}
+
+/**
+ * Copy a name to be used as Prometheus label value, escaping the chars.
+ */
+static void prometheus_label(char* dst, size_t size, const char* name)
+{
+	size_t i = 0;
+
+	while (*name != 0 && i + 2 < size) {
+		char c = *name++;
+		if (c == '\\' || c == '"') {
+			dst[i++] = '\\';
+			dst[i++] = c;
+		} else if (c == '\n') {
+			dst[i++] = '\\';
+			dst[i++] = 'n';
+		} else {
+			dst[i++] = c;
+		}
+	}
+	dst[i] = 0;
+}
+
+/**
+ * Write the Prometheus textfile with the progress of the command.
+ *
+ * The file is written in a temporary one and then renamed, so the
+ * textfile collector never reads a partial file.
+ * On error, only a warning is printed, as the command can continue anyway.
+ *
+ * @eta Estimated remaining time in seconds.
+ * @cpu Cpu usage percentage.
+ * @running If the command is still running.
+ */
+static void state_prometheus(struct snapraid_state* state, block_off_t countpos, block_off_t countmax, data_off_t countsize, unsigned eta, unsigned cpu, int running)
+{
+	char tmp[PATH_MAX];
+	char command[64];
+	char name[PATH_MAX * 2];
+	tommy_node* i;
+	FILE* f;
+
+	if (!*state->prometheus)
+		return;
+
+	pathprint(tmp, sizeof(tmp), "%s.tmp", state->prometheus);
+
+	f = fopen(tmp, "w");
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error creating the Prometheus file '%s'. %s.\n", tmp, strerror(errno));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	prometheus_label(command, sizeof(command), state->command ? state->command : "");
+
+	fprintf(f, "# HELP snapraid_running If the command is running.\n");
+	fprintf(f, "# TYPE snapraid_running gauge\n");
+	fprintf(f, "snapraid_running{command=\"%s\"} %d\n", command, running);
+	fprintf(f, "# HELP snapraid_last_update_timestamp_seconds Time of the last update of this file.\n");
+	fprintf(f, "# TYPE snapraid_last_update_timestamp_seconds gauge\n");
+	fprintf(f, "snapraid_last_update_timestamp_seconds{command=\"%s\"} %" PRIu64 "\n", command, (uint64_t)time(0));
+	fprintf(f, "# HELP snapraid_blocks_processed Number of blocks processed.\n");
+	fprintf(f, "# TYPE snapraid_blocks_processed gauge\n");
+	fprintf(f, "snapraid_blocks_processed{command=\"%s\"} %u\n", command, countpos);
+	fprintf(f, "# HELP snapraid_blocks_total Number of blocks to process.\n");
+	fprintf(f, "# TYPE snapraid_blocks_total gauge\n");
+	fprintf(f, "snapraid_blocks_total{command=\"%s\"} %u\n", command, countmax);
+	fprintf(f, "# HELP snapraid_processed_bytes Bytes of data processed.\n");
+	fprintf(f, "# TYPE snapraid_processed_bytes gauge\n");
+	fprintf(f, "snapraid_processed_bytes{command=\"%s\"} %" PRIu64 "\n", command, (uint64_t)countsize);
+
+	fprintf(f, "# HELP snapraid_disk_read_bytes Bytes read from the data disk.\n");
+	fprintf(f, "# TYPE snapraid_disk_read_bytes counter\n");
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		prometheus_label(name, sizeof(name), disk->name);
+		fprintf(f, "snapraid_disk_read_bytes{command=\"%s\",disk=\"%s\"} %" PRIu64 "\n", command, name, disk->read_bytes);
+	}
+
+	fprintf(f, "# HELP snapraid_errors Number of errors found by class.\n");
+	fprintf(f, "# TYPE snapraid_errors gauge\n");
+	fprintf(f, "snapraid_errors{command=\"%s\",class=\"file\"} %u\n", command, state->progress_error);
+	fprintf(f, "snapraid_errors{command=\"%s\",class=\"io\"} %u\n", command, state->progress_io_error);
+	fprintf(f, "snapraid_errors{command=\"%s\",class=\"data\"} %u\n", command, state->progress_silent_error);
+	fprintf(f, "# HELP snapraid_eta_seconds Estimated time to completion.\n");
+	fprintf(f, "# TYPE snapraid_eta_seconds gauge\n");
+	fprintf(f, "snapraid_eta_seconds{command=\"%s\"} %u\n", command, eta);
+	fprintf(f, "# HELP snapraid_cpu_ratio Fraction of the time used for computations instead of waiting the disks.\n");
+	fprintf(f, "# TYPE snapraid_cpu_ratio gauge\n");
+	fprintf(f, "snapraid_cpu_ratio{command=\"%s\"} %u.%02u\n", command, cpu / 100, cpu % 100);
+	fprintf(f, "# HELP snapraid_content_write_seconds Duration of the last write of the content files, like an autosave.\n");
+	fprintf(f, "# TYPE snapraid_content_write_seconds gauge\n");
+	fprintf(f, "snapraid_content_write_seconds{command=\"%s\"} %" PRIu64 ".%03u\n", command, state->content_write_ms / 1000, (unsigned)(state->content_write_ms % 1000));
+
+	/* Use the sequence fflush() -> fclose() -> rename() to ensure */
+	/* that the collector sees the old or the new file, never a partial one */
+	if (fflush(f) != 0 || ferror(f)) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error writing the Prometheus file '%s'. %s.\n", tmp, strerror(errno));
+		fclose(f);
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (fclose(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error closing the Prometheus file '%s'. %s.\n", tmp, strerror(errno));
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (rename(tmp, state->prometheus) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error renaming the Prometheus file '%s' to '%s'. %s.\n", tmp, state->prometheus, strerror(errno));
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
 }
 
 int state_progress_begin(struct snapraid_state* state, block_off_t blockstart, block_off_t blockmax, block_off_t countmax)
@@ -3639,11 +4088,19 @@ int state_progress_begin(struct snapraid_state* state, block_off_t blockstart, b
 	now = time(0);
 
 	state->progress_whole_start = now;
+	state->usage_last = now;
+	state->prometheus_last = now;
 
 	state->progress_tick = 0;
 	state->progress_ptr = 0;
 	state->progress_wasted = 0;
 
+	state->progress_error = 0;
+	state->progress_io_error = 0;
+	state->progress_silent_error = 0;
+
+	state_prometheus(state, 0, countmax, 0, 0, 0, 1);
+
 	/* stop if requested */
 	if (global_interrupt) {
 		/* LCOV_EXCL_START */
@@ -3661,6 +4118,8 @@ int state_progress_begin(struct snapraid_state* state, block_off_t blockstart, b
 
 void state_progress_end(struct snapraid_state* state, block_off_t countpos, block_off_t countmax, data_off_t countsize)
 {
+	state_prometheus(state, countpos, countmax, countsize, 0, 0, 0);
+
 	if (state->opt.gui) {
 		log_tag("run:end\n");
 		log_flush();
@@ -3826,6 +4285,18 @@ int state_progress(struct snapraid_state* state, block_off_t blockpos, block_off
 
 		/* one more measure */
 		++state->progress_tick;
+
+		/* periodically save the usage stats in the log */
+		if (now - state->usage_last >= USAGE_LOG_PERIOD) {
+			state_usage_log(state, 0);
+			state->usage_last = now;
+		}
+
+		/* periodically update the Prometheus textfile */
+		if (now - state->prometheus_last >= PROMETHEUS_PERIOD) {
+			state_prometheus(state, countpos, countmax, countsize, out_eta * 60, out_cpu, 1);
+			state->prometheus_last = now;
+		}
 	}
 
 	/* stop if requested */
@@ -3844,6 +4315,109 @@ int state_progress(struct snapraid_state* state, block_off_t blockpos, block_off
 	return 0;
 }
 
+/**
+ * Copy a name to be used as JSON string, replacing the chars to escape.
+ */
+static void usage_name(char* dst, size_t size, const char* name)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < size && name[i] != 0; ++i) {
+		unsigned char c = name[i];
+		if (c < 32 || c == '"' || c == '\\')
+			c = '_';
+		dst[i] = c;
+	}
+	dst[i] = 0;
+}
+
+/**
+ * Get the upper limit of the latency percentile in microseconds.
+ */
+static uint64_t usage_percentile(struct snapraid_latency* latency, unsigned perc)
+{
+	uint64_t limit;
+	uint64_t sum;
+	unsigned i;
+
+	if (latency->count == 0)
+		return 0;
+
+	limit = (latency->count * perc + 99) / 100;
+
+	sum = 0;
+	for (i = 0; i < LATENCY_MAX; ++i) {
+		sum += latency->bucket[i];
+		if (sum != 0 && sum >= limit) {
+			uint64_t upper = (2ULL << i) - 1;
+			return upper < latency->max ? upper : latency->max;
+		}
+	}
+
+	return latency->max;
+}
+
+static void usage_log_latency(struct snapraid_state* state, int final, const char* kind, const char* name, uint64_t tick, struct snapraid_latency* latency)
+{
+	char esc_name[PATH_MAX];
+	char hist[LATENCY_MAX * 24];
+	size_t len;
+	int last;
+	int i;
+
+	usage_name(esc_name, sizeof(esc_name), name);
+
+	/* the histogram up to the last not empty bucket */
+	last = LATENCY_MAX - 1;
+	while (last > 0 && latency->bucket[last] == 0)
+		--last;
+
+	len = 0;
+	hist[0] = 0;
+	for (i = 0; i <= last; ++i)
+		len += snprintf(hist + len, sizeof(hist) - len, "%s%" PRIu64, i != 0 ? "," : "", latency->bucket[i]);
+
+	log_tag("usage:{\"final\":%d,\"kind\":\"%s\",\"name\":\"%s\",\"busy_ms\":%" PRIu64 ",\"count\":%" PRIu64 ",\"mean_us\":%" PRIu64 ",\"p50_us\":%" PRIu64 ",\"p90_us\":%" PRIu64 ",\"p99_us\":%" PRIu64 ",\"max_us\":%" PRIu64 ",\"hist_us\":[%s]}\n",
+		final, kind, esc_name,
+		tick * 1000 / state->tick_freq,
+		latency->count,
+		latency->count != 0 ? latency->total / latency->count : 0,
+		usage_percentile(latency, 50),
+		usage_percentile(latency, 90),
+		usage_percentile(latency, 99),
+		latency->max,
+		hist);
+}
+
+void state_usage_log(struct snapraid_state* state, int final)
+{
+	tommy_node* i;
+	unsigned l;
+
+	/* nothing to do without a log */
+	if (!stdlog)
+		return;
+
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		usage_log_latency(state, final, "disk", disk->name, disk->tick, &disk->latency);
+	}
+
+	for (l = 0; l < state->level; ++l) {
+		struct snapraid_parity* parity = &state->parity[l];
+		usage_log_latency(state, final, "parity", lev_config_name(l), parity->tick - parity->write_tick, &parity->latency);
+		usage_log_latency(state, final, "parity_write", lev_config_name(l), parity->write_tick, &parity->write_latency);
+	}
+
+	log_tag("usage:{\"final\":%d,\"kind\":\"stage\",\"hash_ms\":%" PRIu64 ",\"raid_ms\":%" PRIu64 ",\"cpu_ms\":%" PRIu64 ",\"io_ms\":%" PRIu64 "}\n",
+		final,
+		state->tick_hash * 1000 / state->tick_freq,
+		state->tick_raid * 1000 / state->tick_freq,
+		state->tick_cpu * 1000 / state->tick_freq,
+		state->tick_io * 1000 / state->tick_freq);
+	log_flush();
+}
+
 void state_usage_print(struct snapraid_state* state)
 {
 	uint64_t tick_total;
@@ -3851,6 +4425,8 @@ void state_usage_print(struct snapraid_state* state)
 	tommy_node* i;
 	unsigned l;
 
+	state_usage_log(state, 1);
+
 	tick_max = 0;
 	tick_total = 0;
 	for (i = state->disklist; i != 0; i = i->next) {
@@ -19,6 +19,7 @@
 #define __STATE_H
 
 #include "elem.h"
+#include "fetch.h"
 
 /****************************************************************************/
 /* parity level */
@@ -73,7 +74,14 @@ struct snapraid_option {
 	int badonly; /**< In fix, fixes only the blocks marked as bad. */
 	int syncedonly; /**< In fix, fixes only files that are synced. */
 	int prehash; /**< Enables the prehash mode for sync. */
+	int copy_content; /**< Enables the copy detection by content in the scan. */
 	unsigned io_error_limit; /**< Max number of input/output errors before aborting. */
+	unsigned limit_speed; /**< Max read speed of scrub in MB/s. 0 for no limit. */
+	unsigned limit_disk_speed; /**< Max read speed of scrub for each disk in MB/s. 0 for no limit. */
+	unsigned limit_iops; /**< Max read operations for second of scrub. 0 for no limit. */
+	unsigned limit_disk_iops; /**< Max read operations for second of scrub for each disk. 0 for no limit. */
+	unsigned limit_latency; /**< Read latency in milliseconds of a disk, over which scrub slows down. 0 for no limit. */
+	unsigned time_limit; /**< Max time of scrub in minutes. 0 for no limit. */
 	int force_zero; /**< Forced dangerous operations of synching files now with zero size. */
 	int force_empty; /**< Forced dangerous operations of synching disks now empty. */
 	int force_uuid; /**< Forced dangerous operations of synching disks with uuid changed. */
@@ -87,6 +95,7 @@ struct snapraid_option {
 	int skip_fallocate; /**< Skip the use of fallocate(). */
 	int skip_sequential; /**< Skip sequential hint. */
 	int skip_lock; /**< Skip the lock file protection. */
+	int skip_watch_lock; /**< Trust the change log of the watcher even if not locked. */
 	int skip_self; /**< Skip the self-test. */
 	int skip_content_check; /**< Relax some content file checks. */
 	int skip_parity_access; /**< Skip the parity access for commands that don't need it. */
@@ -95,9 +104,11 @@ struct snapraid_option {
 	int kill_after_sync; /**< Kill the process after sync without saving the final state. */
 	int force_murmur3; /**< Force Murmur3 choice. */
 	int force_spooky2; /**< Force Spooky2 choice. */
+	int force_xxh3; /**< Force XXH3 choice. */
 	int force_order; /**< Force sorting order. One of the SORT_* defines. */
 	unsigned force_scrub_at; /**< Force scrub for the specified number of blocks. */
 	int force_scrub_even; /**< Force scrub of all the even blocks. */
+	unsigned force_time_limit_at; /**< Force the scrub time limit after the specified number of blocks. */
 	int force_content_write; /**< Force the update of the content file. */
 	int force_scan_winfind; /**< Force the use of FindFirst/Next in Windows to list directories. */
 	int force_progress; /**< Force the use of the progress status. */
@@ -115,6 +126,8 @@ struct snapraid_state {
 	struct snapraid_option opt; /**< Setup options. */
 	int filter_hidden; /**< Filter out hidden files. */
 	uint64_t autosave; /**< Autosave after the specified amount of data. 0 to disable. */
+	unsigned quickscan; /**< Max days between full scans, using the quick scan in between. 0 to disable. */
+	int64_t quickscan_last; /**< Time of the last full scan. 0 if never done. */
 	int need_write; /**< If the state is changed. */
 	int checked_read; /**< If the state was read and checked. */
 	uint32_t block_size; /**< Block size in bytes. */
@@ -127,6 +140,7 @@ struct snapraid_state {
 	unsigned char hashseed[HASH_SIZE]; /**< Hash seed. Just after a uint64 to provide a minimal alignment. */
 	unsigned char prevhashseed[HASH_SIZE]; /**< Previous hash seed. In case of rehash. */
 	char lockfile[PATH_MAX]; /**< Path of the lock file to use. */
+	char prometheus[PATH_MAX]; /**< Path of the Prometheus textfile to write. Empty to disable. */
 	unsigned level; /**< Number of parity levels. 1 for PAR1, 2 for PAR2. */
 	unsigned hash; /**< Hash kind used. */
 	unsigned prevhash; /**< Previous hash kind used.  In case of rehash. */
@@ -136,10 +150,12 @@ struct snapraid_state {
 	tommy_list disklist; /**< List of all the disks. */
 	tommy_list maplist; /**< List of all the disk mappings. */
 	tommy_list filterlist; /**< List of inclusion/exclusion. */
+	struct snapraid_filterset filterset; /**< Compiled list of inclusion/exclusion. */
 	tommy_list importlist; /**< List of import file. */
 	tommy_hashdyn importset; /**< Hashtable by hash of all the import blocks. */
 	tommy_hashdyn previmportset; /**< Hashtable by prevhash of all the import blocks. Valid only if we are in a rehash state. */
 	tommy_hashdyn searchset; /**< Hashtable by timestamp of all the search files. */
+	struct snapraid_fetch fetch; /**< Files kept open to fetch the import and search blocks. */
 	tommy_arrayblkof infoarr; /**< Block information array. */
 
 	/**
@@ -147,6 +163,16 @@ struct snapraid_state {
 	 */
 	uint64_t tick_cpu;
 
+	/**
+	 * Cumulative time used for the hash, part of the computations.
+	 */
+	uint64_t tick_hash;
+
+	/**
+	 * Cumulative time used for the parity, part of the computations.
+	 */
+	uint64_t tick_raid;
+
 	/**
 	 * Cumulative time used for all io operations of disks.
 	 */
@@ -157,6 +183,11 @@ struct snapraid_state {
 	 */
 	uint64_t tick_last;
 
+	uint64_t tick_freq; /**< Frequency of the ticks. */
+	time_t usage_last; /**< Time of the last usage stats in the log. */
+	time_t prometheus_last; /**< Time of the last write of the Prometheus textfile. */
+	uint64_t content_write_ms; /**< Duration of the last write of the content files, like an autosave. */
+
 	int clear_past_hash; /**< Clear all the hash from CHG and DELETED blocks when reading the state from an incomplete sync. */
 
 	time_t progress_whole_start; /**< Initial start of the whole process. */
@@ -172,6 +203,10 @@ struct snapraid_state {
 	int progress_ptr; /**< Pointer to the next position to fill. Rolling over. */
 	int progress_tick; /**< Number of measures done. */
 
+	unsigned progress_error; /**< Number of file errors found until now. Used only for reporting. */
+	unsigned progress_io_error; /**< Number of input/output errors found until now. Used only for reporting. */
+	unsigned progress_silent_error; /**< Number of data errors found until now. Used only for reporting. */
+
 	int no_conf; /**< Automatically add missing info. Used to load content without a configuration file. */
 };
 
@@ -259,6 +294,17 @@ int state_scrub(struct snapraid_state* state, int percentage, int olderthan);
  */
 int state_status(struct snapraid_state* state);
 
+/**
+ * Print the status using the summary file of the content file, without reading it.
+ * Return -1 if the summary file is missing, or it doesn't match the content file.
+ */
+int state_status_summary(struct snapraid_state* state);
+
+/**
+ * Write the summary file used by "status", next to each content file.
+ */
+void state_summary_write(struct snapraid_state* state, uint32_t crc);
+
 /**
  * Find duplicates.
  */
@@ -274,6 +320,11 @@ void state_list(struct snapraid_state* state);
  */
 void state_pool(struct snapraid_state* state);
 
+/**
+ * Watch the disks for changes.
+ */
+void state_watch(struct snapraid_state* state);
+
 /**
  * Refresh the free space info.
  *
@@ -342,6 +393,36 @@ static inline void state_usage_cpu(struct snapraid_state* state)
 	state->tick_last = now;
 }
 
+/**
+ * Set the usage time for CPU computing the hash.
+ */
+static inline void state_usage_hash(struct snapraid_state* state)
+{
+	uint64_t now = tick();
+	uint64_t delta = now - state->tick_last;
+
+	/* increment the time spent in computations */
+	state->tick_hash += delta;
+	state->tick_cpu += delta;
+
+	state->tick_last = now;
+}
+
+/**
+ * Set the usage time for CPU computing the parity.
+ */
+static inline void state_usage_raid(struct snapraid_state* state)
+{
+	uint64_t now = tick();
+	uint64_t delta = now - state->tick_last;
+
+	/* increment the time spent in computations */
+	state->tick_raid += delta;
+	state->tick_cpu += delta;
+
+	state->tick_last = now;
+}
+
 /**
  * Set the usage time for data disk.
  */
@@ -353,6 +434,7 @@ static inline void state_usage_disk(struct snapraid_state* state, struct snaprai
 	/* increment the time spent in the data disk */
 	disk->tick += delta;
 	state->tick_io += delta;
+	latency_add(&disk->latency, delta * 1000000 / state->tick_freq);
 
 	state->tick_last = now;
 }
@@ -370,15 +452,59 @@ static inline void state_usage_parity(struct snapraid_state* state, unsigned lev
 	/* increment the time spent in the parity disk */
 	state->parity[level].tick += delta;
 	state->tick_io += delta;
+	latency_add(&state->parity[level].latency, delta * 1000000 / state->tick_freq);
+
+	state->tick_last = now;
+}
+
+/**
+ * Set the usage time for parity disk write.
+ */
+static inline void state_usage_parity_write(struct snapraid_state* state, unsigned level)
+{
+	uint64_t now = tick();
+	uint64_t delta = now - state->tick_last;
+
+	assert(level < LEV_MAX);
+
+	/* increment the time spent in the parity disk */
+	state->parity[level].tick += delta;
+	state->parity[level].write_tick += delta;
+	state->tick_io += delta;
+	latency_add(&state->parity[level].write_latency, delta * 1000000 / state->tick_freq);
 
 	state->tick_last = now;
 }
 
 /**
  * Print the stats of the usage time.
+ *
+ * The stats are also saved in the log, like state_usage_log().
  */
 void state_usage_print(struct snapraid_state* state);
 
+/**
+ * Period in seconds to save the usage stats in the log while processing.
+ */
+#define USAGE_LOG_PERIOD 60
+
+/**
+ * Save in the log the stats of the usage time, as JSON lines.
+ *
+ * There is a line for each data disk, two for each parity disk, one
+ * for reads and one for writes, with the latency histogram of the
+ * operations, and a line with the time used for the hash, the parity
+ * and the disks.
+ *
+ * @final If it's the last one of the command.
+ */
+void state_usage_log(struct snapraid_state* state, int final);
+
+/**
+ * Period in seconds to write the Prometheus textfile while processing.
+ */
+#define PROMETHEUS_PERIOD 10
+
 /**
  * Check the filesystem on all disks.
  * On error it aborts.
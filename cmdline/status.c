@@ -22,6 +22,7 @@
 #include "state.h"
 #include "parity.h"
 #include "handle.h"
+#include "stream.h"
 #include "raid/raid.h"
 
 /****************************************************************************/
@@ -43,87 +44,102 @@ static unsigned perc(uint64_t part, uint64_t total)
 	return (unsigned)(part * 100 / total);
 }
 
-int state_status(struct snapraid_state* state)
-{
-	block_off_t blockmax;
-	block_off_t i;
-	time_t* timemap;
-	time_t now;
-	block_off_t bad;
-	block_off_t bad_first;
-	block_off_t bad_last;
-	block_off_t rehash;
-	block_off_t count;
-	unsigned l;
-	unsigned dayoldest, daymedian, daynewest;
-	unsigned bar[GRAPH_COLUMN];
-	unsigned barpos;
-	unsigned barmax;
-	time_t oldest, newest, median;
-	unsigned x, y;
-	tommy_node* node_disk;
-	unsigned file_count;
-	unsigned file_fragmented;
-	unsigned extra_fragment;
-	uint64_t file_size;
-	uint64_t file_block_count;
-	uint64_t file_block_free;
-	block_off_t parity_block_free;
-	unsigned unsynced_blocks;
-	unsigned unscrubbed_blocks;
-	uint64_t all_wasted;
-	int free_not_zero;
-
-	/* get the present time */
-	now = time(0);
+/**
+ * Max number of bad blocks listed.
+ */
+#define SUMMARY_BAD_MAX 101
 
-	/* keep track if at least a free info is available */
-	free_not_zero = 0;
+/**
+ * Status summary of a disk.
+ */
+struct snapraid_summary_disk {
+	char name[PATH_MAX]; /**< Name of the disk. */
+	unsigned file_count; /**< Number of files. */
+	unsigned file_fragmented; /**< Number of fragmented files. */
+	unsigned extra_fragment; /**< Number of excess fragments. */
+	uint64_t file_size; /**< Size of the files. */
+	block_off_t block_count; /**< Number of blocks used by files. */
+	block_off_t block_latest_used; /**< Latest parity position used. */
+	block_off_t total_blocks; /**< Total blocks of the disk. */
+	block_off_t free_blocks; /**< Free blocks of the disk. */
+};
+
+/**
+ * Status summary of the array.
+ *
+ * It contains all the information printed by "status", computed from the
+ * whole state, and saved in the summary file next to each content file.
+ */
+struct snapraid_summary {
+	unsigned block_size; /**< Block size. */
+	block_off_t blockmax; /**< Parity allocated size. */
+	unsigned hash; /**< Hash kind used. */
+	unsigned prevhash; /**< Previous hash kind used. */
+	unsigned level; /**< Number of parities. */
+	block_off_t parity_total_blocks[LEV_MAX]; /**< Total blocks of each parity. */
+	block_off_t parity_free_blocks[LEV_MAX]; /**< Free blocks of each parity. */
+	unsigned disk_max; /**< Number of disks. */
+	struct snapraid_summary_disk* disk; /**< Vector of disks. */
+	block_off_t unsynced_blocks; /**< Blocks with a sync in progress. */
+	block_off_t unscrubbed_blocks; /**< Blocks never scrubbed after the sync. */
+	block_off_t rehash; /**< Blocks with a rehash in progress. */
+	block_off_t bad; /**< Number of bad blocks. */
+	block_off_t bad_first; /**< First bad block. */
+	block_off_t bad_last; /**< Last bad block. */
+	unsigned bad_max; /**< Number of bad blocks listed. */
+	block_off_t bad_list[SUMMARY_BAD_MAX]; /**< First bad blocks. */
+	struct snapraid_timemap timemap; /**< Histogram of the block times. */
+};
+
+static void summary_init(struct snapraid_summary* summary)
+{
+	memset(summary, 0, sizeof(struct snapraid_summary));
+	timemap_init(&summary->timemap);
+}
 
-	blockmax = parity_allocated_size(state);
+static void summary_done(struct snapraid_summary* summary)
+{
+	free(summary->disk);
+	timemap_done(&summary->timemap);
+}
 
-	log_tag("summary:block_size:%u\n", state->block_size);
-	log_tag("summary:parity_block_count:%u\n", blockmax);
+/**
+ * Compute the summary of the files of each disk.
+ */
+static void summary_disk(struct snapraid_state* state, struct snapraid_summary* summary)
+{
+	tommy_node* node_disk;
+	unsigned l;
+	unsigned n;
 
-	/* get the minimum parity free space */
-	parity_block_free = state->parity[0].free_blocks;
+	summary->block_size = state->block_size;
+	summary->blockmax = parity_allocated_size(state);
+	summary->hash = state->hash;
+	summary->prevhash = state->prevhash;
+	summary->level = state->level;
 	for (l = 0; l < state->level; ++l) {
-		log_tag("summary:parity_block_total:%s:%u\n", lev_config_name(l), state->parity[l].total_blocks);
-		log_tag("summary:parity_block_free:%s:%u\n", lev_config_name(l), state->parity[l].free_blocks);
-		if (state->parity[l].free_blocks < parity_block_free)
-			parity_block_free = state->parity[l].free_blocks;
-		if (state->parity[l].free_blocks != 0)
-			free_not_zero = 1;
+		summary->parity_total_blocks[l] = state->parity[l].total_blocks;
+		summary->parity_free_blocks[l] = state->parity[l].free_blocks;
 	}
-	log_tag("summary:parity_block_free_min:%u\n", parity_block_free);
 
-	printf("SnapRAID status report:\n");
-	printf("\n");
-	printf("   Files Fragmented Excess  Wasted  Used    Free  Use Name\n");
-	printf("            Files  Fragments  GB      GB      GB\n");
+	summary->disk_max = tommy_list_count(&state->disklist);
+	summary->disk = malloc_nofail(summary->disk_max * sizeof(struct snapraid_summary_disk));
 
-	/* count fragments */
-	file_count = 0;
-	file_size = 0;
-	file_block_count = 0;
-	file_block_free = 0;
-	file_fragmented = 0;
-	extra_fragment = 0;
-	all_wasted = 0;
-	for (node_disk = state->disklist; node_disk != 0; node_disk = node_disk->next) {
+	for (n = 0, node_disk = state->disklist; node_disk != 0; ++n, node_disk = node_disk->next) {
 		struct snapraid_disk* disk = node_disk->data;
+		struct snapraid_summary_disk* sum = &summary->disk[n];
 		tommy_node* node;
 		block_off_t j;
-		unsigned disk_file_count = 0;
-		unsigned disk_file_fragmented = 0;
-		unsigned disk_extra_fragment = 0;
-		block_off_t disk_block_count = 0;
-		uint64_t disk_file_size = 0;
-		block_off_t disk_block_latest_used = 0;
-		block_off_t disk_block_max_by_space;
-		block_off_t disk_block_max_by_parity;
-		block_off_t disk_block_max;
-		int64_t wasted;
+
+		pathcpy(sum->name, sizeof(sum->name), disk->name);
+		sum->file_count = 0;
+		sum->file_fragmented = 0;
+		sum->extra_fragment = 0;
+		sum->file_size = 0;
+		sum->block_count = 0;
+		sum->block_latest_used = 0;
+		sum->total_blocks = disk->total_blocks;
+		sum->free_blocks = disk->free_blocks;
 
 		/* for each file in the disk */
 		node = disk->filelist;
@@ -145,39 +161,163 @@ int state_status(struct snapraid_state* state)
 					block_off_t parity_pos = fs_file2par_get(disk, file, j);
 					if (prev_pos + 1 != parity_pos) {
 						fragmented = 1;
-						++extra_fragment;
-						++disk_extra_fragment;
+						++sum->extra_fragment;
 					}
 					prev_pos = parity_pos;
 				}
 
 				/* keep track of latest block used */
 				last_pos = fs_file2par_get(disk, file, file->blockmax - 1);
-				if (last_pos > disk_block_latest_used) {
-					disk_block_latest_used = last_pos;
+				if (last_pos > sum->block_latest_used) {
+					sum->block_latest_used = last_pos;
 				}
 
-				if (fragmented) {
-					++file_fragmented;
-					++disk_file_fragmented;
-				}
+				if (fragmented)
+					++sum->file_fragmented;
 
-				disk_block_count += file->blockmax;
+				sum->block_count += file->blockmax;
 			}
 
 			/* count files */
-			++file_count;
-			++disk_file_count;
-			file_size += file->size;
-			file_block_count += file->blockmax;
-			disk_file_size += file->size;
+			++sum->file_count;
+			sum->file_size += file->size;
+		}
+	}
+}
+
+/**
+ * Compute the summary of the parity blocks.
+ */
+static void summary_block(struct snapraid_state* state, struct snapraid_summary* summary)
+{
+	block_off_t blockmax = summary->blockmax;
+	block_off_t i;
+
+	for (i = 0; i < blockmax; ++i) {
+		tommy_node* node_disk;
+		int one_invalid;
+		int one_valid;
+
+		snapraid_info info = info_get(&state->infoarr, i);
+
+		/* for each disk */
+		one_invalid = 0;
+		one_valid = 0;
+		for (node_disk = state->disklist; node_disk != 0; node_disk = node_disk->next) {
+			struct snapraid_disk* disk = node_disk->data;
+			struct snapraid_block* block = fs_par2block_get(disk, i);
+
+			if (block_has_file(block))
+				one_valid = 1;
+			if (block_has_invalid_parity(block))
+				one_invalid = 1;
+		}
+
+		/* if both valid and invalid, we need to update */
+		if (one_invalid && one_valid) {
+			++summary->unsynced_blocks;
+		}
+
+		/* skip unused blocks */
+		if (info != 0) {
+			if (info_get_bad(info)) {
+				if (summary->bad == 0)
+					summary->bad_first = i;
+				summary->bad_last = i;
+				++summary->bad;
+				if (summary->bad_max < SUMMARY_BAD_MAX)
+					summary->bad_list[summary->bad_max++] = i;
+			}
+
+			if (info_get_rehash(info))
+				++summary->rehash;
+
+			if (info_get_justsynced(info))
+				++summary->unscrubbed_blocks;
+
+			timemap_insert(&summary->timemap, info_get_time(info), 1);
 		}
 
+		if (state->opt.gui) {
+			if (info != 0)
+				log_tag("block:%u:%" PRIu64 ":%s:%s:%s:%s\n", i, (uint64_t)info_get_time(info), one_valid ? "used" : "", one_invalid ? "unsynced" : "", info_get_bad(info) ? "bad" : "", info_get_rehash(info) ? "rehash" : "");
+			else
+				log_tag("block_noinfo:%u:%s:%s\n", i, one_valid ? "used" : "", one_invalid ? "unsynced" : "");
+		}
+	}
+
+	timemap_sort(&summary->timemap);
+}
+
+/**
+ * Print the status of the disks.
+ */
+static void status_disk(struct snapraid_state* state, struct snapraid_summary* summary)
+{
+	block_off_t blockmax;
+	unsigned l;
+	unsigned n;
+	unsigned file_count;
+	unsigned file_fragmented;
+	unsigned extra_fragment;
+	uint64_t file_size;
+	uint64_t file_block_count;
+	uint64_t file_block_free;
+	block_off_t parity_block_free;
+	uint64_t all_wasted;
+	int free_not_zero;
+
+	/* keep track if at least a free info is available */
+	free_not_zero = 0;
+
+	blockmax = summary->blockmax;
+
+	log_tag("summary:block_size:%u\n", summary->block_size);
+	log_tag("summary:parity_block_count:%u\n", blockmax);
+
+	/* get the minimum parity free space */
+	parity_block_free = summary->parity_free_blocks[0];
+	for (l = 0; l < summary->level; ++l) {
+		log_tag("summary:parity_block_total:%s:%u\n", lev_config_name(l), summary->parity_total_blocks[l]);
+		log_tag("summary:parity_block_free:%s:%u\n", lev_config_name(l), summary->parity_free_blocks[l]);
+		if (summary->parity_free_blocks[l] < parity_block_free)
+			parity_block_free = summary->parity_free_blocks[l];
+		if (summary->parity_free_blocks[l] != 0)
+			free_not_zero = 1;
+	}
+	log_tag("summary:parity_block_free_min:%u\n", parity_block_free);
+
+	printf("SnapRAID status report:\n");
+	printf("\n");
+	printf("   Files Fragmented Excess  Wasted  Used    Free  Use Name\n");
+	printf("            Files  Fragments  GB      GB      GB\n");
+
+	/* count fragments */
+	file_count = 0;
+	file_size = 0;
+	file_block_count = 0;
+	file_block_free = 0;
+	file_fragmented = 0;
+	extra_fragment = 0;
+	all_wasted = 0;
+	for (n = 0; n < summary->disk_max; ++n) {
+		struct snapraid_summary_disk* disk = &summary->disk[n];
+		block_off_t disk_block_max_by_space;
+		block_off_t disk_block_max_by_parity;
+		block_off_t disk_block_max;
+		int64_t wasted;
+
+		file_count += disk->file_count;
+		file_fragmented += disk->file_fragmented;
+		extra_fragment += disk->extra_fragment;
+		file_size += disk->file_size;
+		file_block_count += disk->block_count;
+
 		if (disk->free_blocks != 0)
 			free_not_zero = 1;
 
 		/* get the free block info */
-		disk_block_max_by_space = disk_block_count + disk->free_blocks;
+		disk_block_max_by_space = disk->block_count + disk->free_blocks;
 		disk_block_max_by_parity = blockmax + parity_block_free;
 
 		/* the maximum usable space in a disk is limited by the smallest */
@@ -193,38 +333,38 @@ int state_status(struct snapraid_state* state)
 		/* wasted space is the difference of the two maximum size */
 		/* if negative, it's extra space available in parity */
 		wasted = (int64_t)disk_block_max_by_space - (int64_t)disk_block_max_by_parity;
-		wasted *= state->block_size;
+		wasted *= summary->block_size;
 
 		if (wasted > 0)
 			all_wasted += wasted;
-		file_block_free += disk_block_max - disk_block_count;
+		file_block_free += disk_block_max - disk->block_count;
 
-		printf("%8u", disk_file_count);
-		printf("%8u", disk_file_fragmented);
-		printf("%8u", disk_extra_fragment);
+		printf("%8u", disk->file_count);
+		printf("%8u", disk->file_fragmented);
+		printf("%8u", disk->extra_fragment);
 		if (wasted < -100LL * GIGA) {
 			printf("       -");
 		} else {
 			printf("%8.1f", (double)wasted / GIGA);
 		}
-		printf("%8" PRIu64, disk_file_size / GIGA);
+		printf("%8" PRIu64, disk->file_size / GIGA);
 
-		if (disk_block_max == 0 && disk_block_count == 0) {
+		if (disk_block_max == 0 && disk->block_count == 0) {
 			/* if the disk is empty and we don't have the free space info */
 			printf("       -");
 			printf("   - ");
 		} else {
-			printf("%8" PRIu64, (disk_block_max - disk_block_count) * (uint64_t)state->block_size / GIGA);
-			printf(" %3u%%", perc(disk_block_count, disk_block_max));
+			printf("%8" PRIu64, (disk_block_max - disk->block_count) * (uint64_t)summary->block_size / GIGA);
+			printf(" %3u%%", perc(disk->block_count, disk_block_max));
 		}
 		printf(" %s\n", disk->name);
 
-		log_tag("summary:disk_file_count:%s:%u\n", disk->name, disk_file_count);
-		log_tag("summary:disk_block_count:%s:%u\n", disk->name, disk_block_count);
-		log_tag("summary:disk_fragmented_file_count:%s:%u\n", disk->name, disk_file_fragmented);
-		log_tag("summary:disk_excess_fragment_count:%s:%u\n", disk->name, disk_extra_fragment);
-		log_tag("summary:disk_file_size:%s:%" PRIu64 "\n", disk->name, disk_file_size);
-		log_tag("summary:disk_block_allocated:%s:%u\n", disk->name, disk_block_latest_used + 1);
+		log_tag("summary:disk_file_count:%s:%u\n", disk->name, disk->file_count);
+		log_tag("summary:disk_block_count:%s:%u\n", disk->name, disk->block_count);
+		log_tag("summary:disk_fragmented_file_count:%s:%u\n", disk->name, disk->file_fragmented);
+		log_tag("summary:disk_excess_fragment_count:%s:%u\n", disk->name, disk->extra_fragment);
+		log_tag("summary:disk_file_size:%s:%" PRIu64 "\n", disk->name, disk->file_size);
+		log_tag("summary:disk_block_allocated:%s:%u\n", disk->name, disk->block_latest_used + 1);
 		log_tag("summary:disk_block_total:%s:%u\n", disk->name, disk->total_blocks);
 		log_tag("summary:disk_block_free:%s:%u\n", disk->name, disk->free_blocks);
 		log_tag("summary:disk_block_max_by_space:%s:%u\n", disk->name, disk_block_max_by_space);
@@ -240,7 +380,7 @@ int state_status(struct snapraid_state* state)
 	printf("%8u", extra_fragment);
 	printf("%8.1f", (double)all_wasted / GIGA);
 	printf("%8" PRIu64, file_size / GIGA);
-	printf("%8" PRIu64, file_block_free * state->block_size / GIGA);
+	printf("%8" PRIu64, file_block_free * summary->block_size / GIGA);
 	printf(" %3u%%", perc(file_block_count, file_block_count + file_block_free));
 	printf("\n");
 
@@ -253,102 +393,56 @@ int state_status(struct snapraid_state* state)
 	log_tag("summary:fragmented_file_count:%u\n", file_fragmented);
 	log_tag("summary:excess_fragment_count:%u\n", extra_fragment);
 	log_tag("summary:file_size:%" PRIu64 "\n", file_size);
-	log_tag("summary:parity_size:%" PRIu64 "\n", blockmax * (uint64_t)state->block_size);
-	log_tag("summary:parity_size_max:%" PRIu64 "\n", (blockmax + parity_block_free) * (uint64_t)state->block_size);
-	log_tag("summary:hash:%s\n", hash_config_name(state->hash));
-	log_tag("summary:prev_hash:%s\n", hash_config_name(state->prevhash));
+	log_tag("summary:parity_size:%" PRIu64 "\n", blockmax * (uint64_t)summary->block_size);
+	log_tag("summary:parity_size_max:%" PRIu64 "\n", (blockmax + parity_block_free) * (uint64_t)summary->block_size);
+	log_tag("summary:hash:%s\n", hash_config_name(summary->hash));
+	log_tag("summary:prev_hash:%s\n", hash_config_name(summary->prevhash));
 	log_tag("summary:best_hash:%s\n", hash_config_name(state->besthash));
 	log_flush();
+}
 
-	/* copy the info a temp vector, and count bad/rehash/unsynced blocks */
-	timemap = malloc_nofail(blockmax * sizeof(time_t));
-	bad = 0;
-	bad_first = 0;
-	bad_last = 0;
-	count = 0;
-	rehash = 0;
-	unsynced_blocks = 0;
-	unscrubbed_blocks = 0;
-	log_tag("block_count:%u\n", blockmax);
-	for (i = 0; i < blockmax; ++i) {
-		int one_invalid;
-		int one_valid;
-
-		snapraid_info info = info_get(&state->infoarr, i);
-
-		/* for each disk */
-		one_invalid = 0;
-		one_valid = 0;
-		for (node_disk = state->disklist; node_disk != 0; node_disk = node_disk->next) {
-			struct snapraid_disk* disk = node_disk->data;
-			struct snapraid_block* block = fs_par2block_get(disk, i);
-
-			if (block_has_file(block))
-				one_valid = 1;
-			if (block_has_invalid_parity(block))
-				one_invalid = 1;
-		}
-
-		/* if both valid and invalid, we need to update */
-		if (one_invalid && one_valid) {
-			++unsynced_blocks;
-		}
-
-		/* skip unused blocks */
-		if (info != 0) {
-			if (info_get_bad(info)) {
-				if (bad == 0)
-					bad_first = i;
-				bad_last = i;
-				++bad;
-			}
-
-			if (info_get_rehash(info))
-				++rehash;
-
-			if (info_get_justsynced(info))
-				++unscrubbed_blocks;
+/**
+ * Print the status of the parity blocks.
+ */
+static void status_block(struct snapraid_state* state, struct snapraid_summary* summary)
+{
+	struct snapraid_timemap* timemap = &summary->timemap;
+	block_off_t blockmax;
+	block_off_t count;
+	block_off_t i;
+	time_t now;
+	unsigned dayoldest, daymedian, daynewest;
+	unsigned bar[GRAPH_COLUMN];
+	unsigned barpos;
+	unsigned barmax;
+	time_t oldest, newest, median;
+	unsigned x, y;
 
-			timemap[count++] = info_get_time(info);
-		}
+	/* get the present time */
+	now = time(0);
 
-		if (state->opt.gui) {
-			if (info != 0)
-				log_tag("block:%u:%" PRIu64 ":%s:%s:%s:%s\n", i, (uint64_t)info_get_time(info), one_valid ? "used" : "", one_invalid ? "unsynced" : "", info_get_bad(info) ? "bad" : "", info_get_rehash(info) ? "rehash" : "");
-			else
-				log_tag("block_noinfo:%u:%s:%s\n", i, one_valid ? "used" : "", one_invalid ? "unsynced" : "");
-		}
-	}
+	blockmax = summary->blockmax;
+	count = timemap->count;
 
-	log_tag("summary:has_unsynced:%u\n", unsynced_blocks);
-	log_tag("summary:has_unscrubbed:%u\n", unscrubbed_blocks);
-	log_tag("summary:has_rehash:%u\n", rehash);
-	log_tag("summary:has_bad:%u:%u:%u\n", bad, bad_first, bad_last);
+	log_tag("summary:has_unsynced:%u\n", summary->unsynced_blocks);
+	log_tag("summary:has_unscrubbed:%u\n", summary->unscrubbed_blocks);
+	log_tag("summary:has_rehash:%u\n", summary->rehash);
+	log_tag("summary:has_bad:%u:%u:%u\n", summary->bad, summary->bad_first, summary->bad_last);
 	log_flush();
 
 	if (!count) {
 		log_fatal("The array is empty.\n");
-		free(timemap);
-		return 0;
+		return;
 	}
 
-	/* sort the info to get the time info */
-	qsort(timemap, count, sizeof(time_t), time_compare);
-
 	/* output the info map */
-	i = 0;
 	log_tag("info_count:%u\n", count);
-	while (i < count) {
-		unsigned j = i + 1;
-		while (j < count && timemap[i] == timemap[j])
-			++j;
-		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)timemap[i], j - i);
-		i = j;
-	}
+	for (i = 0; i < timemap->size; ++i)
+		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)timemap->vec[i]->time, timemap->vec[i]->count);
 
-	oldest = info_get_time(timemap[0]);
-	median = info_get_time(timemap[count / 2]);
-	newest = info_get_time(timemap[count - 1]);
+	oldest = timemap_nth(timemap, 0);
+	median = timemap_nth(timemap, count / 2);
+	newest = timemap_nth(timemap, count - 1);
 	dayoldest = day_ago(oldest, now);
 	daymedian = day_ago(median, now);
 	daynewest = day_ago(newest, now);
@@ -363,9 +457,9 @@ int state_status(struct snapraid_state* state)
 		limit = oldest + (newest - oldest) * (i + 1) / GRAPH_COLUMN;
 
 		step = 0;
-		while (barpos < count && timemap[barpos] <= limit) {
+		while (barpos < timemap->size && timemap->vec[barpos]->time <= limit) {
+			step += timemap->vec[barpos]->count;
 			++barpos;
-			++step;
 		}
 
 		if (step > barmax)
@@ -418,52 +512,44 @@ int state_status(struct snapraid_state* state)
 
 	printf("\n");
 
-	if (unsynced_blocks) {
+	if (summary->unsynced_blocks) {
 		printf("WARNING! The array is NOT fully synced.\n");
-		printf("You have a sync in progress at %u%%.\n", (blockmax - unsynced_blocks) * 100 / blockmax);
+		printf("You have a sync in progress at %u%%.\n", (blockmax - summary->unsynced_blocks) * 100 / blockmax);
 	} else {
 		printf("No sync is in progress.\n");
 	}
 
-	if (unscrubbed_blocks) {
-		printf("You need to scrub at least the %u%% to check the latest sync.\n", (unscrubbed_blocks * 100 + blockmax - 1) / blockmax);
+	if (summary->unscrubbed_blocks) {
+		printf("You need to scrub at least the %u%% to check the latest sync.\n", (summary->unscrubbed_blocks * 100 + blockmax - 1) / blockmax);
 	} else {
 		printf("The full array was scrubbed at least one time.\n");
 	}
 
-	if (rehash) {
-		printf("You have a rehash in progress at %u%%.\n", (count - rehash) * 100 / count);
+	if (summary->rehash) {
+		printf("You have a rehash in progress at %u%%.\n", (count - summary->rehash) * 100 / count);
 	} else {
-		if (state->besthash != state->hash) {
+		if (state->besthash != summary->hash) {
 			printf("No rehash is in progress, but for optimal performance one is recommended.\n");
 		} else {
 			printf("No rehash is in progress or needed.\n");
 		}
 	}
 
-	if (bad) {
+	if (summary->bad) {
 		block_off_t bad_print;
 
-		printf("DANGER! In the array there are %u errors!\n\n", bad);
+		printf("DANGER! In the array there are %u errors!\n\n", summary->bad);
 
-		printf("They are from block %u to %u, specifically at blocks:", bad_first, bad_last);
+		printf("They are from block %u to %u, specifically at blocks:", summary->bad_first, summary->bad_last);
 
 		/* print some of the errors */
 		bad_print = 0;
-		for (i = 0; i < blockmax; ++i) {
-			snapraid_info info = info_get(&state->infoarr, i);
-
-			/* skip unused blocks */
-			if (info == 0)
-				continue;
-
-			if (info_get_bad(info)) {
-				printf(" %u", i);
-				++bad_print;
-			}
+		for (i = 0; i < summary->bad_max; ++i) {
+			printf(" %u", summary->bad_list[i]);
+			++bad_print;
 
 			if (bad_print > 100) {
-				printf(" and %u more...", bad - bad_print);
+				printf(" and %u more...", summary->bad - bad_print);
 				break;
 			}
 		}
@@ -475,10 +561,362 @@ int state_status(struct snapraid_state* state)
 	} else {
 		printf("No error detected.\n");
 	}
+}
 
-	/* free the temp vector */
-	free(timemap);
+int state_status(struct snapraid_state* state)
+{
+	struct snapraid_summary summary;
+
+	summary_init(&summary);
+
+	summary_disk(state, &summary);
+
+	status_disk(state, &summary);
+
+	log_tag("block_count:%u\n", summary.blockmax);
+
+	summary_block(state, &summary);
+
+	status_block(state, &summary);
+
+	summary_done(&summary);
 
 	return 0;
 }
 
+/****************************************************************************/
+/* summary */
+
+/**
+ * Get the crc stored at the end of a content file, and its size.
+ * Return -1 if the file cannot be read.
+ */
+static int summary_content_crc(const char* path, uint64_t* size, uint32_t* crc)
+{
+	unsigned char buf[4];
+	struct stat st;
+	int f;
+
+	f = open(path, O_RDONLY | O_BINARY);
+	if (f == -1)
+		return -1;
+
+	if (fstat(f, &st) != 0
+		|| st.st_size < 4
+		|| lseek(f, st.st_size - 4, SEEK_SET) != st.st_size - 4
+		|| read(f, buf, 4) != 4) {
+		close(f);
+		return -1;
+	}
+
+	close(f);
+
+	*size = st.st_size;
+	*crc = buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+
+	return 0;
+}
+
+/**
+ * Write the summary file of a content file.
+ *
+ * The summary is only an optimization, so on error only a warning is printed.
+ */
+static void summary_write(struct snapraid_summary* summary, const char* content, uint32_t crc)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+	uint64_t content_size;
+	uint32_t content_crc;
+	unsigned i;
+	STREAM* f;
+
+	/* the summary refers to the content file just written */
+	if (summary_content_crc(content, &content_size, &content_crc) != 0 || content_crc != crc)
+		return;
+
+	pathprint(path, sizeof(path), "%s.status", content);
+	pathprint(tmp, sizeof(tmp), "%s.tmp", path);
+
+	f = sopen_write(tmp);
+	if (f == 0) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error opening the summary file '%s'. %s.\n", tmp, strerror(errno));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	swrite("SNAPSUM1\n\3\0\0", 12, f);
+	sputc('k', f);
+	sputb64(content_size, f);
+	sputb32(content_crc, f);
+	sputc('z', f);
+	sputb32(summary->block_size, f);
+	sputb32(summary->blockmax, f);
+	sputc('c', f);
+	sputb32(summary->hash, f);
+	sputb32(summary->prevhash, f);
+
+	sputc('p', f);
+	sputb32(summary->level, f);
+	for (i = 0; i < summary->level; ++i) {
+		sputb32(summary->parity_total_blocks[i], f);
+		sputb32(summary->parity_free_blocks[i], f);
+	}
+
+	sputc('d', f);
+	sputb32(summary->disk_max, f);
+	for (i = 0; i < summary->disk_max; ++i) {
+		struct snapraid_summary_disk* disk = &summary->disk[i];
+		sputbs(disk->name, f);
+		sputb32(disk->file_count, f);
+		sputb32(disk->file_fragmented, f);
+		sputb32(disk->extra_fragment, f);
+		sputb64(disk->file_size, f);
+		sputb32(disk->block_count, f);
+		sputb32(disk->block_latest_used, f);
+		sputb32(disk->total_blocks, f);
+		sputb32(disk->free_blocks, f);
+	}
+
+	sputc('b', f);
+	sputb32(summary->unsynced_blocks, f);
+	sputb32(summary->unscrubbed_blocks, f);
+	sputb32(summary->rehash, f);
+	sputb32(summary->bad, f);
+	sputb32(summary->bad_first, f);
+	sputb32(summary->bad_last, f);
+	sputb32(summary->bad_max, f);
+	for (i = 0; i < summary->bad_max; ++i)
+		sputb32(summary->bad_list[i], f);
+
+	sputc('t', f);
+	sputb32(summary->timemap.size, f);
+	for (i = 0; i < summary->timemap.size; ++i) {
+		sputb64(summary->timemap.vec[i]->time, f);
+		sputb32(summary->timemap.vec[i]->count, f);
+	}
+
+	sputc('N', f);
+
+	/* flush data written to the disk, before getting the crc */
+	if (sflush(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error writing the summary file '%s'. %s.\n", tmp, strerror(errno));
+		sclose(f);
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	sputble32(scrc(f), f);
+
+	if (serror(f) || sflush(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error writing the summary file '%s'. %s.\n", tmp, strerror(errno));
+		sclose(f);
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (sclose(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error closing the summary file '%s'. %s.\n", tmp, strerror(errno));
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (rename(tmp, path) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Error renaming the summary file '%s' to '%s'. %s.\n", tmp, path, strerror(errno));
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+void state_summary_write(struct snapraid_state* state, uint32_t crc)
+{
+	struct snapraid_summary summary;
+	tommy_node* i;
+
+	summary_init(&summary);
+
+	summary_disk(state, &summary);
+
+	summary_block(state, &summary);
+
+	for (i = tommy_list_head(&state->contentlist); i != 0; i = i->next) {
+		struct snapraid_content* content = i->data;
+		summary_write(&summary, content->content, crc);
+	}
+
+	summary_done(&summary);
+}
+
+/**
+ * Read the summary file of a content file.
+ * Return 0 if the summary is valid for the content file and the configuration.
+ */
+static int summary_read(struct snapraid_state* state, struct snapraid_summary* summary, const char* content)
+{
+	char path[PATH_MAX];
+	unsigned char buffer[12];
+	uint64_t content_size;
+	uint32_t content_crc;
+	uint32_t crc_stored;
+	uint32_t crc_computed;
+	uint64_t v64;
+	uint32_t v;
+	tommy_node* node_disk;
+	unsigned i;
+	STREAM* f;
+
+	if (summary_content_crc(content, &content_size, &content_crc) != 0)
+		return -1;
+
+	pathprint(path, sizeof(path), "%s.status", content);
+
+	f = sopen_read(path);
+	if (f == 0)
+		return -1;
+
+	if (sread(f, buffer, 12) < 0 || memcmp(buffer, "SNAPSUM1\n\3\0\0", 12) != 0)
+		goto bail;
+
+	/* the summary must be of the current content file */
+	if (sgetc(f) != 'k' || sgetb64(f, &v64) < 0 || v64 != content_size)
+		goto bail;
+	if (sgetb32(f, &v) < 0 || v != content_crc)
+		goto bail;
+
+	/* and of the current configuration */
+	if (sgetc(f) != 'z' || sgetb32(f, &v) < 0 || v != state->block_size)
+		goto bail;
+	if (sgetb32(f, &summary->blockmax) < 0)
+		goto bail;
+	summary->block_size = state->block_size;
+
+	if (sgetc(f) != 'c' || sgetb32(f, &summary->hash) < 0 || sgetb32(f, &summary->prevhash) < 0)
+		goto bail;
+
+	if (sgetc(f) != 'p' || sgetb32(f, &v) < 0 || v != state->level)
+		goto bail;
+	summary->level = state->level;
+	for (i = 0; i < summary->level; ++i) {
+		if (sgetb32(f, &summary->parity_total_blocks[i]) < 0
+			|| sgetb32(f, &summary->parity_free_blocks[i]) < 0)
+			goto bail;
+	}
+
+	if (sgetc(f) != 'd' || sgetb32(f, &v) < 0 || v != tommy_list_count(&state->disklist))
+		goto bail;
+	summary->disk_max = v;
+	summary->disk = malloc_nofail(summary->disk_max * sizeof(struct snapraid_summary_disk));
+	for (i = 0, node_disk = state->disklist; i < summary->disk_max; ++i, node_disk = node_disk->next) {
+		struct snapraid_summary_disk* disk = &summary->disk[i];
+		struct snapraid_disk* state_disk = node_disk->data;
+		if (sgetbs(f, disk->name, sizeof(disk->name)) < 0
+			|| strcmp(disk->name, state_disk->name) != 0
+			|| sgetb32(f, &disk->file_count) < 0
+			|| sgetb32(f, &disk->file_fragmented) < 0
+			|| sgetb32(f, &disk->extra_fragment) < 0
+			|| sgetb64(f, &disk->file_size) < 0
+			|| sgetb32(f, &disk->block_count) < 0
+			|| sgetb32(f, &disk->block_latest_used) < 0
+			|| sgetb32(f, &disk->total_blocks) < 0
+			|| sgetb32(f, &disk->free_blocks) < 0)
+			goto bail;
+	}
+
+	if (sgetc(f) != 'b'
+		|| sgetb32(f, &summary->unsynced_blocks) < 0
+		|| sgetb32(f, &summary->unscrubbed_blocks) < 0
+		|| sgetb32(f, &summary->rehash) < 0
+		|| sgetb32(f, &summary->bad) < 0
+		|| sgetb32(f, &summary->bad_first) < 0
+		|| sgetb32(f, &summary->bad_last) < 0
+		|| sgetb32(f, &summary->bad_max) < 0
+		|| summary->bad_max > SUMMARY_BAD_MAX)
+		goto bail;
+	for (i = 0; i < summary->bad_max; ++i) {
+		if (sgetb32(f, &summary->bad_list[i]) < 0)
+			goto bail;
+	}
+
+	if (sgetc(f) != 't' || sgetb32(f, &v) < 0)
+		goto bail;
+	for (i = 0; i < v; ++i) {
+		uint32_t count;
+		if (sgetb64(f, &v64) < 0 || sgetb32(f, &count) < 0)
+			goto bail;
+		timemap_insert(&summary->timemap, v64, count);
+	}
+	timemap_sort(&summary->timemap);
+
+	if (sgetc(f) != 'N')
+		goto bail;
+
+	/* get the crc before reading it from the file */
+	crc_computed = scrc(f);
+
+	if (sgetble32(f, &crc_stored) < 0 || crc_stored != crc_computed) {
+		/* LCOV_EXCL_START */
+		log_error("WARNING! Ignoring the damaged summary file '%s'.\n", path);
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	sclose(f);
+	return 0;
+
+bail:
+	sclose(f);
+	return -1;
+}
+
+int state_status_summary(struct snapraid_state* state)
+{
+	struct snapraid_summary summary;
+	tommy_node* node;
+	int ret;
+
+	/* the GUI needs the info of every block */
+	if (state->opt.gui)
+		return -1;
+
+	/* use the first content file present, as state_read() */
+	node = tommy_list_head(&state->contentlist);
+	while (node) {
+		struct snapraid_content* content = node->data;
+		struct stat st;
+
+		if (stat(content->content, &st) == 0)
+			break;
+
+		node = node->next;
+	}
+	if (!node)
+		return -1;
+
+	summary_init(&summary);
+
+	ret = summary_read(state, &summary, ((struct snapraid_content*)node->data)->content);
+	if (ret == 0) {
+		log_tag("content:%s\n", ((struct snapraid_content*)node->data)->content);
+		log_flush();
+		msg_verbose("Using the summary of the content file '%s'\n", ((struct snapraid_content*)node->data)->content);
+
+		status_disk(state, &summary);
+
+		log_tag("block_count:%u\n", summary.blockmax);
+
+		status_block(state, &summary);
+	}
+
+	summary_done(&summary);
+
+	return ret;
+}
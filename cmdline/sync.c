@@ -242,6 +242,7 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 
 			/* until now is disk */
 			state_usage_disk(state, disk);
+			disk->read_bytes += read_size;
 
 			countsize += read_size;
 
@@ -252,6 +253,9 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 				memhash(state->hash, state->hashseed, hash, buffer, read_size);
 			}
 
+			/* until now is hash */
+			state_usage_hash(state);
+
 			if (block_state == BLOCK_STATE_REP) {
 				/* compare the hash */
 				if (memcmp(hash, block->hash, HASH_SIZE) != 0) {
@@ -292,6 +296,10 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 			/* count the number of processed block */
 			++countpos;
 
+			/* errors for the progress reporting */
+			state->progress_error = error;
+			state->progress_io_error = io_error;
+
 			/* progress */
 			if (state_progress(state, i, countpos, countmax, countsize)) {
 				/* LCOV_EXCL_START */
@@ -753,6 +761,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 
 			/* until now is disk */
 			state_usage_disk(state, disk);
+			disk->read_bytes += read_size;
 
 			countsize += read_size;
 
@@ -767,6 +776,9 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 				memhash(state->hash, state->hashseed, hash, buffer[j], read_size);
 			}
 
+			/* until now is hash */
+			state_usage_hash(state);
+
 			if (block_has_updated_hash(block)) {
 				/* compare the hash */
 				if (memcmp(hash, block->hash, HASH_SIZE) != 0) {
@@ -977,8 +989,8 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 				/* compute the parity */
 				raid_gen(diskmax, state->level, state->block_size, buffer);
 
-				/* until now is CPU */
-				state_usage_cpu(state);
+				/* until now is parity */
+				state_usage_raid(state);
 
 				/* write the parity */
 				for (l = 0; l < state->level; ++l) {
@@ -1011,7 +1023,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 					}
 
 					/* until now is parity */
-					state_usage_parity(state, l);
+					state_usage_parity_write(state, l);
 				}
 			}
 
@@ -1081,6 +1093,11 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 		/* count the number of processed block */
 		++countpos;
 
+		/* errors for the progress reporting */
+		state->progress_error = error;
+		state->progress_io_error = io_error;
+		state->progress_silent_error = silent_error;
+
 		/* progress */
 		if (state_progress(state, i, countpos, countmax, countsize)) {
 			/* LCOV_EXCL_START */
@@ -47,6 +47,136 @@ int dirent_hidden(struct dirent* dd)
 	return dd->d_name[0] == '.';
 }
 
+#if HAVE_STATX
+int lstat_scan(const char* file, struct stat* st)
+{
+	struct statx stx;
+	unsigned mask = STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_MTIME;
+
+	/* request only the fields we use, to allow the filesystem to skip the others */
+	if (statx(AT_FDCWD, file, AT_SYMLINK_NOFOLLOW, mask, &stx) != 0) {
+		/* if not supported by the kernel, fallback to lstat() */
+		if (errno == ENOSYS)
+			return lstat(file, st);
+		return -1;
+	}
+
+	/* if some field is missing, fallback to lstat() */
+	if ((stx.stx_mask & mask) != mask)
+		return lstat(file, st);
+
+	memset(st, 0, sizeof(struct stat));
+	st->st_mode = stx.stx_mode;
+	st->st_ino = stx.stx_ino;
+	st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+	st->st_nlink = stx.stx_nlink;
+	st->st_size = stx.stx_size;
+	st->st_mtime = stx.stx_mtime.tv_sec;
+#if HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+#endif
+
+	return 0;
+}
+#endif
+
+#if HAVE_GETDENTS64
+/**
+ * Initial and max size of the getdents64() buffer.
+ *
+ * The initial size is the same used by readdir() in glibc, and
+ * it's doubled at every read that fills it, up to the max size.
+ */
+#define LINUX_DIR_BUFFER_MIN (32 * 1024)
+#define LINUX_DIR_BUFFER_MAX (4 * 1024 * 1024)
+
+struct linux_dir_struct {
+	int f; /**< Handle of the directory. */
+	char* buf; /**< Buffer filled by getdents64(). */
+	size_t size; /**< Size of the buffer. */
+	size_t pos; /**< Position of the next entry in the buffer. */
+	size_t len; /**< Number of valid bytes in the buffer. */
+	struct dirent dd; /**< Entry returned. */
+};
+
+linux_dir* linux_opendir(const char* dir)
+{
+	linux_dir* dirstream;
+	int f;
+
+	f = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (f == -1)
+		return 0;
+
+	dirstream = malloc_nofail(sizeof(linux_dir));
+	dirstream->f = f;
+	dirstream->size = LINUX_DIR_BUFFER_MIN;
+	dirstream->buf = malloc_nofail(dirstream->size);
+	dirstream->pos = 0;
+	dirstream->len = 0;
+
+	return dirstream;
+}
+
+struct dirent* linux_readdir(linux_dir* dirstream)
+{
+	struct dirent64* entry;
+	size_t name_len;
+
+	if (dirstream->pos >= dirstream->len) {
+		ssize_t ret;
+
+		/* if the previous read filled the buffer, read more the next time */
+		if (dirstream->len != 0
+			&& dirstream->len + sizeof(struct dirent64) > dirstream->size
+			&& dirstream->size < LINUX_DIR_BUFFER_MAX
+		) {
+			free(dirstream->buf);
+			dirstream->size *= 2;
+			dirstream->buf = malloc_nofail(dirstream->size);
+		}
+
+		ret = getdents64(dirstream->f, dirstream->buf, dirstream->size);
+		if (ret <= 0) {
+			/* at the end errno is not changed */
+			return 0;
+		}
+
+		dirstream->pos = 0;
+		dirstream->len = ret;
+	}
+
+	entry = (struct dirent64*)(dirstream->buf + dirstream->pos);
+	dirstream->pos += entry->d_reclen;
+
+	name_len = strlen(entry->d_name);
+	if (name_len >= sizeof(dirstream->dd.d_name)) {
+		/* LCOV_EXCL_START */
+		errno = ENAMETOOLONG;
+		return 0;
+		/* LCOV_EXCL_STOP */
+	}
+
+	dirstream->dd.d_ino = entry->d_ino;
+	dirstream->dd.d_type = entry->d_type;
+	memcpy(dirstream->dd.d_name, entry->d_name, name_len + 1);
+
+	return &dirstream->dd;
+}
+
+int linux_closedir(linux_dir* dirstream)
+{
+	int ret;
+
+	ret = close(dirstream->f);
+
+	free(dirstream->buf);
+	free(dirstream);
+
+	return ret;
+}
+#endif
+
 const char* stat_desc(struct stat* st)
 {
 	if (S_ISREG(st->st_mode))
@@ -294,6 +424,25 @@ uint64_t tick(void)
 #endif
 }
 
+uint64_t tick_freq(void)
+{
+#if HAVE_MACH_ABSOLUTE_TIME
+	/* for Mac OS X */
+	mach_timebase_info_data_t tb;
+
+	if (mach_timebase_info(&tb) != 0 || tb.numer == 0)
+		return 1000000000ULL;
+
+	return 1000000000ULL * tb.denom / tb.numer;
+#elif HAVE_CLOCK_GETTIME && (defined(CLOCK_MONOTONIC) || defined(CLOCK_MONOTONIC_RAW))
+	/* for Linux */
+	return 1000000000ULL;
+#else
+	/* other platforms */
+	return 1000000ULL;
+#endif
+}
+
 uint64_t tick_ms(void)
 {
 	struct timeval tv;
@@ -304,6 +453,17 @@ uint64_t tick_ms(void)
 	return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
 }
 
+void sleep_us(uint64_t us)
+{
+	struct timespec req;
+
+	req.tv_sec = us / 1000000;
+	req.tv_nsec = (us % 1000000) * 1000;
+
+	/* an early wake up for a signal is not a problem */
+	nanosleep(&req, 0);
+}
+
 int randomize(void* ptr, size_t size)
 {
 	int f;
@@ -57,5 +57,43 @@ int dirent_hidden(struct dirent* dd);
  */
 const char* stat_desc(struct stat* st);
 
+/**
+ * Get the stat info of a file without following links, like lstat().
+ * Only the fields used by the scan are guaranteed to be filled:
+ * st_mode, st_ino, st_dev, st_nlink, st_size and st_mtime.
+ */
+#if HAVE_STATX
+int lstat_scan(const char* file, struct stat* st);
+#else
+#define lstat_scan lstat
+#endif
+
+#if HAVE_GETDENTS64
+/**
+ * Directory reading with getdents64().
+ *
+ * It's like opendir()/readdir()/closedir(), but it uses a buffer growing
+ * up to some MB to reduce the number of syscalls in big directories.
+ */
+struct linux_dir_struct;
+typedef struct linux_dir_struct linux_dir;
+
+/**
+ * Open a directory.
+ */
+linux_dir* linux_opendir(const char* dir);
+
+/**
+ * Read the next directory entry.
+ * Return 0 at the end, or on error setting errno.
+ */
+struct dirent* linux_readdir(linux_dir* dirstream);
+
+/**
+ * Close a directory.
+ */
+int linux_closedir(linux_dir* dirstream);
+#endif
+
 #endif
 
@@ -25,6 +25,40 @@
 /****************************************************************************/
 /* memory */
 
+/**
+ * Size of the huge pages used for the big buffers.
+ */
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * Advise the kernel to back the memory with transparent huge pages.
+ * Only the huge pages fully inside the memory are affected, so it's used
+ * only for buffers of at least two huge pages.
+ * It reduces the TLB misses in the raid and hash functions that walk
+ * all the buffers of a stripe for each block.
+ * It's only an hint, and it does nothing if huge pages are disabled.
+ */
+static void malloc_hugepage(void* ptr, size_t size)
+{
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+	uintptr_t begin;
+	uintptr_t end;
+
+	if (size < 2 * HUGEPAGE_SIZE)
+		return;
+
+	begin = ((uintptr_t)ptr + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+	end = ((uintptr_t)ptr + size) & ~(uintptr_t)(HUGEPAGE_SIZE - 1);
+
+	/* ignore errors, as without huge pages the memory is still usable */
+	if (begin < end)
+		madvise((void*)begin, end - begin, MADV_HUGEPAGE);
+#else
+	(void)ptr;
+	(void)size;
+#endif
+}
+
 void* malloc_nofail_align(size_t size, void** freeptr)
 {
 	void* ptr;
@@ -38,6 +72,8 @@ void* malloc_nofail_align(size_t size, void** freeptr)
 		/* LCOV_EXCL_STOP */
 	}
 
+	malloc_hugepage(ptr, size);
+
 	return ptr;
 }
 
@@ -54,6 +90,9 @@ void** malloc_nofail_vector_align(int nd, int n, size_t size, void** freeptr)
 		/* LCOV_EXCL_STOP */
 	}
 
+	/* all the buffers are allocated in a single memory block */
+	malloc_hugepage(*freeptr, n * size);
+
 	return ptr;
 }
 
@@ -443,8 +482,13 @@ static inline uint64_t util_swap64(uint64_t v)
 /****************************************************************************/
 /* hash */
 
+#if HAVE_AVX2
+int hash_avx2;
+#endif
+
 #include "murmur3.c"
 #include "spooky2.c"
+#include "xxh3.c"
 
 void memhash(unsigned kind, const unsigned char* seed, void* digest, const void* src, size_t size)
 {
@@ -455,6 +499,9 @@ void memhash(unsigned kind, const unsigned char* seed, void* digest, const void*
 	case HASH_SPOOKY2 :
 		SpookyHash128(src, size, seed, digest);
 		break;
+	case HASH_XXH3 :
+		XXH3Hash128(src, size, seed, digest);
+		break;
 	default :
 		/* LCOV_EXCL_START */
 		log_fatal("Internal inconsistency in hash function %u\n", kind);
@@ -470,6 +517,7 @@ const char* hash_config_name(unsigned kind)
 	case HASH_UNDEFINED : return "undefined";
 	case HASH_MURMUR3 : return "murmur3";
 	case HASH_SPOOKY2 : return "spooky2";
+	case HASH_XXH3 : return "xxh3";
 	default :
 		/* LCOV_EXCL_START */
 		return "unknown";
@@ -477,6 +525,34 @@ const char* hash_config_name(unsigned kind)
 	}
 }
 
+void memhash_init(void)
+{
+#if HAVE_AVX2
+	if (raid_cpu_has_avx2())
+		hash_avx2 = 1;
+#endif
+}
+
+unsigned memhash_best(void)
+{
+#ifdef CONFIG_X86
+#if HAVE_AVX2
+	/* XXH3 with AVX2 is faster than any scalar hash */
+	if (hash_avx2)
+		return HASH_XXH3;
+#endif
+	if (sizeof(void*) == 4 && !raid_cpu_has_slowmult())
+		return HASH_MURMUR3;
+	else
+		return HASH_SPOOKY2;
+#else
+	if (sizeof(void*) == 4)
+		return HASH_MURMUR3;
+	else
+		return HASH_SPOOKY2;
+#endif
+}
+
 unsigned memdiff(const unsigned char* data1, const unsigned char* data2, size_t size)
 {
 	size_t i;
@@ -178,6 +178,14 @@ void crc32c_init(void);
 #define HASH_UNDEFINED 0
 #define HASH_MURMUR3 1
 #define HASH_SPOOKY2 2
+#define HASH_XXH3 3
+
+/**
+ * If the CPU supports the AVX2 instructions used by XXH3.
+ */
+#if HAVE_AVX2
+extern int hash_avx2;
+#endif
 
 /**
  * Compute the HASH of a memory block.
@@ -190,6 +198,17 @@ void memhash(unsigned kind, const unsigned char* seed, void* digest, const void*
  */
 const char* hash_config_name(unsigned kind);
 
+/**
+ * Initialize the HASH support.
+ */
+void memhash_init(void);
+
+/**
+ * Return the fastest hash in this machine, used by default for new arrays.
+ * It requires memhash_init() already called.
+ */
+unsigned memhash_best(void);
+
 /**
  * Count the number of different bits in the two buffers.
  */
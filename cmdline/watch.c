@@ -0,0 +1,807 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "support.h"
+#include "util.h"
+#include "elem.h"
+#include "state.h"
+#include "watch.h"
+
+/****************************************************************************/
+/* watch */
+
+/*
+ * The watch command keeps a change log for each disk, stored near the first
+ * content file, and named "<content>.<disk>.watch".
+ *
+ * The change log is a text file with one entry for line:
+ *  SNAPWATCH1 - Header.
+ *  s<session> - Session of the watcher. Always the second line.
+ *  c<session> <offset> - Session continued, with the position from where all the
+ *    changed dirs are reported again in the following lines. Optional third line.
+ *  e<time> - Start of a new second. The dirs are reported only once for each second.
+ *  d<sub> - Dir with a change in one of its entries. Empty for the disk root.
+ *  o - Some changes were lost.
+ *
+ * The watcher keeps the change log locked while running, so a log
+ * without a lock is not anymore updated, and it cannot be trusted.
+ *
+ * The start of each second, and the position after an 'o' entry, are the points
+ * where the watcher forgets about the dirs already reported. The scan restarts
+ * the reading from the last of these points, to get again all the dirs that
+ * the watcher is not going to report anymore in the same second.
+ *
+ * When the log grows too much, the watcher compacts it in a new session that
+ * reports only once all the dirs changed, and continues the previous session.
+ * A scan that has already read the previous session up to a position after the
+ * continued one, can then continue to use the log without a full scan.
+ */
+
+/**
+ * Header of the change log.
+ */
+#define WATCH_HEADER "SNAPWATCH1\n"
+
+/**
+ * Gets the path of the change log of the disk.
+ */
+static void watch_path(struct snapraid_state* state, struct snapraid_disk* disk, char* path, size_t size)
+{
+	struct snapraid_content* content = tommy_list_head(&state->contentlist)->data;
+
+	pathprint(path, size, "%s.%s.watch", content->content, disk->name);
+}
+
+static struct snapraid_watch_dir* watch_dir_alloc(const char* sub, size_t len)
+{
+	struct snapraid_watch_dir* dir;
+
+	dir = malloc_nofail(sizeof(struct snapraid_watch_dir));
+	dir->sub = malloc_nofail(len + 1);
+	memcpy(dir->sub, sub, len);
+	dir->sub[len] = 0;
+
+	return dir;
+}
+
+static void watch_dir_free(struct snapraid_watch_dir* dir)
+{
+	free(dir->sub);
+	free(dir);
+}
+
+static int watch_dir_compare(const void* void_arg, const void* void_data)
+{
+	const char* arg = void_arg;
+	const struct snapraid_watch_dir* dir = void_data;
+
+	return strcmp(arg, dir->sub);
+}
+
+/**
+ * Insert a dir in the set, if not already present.
+ */
+static void watch_dir_insert(tommy_hashdyn* dirset, const char* sub, size_t len)
+{
+	struct snapraid_watch_dir* dir;
+	tommy_hash_t hash;
+
+	dir = watch_dir_alloc(sub, len);
+	hash = dir_name_hash(dir->sub);
+
+	if (tommy_hashdyn_search(dirset, watch_dir_compare, dir->sub, hash) != 0) {
+		watch_dir_free(dir);
+		return;
+	}
+
+	tommy_hashdyn_insert(dirset, &dir->node, dir, hash);
+}
+
+int watch_is_changed(tommy_hashdyn* dirset, const char* sub)
+{
+	return tommy_hashdyn_search(dirset, watch_dir_compare, sub, dir_name_hash(sub)) != 0;
+}
+
+void watch_done(tommy_hashdyn* dirset)
+{
+	tommy_hashdyn_foreach(dirset, (tommy_foreach_func*)watch_dir_free);
+	tommy_hashdyn_done(dirset);
+}
+
+/**
+ * Read the specified range of the change log.
+ * Return the buffer allocated, or 0 on error.
+ */
+static char* watch_read(int f, uint64_t offset, size_t size)
+{
+	char* buf;
+	size_t done;
+
+	buf = malloc_nofail(size + 1);
+
+	done = 0;
+	while (done < size) {
+		ssize_t ret;
+
+		ret = pread(f, buf + done, size - done, offset + done);
+		if (ret <= 0) {
+			/* LCOV_EXCL_START */
+			free(buf);
+			return 0;
+			/* LCOV_EXCL_STOP */
+		}
+
+		done += ret;
+	}
+
+	buf[size] = 0;
+
+	return buf;
+}
+
+int watch_load(struct snapraid_state* state, struct snapraid_disk* disk, tommy_hashdyn* dirset)
+{
+	char path[PATH_MAX];
+	char session[WATCH_SESSION_MAX];
+	char cont[WATCH_SESSION_MAX];
+	struct stat st;
+	char* buf;
+	char* begin;
+	char* end;
+	char* sep;
+	uint64_t start;
+	uint64_t cont_offset;
+	uint64_t mark;
+	int is_valid;
+	int f;
+
+	session[0] = 0;
+	cont[0] = 0;
+	cont_offset = 0;
+	mark = 0;
+	is_valid = 0;
+
+	watch_path(state, disk, path, sizeof(path));
+
+	f = open(path, O_RDONLY | O_BINARY);
+	if (f == -1) {
+		/* no watcher for this disk */
+		goto bail;
+	}
+
+	if (!state->opt.skip_watch_lock) {
+#if HAVE_LOCKFILE
+		/* if we can lock the change log, the watcher is not running */
+		if (flock(f, LOCK_SH | LOCK_NB) == 0) {
+			msg_verbose("Ignoring change log '%s' not updated anymore\n", path);
+			goto bail_close;
+		}
+#else
+		/* without locks we cannot know if the watcher is running */
+		goto bail_close;
+#endif
+	}
+
+	if (fstat(f, &st) != 0) {
+		/* LCOV_EXCL_START */
+		goto bail_close;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* read the header and the session */
+	buf = watch_read(f, 0, st.st_size < 256 ? st.st_size : 256);
+	if (!buf) {
+		/* LCOV_EXCL_START */
+		goto bail_close;
+		/* LCOV_EXCL_STOP */
+	}
+
+	begin = buf + strlen(WATCH_HEADER);
+	end = begin;
+	if (memcmp(buf, WATCH_HEADER, strlen(WATCH_HEADER)) == 0 && *begin == 's') {
+		end = strchr(begin, '\n');
+		if (end != 0 && end - begin - 1 < WATCH_SESSION_MAX) {
+			memcpy(session, begin + 1, end - begin - 1);
+			session[end - begin - 1] = 0;
+		}
+	}
+
+	if (session[0] == 0) {
+		/* the watcher has not yet written the header */
+		free(buf);
+		goto bail_close;
+	}
+
+	/* the optional continuation of a previous session */
+	begin = end + 1;
+	if (*begin == 'c') {
+		end = strchr(begin, '\n');
+		sep = strchr(begin, ' ');
+		if (end == 0 || sep == 0 || sep > end || sep - begin - 1 >= WATCH_SESSION_MAX) {
+			/* LCOV_EXCL_START */
+			free(buf);
+			goto bail_close;
+			/* LCOV_EXCL_STOP */
+		}
+		memcpy(cont, begin + 1, sep - begin - 1);
+		cont[sep - begin - 1] = 0;
+		cont_offset = strtoull(sep + 1, 0, 10);
+	}
+
+	start = end + 1 - buf;
+	free(buf);
+
+	/* continue from the last position only if it's the same watcher */
+	if (strcmp(session, disk->watch_session) == 0
+		&& disk->watch_offset >= start
+		&& disk->watch_offset <= (uint64_t)st.st_size
+	) {
+		start = disk->watch_offset;
+		is_valid = 1;
+	} else if (cont[0] != 0
+		&& strcmp(cont, disk->watch_session) == 0
+		&& disk->watch_offset >= cont_offset
+	) {
+		/* all the dirs changed after the last position are reported again */
+		msg_verbose("Continuing the compacted change log '%s'\n", path);
+		is_valid = 1;
+	} else {
+		msg_verbose("Starting a new session of the change log '%s'\n", path);
+	}
+
+	mark = start;
+
+	buf = watch_read(f, start, st.st_size - start);
+	if (!buf) {
+		/* LCOV_EXCL_START */
+		is_valid = 0;
+		goto bail_close;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* process only complete lines, the last one may be still in writing */
+	begin = buf;
+	while ((end = strchr(begin, '\n')) != 0) {
+		switch (*begin) {
+		case 'e' :
+			mark = start + (begin - buf);
+			break;
+		case 'd' :
+			if (is_valid)
+				watch_dir_insert(dirset, begin + 1, end - begin - 1);
+			break;
+		case 'o' :
+			/* changes lost, the watcher restarts from here */
+			if (is_valid)
+				msg_verbose("Changes lost in the change log '%s'\n", path);
+			mark = start + (end + 1 - buf);
+			is_valid = 0;
+			break;
+		default :
+			/* LCOV_EXCL_START */
+			is_valid = 0;
+			break;
+			/* LCOV_EXCL_STOP */
+		}
+
+		begin = end + 1;
+	}
+
+	free(buf);
+
+	if (is_valid)
+		msg_verbose("%8u changed dirs in the change log '%s'\n", (unsigned)tommy_hashdyn_count(dirset), path);
+
+bail_close:
+	close(f);
+bail:
+	/* discard all the dirs if the log cannot be trusted */
+	if (!is_valid) {
+		tommy_hashdyn_foreach(dirset, (tommy_foreach_func*)watch_dir_free);
+		tommy_hashdyn_done(dirset);
+		tommy_hashdyn_init(dirset);
+	}
+
+	/* save the new position */
+	if (strcmp(session, disk->watch_session) != 0 || mark != disk->watch_offset) {
+		pathcpy(disk->watch_session, sizeof(disk->watch_session), session);
+		disk->watch_offset = mark;
+		state->need_write = 1;
+	}
+
+	return is_valid ? 0 : -1;
+}
+
+/****************************************************************************/
+/* watcher */
+
+/**
+ * If the watcher is supported.
+ *
+ * It requires fanotify with the names of the changed entries, and Linux 5.9.
+ */
+#if HAVE_SYS_FANOTIFY_H && HAVE_OPEN_BY_HANDLE_AT && defined(FAN_REPORT_DFID_NAME) && HAVE_LOCKFILE
+#define HAVE_WATCH 1
+#endif
+
+#if HAVE_WATCH
+
+/**
+ * Size of the buffer used to read the events.
+ */
+#define WATCH_EVENT_SIZE (256 * 1024)
+
+/**
+ * Minimum size of the change log to compact it.
+ */
+#define WATCH_COMPACT_SIZE (16 * 1024 * 1024)
+
+/**
+ * Events that change the content of a dir.
+ */
+#define WATCH_EVENT_MASK (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR)
+
+struct snapraid_watcher {
+	struct snapraid_disk* disk; /**< Disk watched. */
+	char dir[PATH_MAX]; /**< Real path of the disk dir, with the final slash. */
+	size_t dir_len; /**< Length of the disk dir. */
+	char path[PATH_MAX]; /**< Real path of the change log. */
+	char temp[PATH_MAX]; /**< Path of the change log in writing when compacted. */
+	char session[WATCH_SESSION_MAX]; /**< Session of the change log. */
+	unsigned compact; /**< Number of times the change log was compacted. */
+	int f; /**< Change log. */
+	uint64_t size; /**< Size of the change log. */
+	uint64_t base; /**< Position from where all the changed dirs are in allset. */
+	uint64_t limit; /**< Size of the change log at which it's compacted. */
+	int mount_f; /**< Dir used to open the file handles. */
+	__kernel_fsid_t fsid; /**< Filesystem of the disk. */
+	int64_t epoch; /**< Second of the last entry written. -1 if none. */
+	tommy_hashdyn dirset; /**< Dirs already written in the current second. */
+	tommy_hashdyn allset; /**< Dirs already written from the base position. */
+
+	/* nodes for data structures */
+	tommy_node node;
+};
+
+static void watch_write(struct snapraid_watcher* watcher, const char* text, size_t len)
+{
+	if (write(watcher->f, text, len) != (ssize_t)len) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error writing the change log '%s'. %s.\n", watcher->path, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	watcher->size += len;
+}
+
+/**
+ * Forget all the dirs written.
+ */
+static void watch_forget(struct snapraid_watcher* watcher)
+{
+	tommy_hashdyn_foreach(&watcher->dirset, (tommy_foreach_func*)watch_dir_free);
+	tommy_hashdyn_done(&watcher->dirset);
+	tommy_hashdyn_init(&watcher->dirset);
+}
+
+/**
+ * Report that some changes were lost.
+ */
+static void watch_overflow(struct snapraid_watcher* watcher)
+{
+	watch_write(watcher, "o\n", 2);
+
+	/* the scan restarts after the 'o' entry, so report again everything */
+	watch_forget(watcher);
+	watcher->epoch = -1;
+
+	/* the dirs written before are not enough anymore to continue the session */
+	tommy_hashdyn_foreach(&watcher->allset, (tommy_foreach_func*)watch_dir_free);
+	tommy_hashdyn_done(&watcher->allset);
+	tommy_hashdyn_init(&watcher->allset);
+	watcher->base = watcher->size;
+}
+
+static void watch_compact_dir(void* void_arg, void* void_data)
+{
+	struct snapraid_watcher* watcher = void_arg;
+	struct snapraid_watch_dir* dir = void_data;
+	char buf[PATH_MAX + 32];
+	size_t len;
+
+	len = snprintf(buf, sizeof(buf), "d%s\n", dir->sub);
+	watch_write(watcher, buf, len);
+}
+
+/**
+ * Compact the change log.
+ *
+ * The new change log has a new session, continuing the current one,
+ * and reports only once all the dirs written from the base position.
+ * It's written in a temporary file, and then renamed over the old one,
+ * so a scan sees always a complete log.
+ */
+static void watch_compact(struct snapraid_watcher* watcher)
+{
+	char session[WATCH_SESSION_MAX];
+	char header[WATCH_SESSION_MAX * 2 + 64];
+	size_t len;
+	int old;
+	int f;
+
+	f = open(watcher->temp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_BINARY, 0600);
+	if (f == -1) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error creating the change log '%s'. %s.\n", watcher->temp, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* lock it before it replaces the old one */
+	if (flock(f, LOCK_EX | LOCK_NB) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error locking the change log '%s'. %s.\n", watcher->temp, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	++watcher->compact;
+	snprintf(session, sizeof(session), "%" PRIi64 "-%u-%u", (int64_t)time(0), (unsigned)getpid(), watcher->compact);
+	len = snprintf(header, sizeof(header), "%ss%s\nc%s %" PRIu64 "\n", WATCH_HEADER, session, watcher->session, watcher->base);
+
+	old = watcher->f;
+	watcher->f = f;
+	watcher->size = 0;
+
+	watch_write(watcher, header, len);
+	watcher->base = watcher->size;
+	tommy_hashdyn_foreach_arg(&watcher->allset, watch_compact_dir, watcher);
+
+	if (rename(watcher->temp, watcher->path) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error renaming the change log '%s' to '%s'. %s.\n", watcher->temp, watcher->path, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* release the lock of the old one only after the rename */
+	close(old);
+
+	pathcpy(watcher->session, sizeof(watcher->session), session);
+
+	/* the next 'e' entry starts again to report the dirs */
+	watch_forget(watcher);
+	watcher->epoch = -1;
+
+	/* don't compact again until the log doubles */
+	watcher->limit = watcher->size * 2;
+	if (watcher->limit < WATCH_COMPACT_SIZE)
+		watcher->limit = WATCH_COMPACT_SIZE;
+
+	msg_verbose("Compacted the change log '%s'\n", watcher->path);
+}
+
+/**
+ * Report a changed dir.
+ */
+static void watch_change(struct snapraid_watcher* watcher, const char* sub, int64_t now)
+{
+	char buf[PATH_MAX + 32];
+	size_t len;
+
+	/* a name with a new line cannot be written in the log */
+	if (strchr(sub, '\n') != 0) {
+		/* LCOV_EXCL_START */
+		watch_overflow(watcher);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* at every new second, report again all the dirs */
+	if (now != watcher->epoch) {
+		watch_forget(watcher);
+		watcher->epoch = now;
+
+		len = snprintf(buf, sizeof(buf), "e%" PRIi64 "\n", now);
+		watch_write(watcher, buf, len);
+	}
+
+	if (watch_is_changed(&watcher->dirset, sub))
+		return;
+
+	watch_dir_insert(&watcher->dirset, sub, strlen(sub));
+	watch_dir_insert(&watcher->allset, sub, strlen(sub));
+
+	len = snprintf(buf, sizeof(buf), "d%s\n", sub);
+	watch_write(watcher, buf, len);
+}
+
+/**
+ * Process a single event.
+ */
+static void watch_event(tommy_list* watcherlist, struct fanotify_event_metadata* meta, int64_t now)
+{
+	struct fanotify_event_info_fid* info;
+	struct file_handle* handle;
+	struct snapraid_watcher* owner;
+	const char* name;
+	char proc[64];
+	char dir[PATH_MAX];
+	char path[PATH_MAX];
+	tommy_node* i;
+	ssize_t len;
+	int f;
+
+	/* if the queue overflowed, all the disks have lost changes */
+	if ((meta->mask & FAN_Q_OVERFLOW) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Too many changes. Next scan will be a full one.\n");
+		for (i = tommy_list_head(watcherlist); i != 0; i = i->next)
+			watch_overflow(i->data);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	info = (struct fanotify_event_info_fid*)(meta + 1);
+	if ((char*)info + sizeof(*info) > (char*)meta + meta->event_len)
+		return;
+
+	if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+		handle = (struct file_handle*)info->handle;
+		name = (const char*)(handle->f_handle + handle->handle_bytes);
+	} else if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID) {
+		handle = (struct file_handle*)info->handle;
+		name = "";
+	} else {
+		return;
+	}
+
+	/* search a disk in the same filesystem */
+	owner = 0;
+	for (i = tommy_list_head(watcherlist); i != 0; i = i->next) {
+		struct snapraid_watcher* watcher = i->data;
+		if (memcmp(&watcher->fsid, &info->fsid, sizeof(watcher->fsid)) == 0) {
+			owner = watcher;
+			break;
+		}
+	}
+	if (!owner)
+		return;
+
+	/* get the path of the dir containing the changed entry */
+	f = open_by_handle_at(owner->mount_f, handle, O_PATH);
+	if (f == -1) {
+		/* if the dir is already deleted, its parent has its own event */
+		if (errno == ESTALE)
+			return;
+		/* LCOV_EXCL_START */
+		log_fatal("Error opening a file handle. %s.\n", strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	snprintf(proc, sizeof(proc), "/proc/self/fd/%d", f);
+	len = readlink(proc, dir, sizeof(dir) - 2);
+	close(f);
+	if (len < 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error in readlink file '%s'. %s.\n", proc, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+	dir[len] = 0;
+
+	/* a dir removed while processing the event */
+	if (len >= 10 && strcmp(dir + len - 10, " (deleted)") == 0)
+		return;
+
+	pathslash(dir, sizeof(dir));
+	pathprint(path, sizeof(path), "%s%s", dir, name);
+
+	/* ignore the changes of the change logs */
+	for (i = tommy_list_head(watcherlist); i != 0; i = i->next) {
+		struct snapraid_watcher* watcher = i->data;
+		if (strcmp(watcher->path, path) == 0 || strcmp(watcher->temp, path) == 0)
+			return;
+	}
+
+	/* report the dir to all the disks containing it */
+	for (i = tommy_list_head(watcherlist); i != 0; i = i->next) {
+		struct snapraid_watcher* watcher = i->data;
+		if (strncmp(dir, watcher->dir, watcher->dir_len) == 0)
+			watch_change(watcher, dir + watcher->dir_len, now);
+	}
+}
+
+void state_watch(struct snapraid_state* state)
+{
+	char session[WATCH_SESSION_MAX];
+	char header[WATCH_SESSION_MAX + 32];
+	tommy_list watcherlist;
+	tommy_node* i;
+	void* buf;
+	int fan;
+	size_t len;
+
+	fan = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME, O_RDONLY | O_LARGEFILE);
+	if (fan == -1) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error initializing fanotify. %s.\n", strerror(errno));
+		log_fatal("The watch command requires root privileges, and Linux 5.9 or newer.\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* a different session for every start */
+	snprintf(session, sizeof(session), "%" PRIi64 "-%u", (int64_t)time(0), (unsigned)getpid());
+	len = snprintf(header, sizeof(header), "%ss%s\n", WATCH_HEADER, session);
+
+	tommy_list_init(&watcherlist);
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		struct snapraid_watcher* watcher;
+		struct statfs sfs;
+		char path[PATH_MAX];
+
+		if (disk->skip_access)
+			continue;
+
+		watcher = malloc_nofail(sizeof(struct snapraid_watcher));
+		watcher->disk = disk;
+		watcher->epoch = -1;
+		watcher->compact = 0;
+		watcher->size = 0;
+		watcher->limit = WATCH_COMPACT_SIZE;
+		pathcpy(watcher->session, sizeof(watcher->session), session);
+		tommy_hashdyn_init(&watcher->dirset);
+		tommy_hashdyn_init(&watcher->allset);
+
+		if (realpath(disk->dir, watcher->dir) == 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error getting the real path of '%s'. %s.\n", disk->dir, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+		pathslash(watcher->dir, sizeof(watcher->dir));
+		watcher->dir_len = strlen(watcher->dir);
+
+		watcher->mount_f = open(disk->dir, O_RDONLY | O_DIRECTORY);
+		if (watcher->mount_f == -1) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error opening directory '%s'. %s.\n", disk->dir, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (fstatfs(watcher->mount_f, &sfs) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error accessing disk '%s' to get filesystem info. %s.\n", disk->dir, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+		memcpy(&watcher->fsid, &sfs.f_fsid, sizeof(watcher->fsid));
+
+		/* watch the whole filesystem, the events outside the disk dir are ignored */
+		if (fanotify_mark(fan, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, WATCH_EVENT_MASK, AT_FDCWD, disk->dir) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error watching disk '%s'. %s.\n", disk->dir, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		watch_path(state, disk, path, sizeof(path));
+
+		watcher->f = open(path, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0600);
+		if (watcher->f == -1) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error creating the change log '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* the lock is kept until the end, signaling that the log is updated */
+		if (flock(watcher->f, LOCK_EX | LOCK_NB) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("The change log '%s' is already locked!\n", path);
+			log_fatal("Another watch command is already running!\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (ftruncate(watcher->f, 0) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error truncating the change log '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (realpath(path, watcher->path) == 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error getting the real path of '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		pathprint(watcher->temp, sizeof(watcher->temp), "%s.tmp", watcher->path);
+
+		watch_write(watcher, header, len);
+		watcher->base = watcher->size;
+
+		tommy_list_insert_tail(&watcherlist, &watcher->node, watcher);
+
+		msg_verbose("Watching disk %s in '%s'\n", disk->name, watcher->path);
+	}
+
+	msg_progress("Watching...\n");
+
+	buf = malloc_nofail(WATCH_EVENT_SIZE);
+
+	/* terminates only with a signal, the locks are released by the kernel */
+	while (1) {
+		struct fanotify_event_metadata* meta;
+		ssize_t ret;
+		int64_t now;
+
+		ret = read(fan, buf, WATCH_EVENT_SIZE);
+		if (ret < 0) {
+			/* LCOV_EXCL_START */
+			if (errno == EINTR)
+				continue;
+			log_fatal("Error reading the fanotify events. %s.\n", strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		now = time(0);
+
+		for (meta = buf; FAN_EVENT_OK(meta, ret); meta = FAN_EVENT_NEXT(meta, ret)) {
+			if (meta->vers != FANOTIFY_METADATA_VERSION) {
+				/* LCOV_EXCL_START */
+				log_fatal("Unsupported fanotify version %u.\n", (unsigned)meta->vers);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			watch_event(&watcherlist, meta, now);
+		}
+
+		/* compact the change logs grown too much */
+		for (i = tommy_list_head(&watcherlist); i != 0; i = i->next) {
+			struct snapraid_watcher* watcher = i->data;
+			if (watcher->size >= watcher->limit)
+				watch_compact(watcher);
+		}
+	}
+}
+
+#else
+
+void state_watch(struct snapraid_state* state)
+{
+	(void)state;
+
+	/* LCOV_EXCL_START */
+	log_fatal("The watch command is not supported in this platform.\n");
+	exit(EXIT_FAILURE);
+	/* LCOV_EXCL_STOP */
+}
+
+#endif
+
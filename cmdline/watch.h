@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WATCH_H
+#define __WATCH_H
+
+#include "elem.h"
+#include "state.h"
+
+/****************************************************************************/
+/* watch */
+
+/**
+ * Changed dir.
+ * Dir reported as changed in the change log of the watcher.
+ */
+struct snapraid_watch_dir {
+	char* sub; /**< Sub path of the dir. Without the disk dir. Empty for the disk root. */
+
+	/* nodes for data structures */
+	tommy_hashdyn_node node;
+};
+
+/**
+ * Load the dirs changed from the change log of the disk.
+ *
+ * The change log is read from the position saved in the disk, and the position
+ * and session of the change log are updated for the next time.
+ * Return 0 if the change log is complete, and all the changed dirs are inserted in dirset.
+ * Return -1 if it's missing or incomplete, and a full scan of the disk is required.
+ */
+int watch_load(struct snapraid_state* state, struct snapraid_disk* disk, tommy_hashdyn* dirset);
+
+/**
+ * Check if a dir is reported as changed.
+ */
+int watch_is_changed(tommy_hashdyn* dirset, const char* sub);
+
+/**
+ * Deallocate all the dirs loaded.
+ */
+void watch_done(tommy_hashdyn* dirset);
+
+#endif
+
@@ -0,0 +1,582 @@
+/*
+ * Copyright (C) 2025 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Derivative work from xxhash.h v0.8
+ *
+ * xxHash - Extremely Fast Hash algorithm
+ * https://github.com/Cyan4973/xxHash
+ *
+ * This is the XXH3_128bits_withSeed() function, with the 128 bits seed
+ * of SnapRAID folded to the 64 bits seed of XXH3 as seed[0..7] ^ seed[8..15].
+ * The digest is stored as low64 and high64, both in little endian.
+ *
+ * The inner loop of long inputs works on eight independent 64 bits lanes
+ * with only 32x32->64 multiplications, and it's processed with AVX2
+ * if the CPU supports it, with SSE2 when compiled for it, or with plain C.
+ */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * The AVX2 version is compiled with the target attribute, and selected
+ * at runtime with the hash_avx2 flag.
+ */
+#if HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+ * xxHash - Extremely Fast Hash algorithm
+ * Copyright (C) 2012-2021 Yann Collet
+ *
+ * BSD 2-Clause License (https://www.opensource.org/licenses/bsd-license.php)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH_SECRET_SIZE 192
+#define XXH_SECRET_SIZE_MIN 136
+#define XXH_STRIPE_LEN 64
+#define XXH_SECRET_CONSUME_RATE 8
+#define XXH_ACC_NB 8
+#define XXH_SECRET_LASTACC_START 7
+#define XXH_SECRET_MERGEACCS_START 11
+#define XXH_MIDSIZE_MAX 240
+#define XXH_MIDSIZE_STARTOFFSET 3
+#define XXH_MIDSIZE_LASTOFFSET 17
+
+static const uint8_t XXH3_kSecret[XXH_SECRET_SIZE] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline uint32_t xxh_read32(const uint8_t* ptr)
+{
+	uint32_t v;
+
+	memcpy(&v, ptr, sizeof(v));
+#if WORDS_BIGENDIAN
+	v = util_swap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t xxh_read64(const uint8_t* ptr)
+{
+	uint64_t v;
+
+	memcpy(&v, ptr, sizeof(v));
+#if WORDS_BIGENDIAN
+	v = util_swap64(v);
+#endif
+	return v;
+}
+
+static inline void xxh_write64(uint8_t* ptr, uint64_t v)
+{
+#if WORDS_BIGENDIAN
+	v = util_swap64(v);
+#endif
+	memcpy(ptr, &v, sizeof(v));
+}
+
+static inline uint64_t xxh_mult32to64(uint64_t a, uint64_t b)
+{
+	return (uint64_t)(uint32_t)a * (uint64_t)(uint32_t)b;
+}
+
+/**
+ * Full 64x64->128 multiplication.
+ */
+static inline void xxh_mult64to128(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t)a * b;
+	*lo = (uint64_t)r;
+	*hi = (uint64_t)(r >> 64);
+#else
+	uint64_t lo_lo = xxh_mult32to64(a & 0xFFFFFFFF, b & 0xFFFFFFFF);
+	uint64_t hi_lo = xxh_mult32to64(a >> 32, b & 0xFFFFFFFF);
+	uint64_t lo_hi = xxh_mult32to64(a & 0xFFFFFFFF, b >> 32);
+	uint64_t hi_hi = xxh_mult32to64(a >> 32, b >> 32);
+	uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+	*hi = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+	*lo = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+#endif
+}
+
+static inline uint64_t xxh_mul128_fold64(uint64_t a, uint64_t b)
+{
+	uint64_t lo, hi;
+
+	xxh_mult64to128(a, b, &lo, &hi);
+
+	return lo ^ hi;
+}
+
+static inline uint64_t xxh_xorshift64(uint64_t v, int shift)
+{
+	return v ^ (v >> shift);
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+static inline uint64_t xxh3_avalanche(uint64_t h)
+{
+	h = xxh_xorshift64(h, 37);
+	h *= XXH_PRIME_MX1;
+	h = xxh_xorshift64(h, 32);
+	return h;
+}
+
+static void xxh3_len_1to3(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed, uint64_t* h)
+{
+	uint8_t b1 = input[0];
+	uint8_t b2 = input[len >> 1];
+	uint8_t b3 = input[len - 1];
+	uint32_t combinedl = ((uint32_t)b1 << 16) | ((uint32_t)b2 << 24) | ((uint32_t)b3 << 0) | ((uint32_t)len << 8);
+	uint32_t combinedh = util_rotl32(util_swap32(combinedl), 13);
+	uint64_t bitflipl = (xxh_read32(secret) ^ xxh_read32(secret + 4)) + seed;
+	uint64_t bitfliph = (xxh_read32(secret + 8) ^ xxh_read32(secret + 12)) - seed;
+
+	h[0] = xxh64_avalanche((uint64_t)combinedl ^ bitflipl);
+	h[1] = xxh64_avalanche((uint64_t)combinedh ^ bitfliph);
+}
+
+static void xxh3_len_4to8(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed, uint64_t* h)
+{
+	uint32_t input_lo;
+	uint32_t input_hi;
+	uint64_t input_64;
+	uint64_t bitflip;
+	uint64_t lo, hi;
+
+	seed ^= (uint64_t)util_swap32((uint32_t)seed) << 32;
+
+	input_lo = xxh_read32(input);
+	input_hi = xxh_read32(input + len - 4);
+	input_64 = input_lo + ((uint64_t)input_hi << 32);
+	bitflip = (xxh_read64(secret + 16) ^ xxh_read64(secret + 24)) + seed;
+
+	xxh_mult64to128(input_64 ^ bitflip, XXH_PRIME64_1 + (len << 2), &lo, &hi);
+
+	hi += lo << 1;
+	lo ^= hi >> 3;
+
+	lo = xxh_xorshift64(lo, 35);
+	lo *= XXH_PRIME_MX2;
+	lo = xxh_xorshift64(lo, 28);
+
+	h[0] = lo;
+	h[1] = xxh3_avalanche(hi);
+}
+
+static void xxh3_len_9to16(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed, uint64_t* h)
+{
+	uint64_t bitflipl = (xxh_read64(secret + 32) ^ xxh_read64(secret + 40)) - seed;
+	uint64_t bitfliph = (xxh_read64(secret + 48) ^ xxh_read64(secret + 56)) + seed;
+	uint64_t input_lo = xxh_read64(input);
+	uint64_t input_hi = xxh_read64(input + len - 8);
+	uint64_t m_lo, m_hi;
+	uint64_t lo, hi;
+
+	xxh_mult64to128(input_lo ^ input_hi ^ bitflipl, XXH_PRIME64_1, &m_lo, &m_hi);
+
+	m_lo += (uint64_t)(len - 1) << 54;
+	input_hi ^= bitfliph;
+
+	/* the 32 bits and 64 bits variants of the reference give the same result */
+	m_hi += input_hi + xxh_mult32to64((uint32_t)input_hi, XXH_PRIME32_2 - 1);
+
+	m_lo ^= util_swap64(m_hi);
+
+	/* 128x64 multiplication */
+	xxh_mult64to128(m_lo, XXH_PRIME64_2, &lo, &hi);
+	hi += m_hi * XXH_PRIME64_2;
+
+	h[0] = xxh3_avalanche(lo);
+	h[1] = xxh3_avalanche(hi);
+}
+
+static void xxh3_len_0to16(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed, uint64_t* h)
+{
+	if (len > 8) {
+		xxh3_len_9to16(input, len, secret, seed, h);
+	} else if (len >= 4) {
+		xxh3_len_4to8(input, len, secret, seed, h);
+	} else if (len != 0) {
+		xxh3_len_1to3(input, len, secret, seed, h);
+	} else {
+		h[0] = xxh64_avalanche(seed ^ xxh_read64(secret + 64) ^ xxh_read64(secret + 72));
+		h[1] = xxh64_avalanche(seed ^ xxh_read64(secret + 80) ^ xxh_read64(secret + 88));
+	}
+}
+
+static inline uint64_t xxh3_mix16(const uint8_t* input, const uint8_t* secret, uint64_t seed)
+{
+	uint64_t input_lo = xxh_read64(input);
+	uint64_t input_hi = xxh_read64(input + 8);
+
+	return xxh_mul128_fold64(
+		input_lo ^ (xxh_read64(secret) + seed),
+		input_hi ^ (xxh_read64(secret + 8) - seed)
+	);
+}
+
+static inline void xxh3_mix32(uint64_t* acc, const uint8_t* input_1, const uint8_t* input_2, const uint8_t* secret, uint64_t seed)
+{
+	acc[0] += xxh3_mix16(input_1, secret, seed);
+	acc[0] ^= xxh_read64(input_2) + xxh_read64(input_2 + 8);
+	acc[1] += xxh3_mix16(input_2, secret + 16, seed);
+	acc[1] ^= xxh_read64(input_1) + xxh_read64(input_1 + 8);
+}
+
+static inline void xxh3_mid_final(const uint64_t* acc, size_t len, uint64_t seed, uint64_t* h)
+{
+	uint64_t lo = acc[0] + acc[1];
+	uint64_t hi = (acc[0] * XXH_PRIME64_1) + (acc[1] * XXH_PRIME64_4) + ((len - seed) * XXH_PRIME64_2);
+
+	h[0] = xxh3_avalanche(lo);
+	h[1] = (uint64_t)0 - xxh3_avalanche(hi);
+}
+
+static void xxh3_len_17to128(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed, uint64_t* h)
+{
+	uint64_t acc[2];
+
+	acc[0] = len * XXH_PRIME64_1;
+	acc[1] = 0;
+
+	if (len > 32) {
+		if (len > 64) {
+			if (len > 96)
+				xxh3_mix32(acc, input + 48, input + len - 64, secret + 96, seed);
+			xxh3_mix32(acc, input + 32, input + len - 48, secret + 64, seed);
+		}
+		xxh3_mix32(acc, input + 16, input + len - 32, secret + 32, seed);
+	}
+	xxh3_mix32(acc, input, input + len - 16, secret, seed);
+
+	xxh3_mid_final(acc, len, seed, h);
+}
+
+static void xxh3_len_129to240(const uint8_t* input, size_t len, const uint8_t* secret, uint64_t seed, uint64_t* h)
+{
+	uint64_t acc[2];
+	size_t i;
+
+	acc[0] = len * XXH_PRIME64_1;
+	acc[1] = 0;
+
+	for (i = 32; i < 160; i += 32)
+		xxh3_mix32(acc, input + i - 32, input + i - 16, secret + i - 32, seed);
+
+	acc[0] = xxh3_avalanche(acc[0]);
+	acc[1] = xxh3_avalanche(acc[1]);
+
+	for (i = 160; i <= len; i += 32)
+		xxh3_mix32(acc, input + i - 32, input + i - 16, secret + XXH_MIDSIZE_STARTOFFSET + i - 160, seed);
+
+	xxh3_mix32(acc, input + len - 16, input + len - 32, secret + XXH_SECRET_SIZE_MIN - XXH_MIDSIZE_LASTOFFSET - 16, (uint64_t)0 - seed);
+
+	xxh3_mid_final(acc, len, seed, h);
+}
+
+/**
+ * Process a stripe of 64 bytes.
+ *
+ * The eight lanes are independent, two for each SSE2 register.
+ */
+static inline void xxh3_accumulate_512(uint64_t* acc, const uint8_t* input, const uint8_t* secret)
+{
+#if defined(__SSE2__)
+	unsigned i;
+
+	for (i = 0; i < XXH_ACC_NB / 2; ++i) {
+		__m128i acc_vec = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+		__m128i data_vec = _mm_loadu_si128((const __m128i*)(input + 16 * i));
+		__m128i key_vec = _mm_loadu_si128((const __m128i*)(secret + 16 * i));
+		__m128i data_key = _mm_xor_si128(data_vec, key_vec);
+		__m128i data_key_lo = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i product = _mm_mul_epu32(data_key, data_key_lo);
+		/* swap adjacent lanes */
+		__m128i data_swap = _mm_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+		acc_vec = _mm_add_epi64(acc_vec, data_swap);
+		acc_vec = _mm_add_epi64(acc_vec, product);
+		_mm_storeu_si128((__m128i*)(acc + 2 * i), acc_vec);
+	}
+#else
+	uint64_t data_val[XXH_ACC_NB];
+	uint64_t data_key[XXH_ACC_NB];
+	unsigned i;
+
+	for (i = 0; i < XXH_ACC_NB; ++i) {
+		data_val[i] = xxh_read64(input + i * 8);
+		data_key[i] = data_val[i] ^ xxh_read64(secret + i * 8);
+	}
+
+	for (i = 0; i < XXH_ACC_NB; ++i) {
+		/* swap adjacent lanes */
+		acc[i] += data_val[i ^ 1] + xxh_mult32to64(data_key[i], data_key[i] >> 32);
+	}
+#endif
+}
+
+static inline void xxh3_scramble(uint64_t* acc, const uint8_t* secret)
+{
+#if defined(__SSE2__)
+	const __m128i prime32 = _mm_set1_epi32((int)XXH_PRIME32_1);
+	unsigned i;
+
+	for (i = 0; i < XXH_ACC_NB / 2; ++i) {
+		__m128i acc_vec = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+		__m128i key_vec = _mm_loadu_si128((const __m128i*)(secret + 16 * i));
+		__m128i data_key;
+		__m128i data_key_hi;
+		__m128i prod_lo;
+		__m128i prod_hi;
+
+		acc_vec = _mm_xor_si128(acc_vec, _mm_srli_epi64(acc_vec, 47));
+		data_key = _mm_xor_si128(acc_vec, key_vec);
+		data_key_hi = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+		prod_lo = _mm_mul_epu32(data_key, prime32);
+		prod_hi = _mm_mul_epu32(data_key_hi, prime32);
+		acc_vec = _mm_add_epi64(prod_lo, _mm_slli_epi64(prod_hi, 32));
+		_mm_storeu_si128((__m128i*)(acc + 2 * i), acc_vec);
+	}
+#else
+	unsigned i;
+
+	for (i = 0; i < XXH_ACC_NB; ++i) {
+		uint64_t acc64 = acc[i];
+		acc64 = xxh_xorshift64(acc64, 47);
+		acc64 ^= xxh_read64(secret + i * 8);
+		acc64 *= XXH_PRIME32_1;
+		acc[i] = acc64;
+	}
+#endif
+}
+
+static uint64_t xxh3_merge(const uint64_t* acc, const uint8_t* secret, uint64_t start)
+{
+	uint64_t result = start;
+	unsigned i;
+
+	for (i = 0; i < 4; ++i)
+		result += xxh_mul128_fold64(acc[2 * i] ^ xxh_read64(secret + 16 * i), acc[2 * i + 1] ^ xxh_read64(secret + 16 * i + 8));
+
+	return xxh3_avalanche(result);
+}
+
+#define XXH_STRIPES_PER_BLOCK ((XXH_SECRET_SIZE - XXH_STRIPE_LEN) / XXH_SECRET_CONSUME_RATE)
+#define XXH_BLOCK_LEN (XXH_STRIPE_LEN * XXH_STRIPES_PER_BLOCK)
+
+static void xxh3_loop(uint64_t* acc, const uint8_t* input, size_t len, const uint8_t* secret)
+{
+	size_t nblocks = (len - 1) / XXH_BLOCK_LEN;
+	size_t nstripes;
+	size_t n, s;
+
+	/* full blocks */
+	for (n = 0; n < nblocks; ++n) {
+		const uint8_t* block = input + n * XXH_BLOCK_LEN;
+		for (s = 0; s < XXH_STRIPES_PER_BLOCK; ++s)
+			xxh3_accumulate_512(acc, block + s * XXH_STRIPE_LEN, secret + s * XXH_SECRET_CONSUME_RATE);
+		xxh3_scramble(acc, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);
+	}
+
+	/* last partial block */
+	nstripes = ((len - 1) - (XXH_BLOCK_LEN * nblocks)) / XXH_STRIPE_LEN;
+	for (s = 0; s < nstripes; ++s)
+		xxh3_accumulate_512(acc, input + nblocks * XXH_BLOCK_LEN + s * XXH_STRIPE_LEN, secret + s * XXH_SECRET_CONSUME_RATE);
+
+	/* last stripe */
+	xxh3_accumulate_512(acc, input + len - XXH_STRIPE_LEN, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - XXH_SECRET_LASTACC_START);
+}
+
+#if HAVE_AVX2
+/**
+ * Process a stripe of 64 bytes with AVX2.
+ *
+ * The eight lanes are kept in two AVX2 registers.
+ */
+static inline __attribute__((target("avx2"))) void xxh3_accumulate_512_avx2(__m256i* acc, const uint8_t* input, const uint8_t* secret)
+{
+	unsigned i;
+
+	for (i = 0; i < 2; ++i) {
+		__m256i data_vec = _mm256_loadu_si256((const __m256i*)(input + 32 * i));
+		__m256i key_vec = _mm256_loadu_si256((const __m256i*)(secret + 32 * i));
+		__m256i data_key = _mm256_xor_si256(data_vec, key_vec);
+		__m256i data_key_lo = _mm256_srli_epi64(data_key, 32);
+		__m256i product = _mm256_mul_epu32(data_key, data_key_lo);
+		/* swap adjacent lanes */
+		__m256i data_swap = _mm256_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm256_add_epi64(_mm256_add_epi64(acc[i], data_swap), product);
+	}
+}
+
+static inline __attribute__((target("avx2"))) void xxh3_scramble_avx2(__m256i* acc, const uint8_t* secret)
+{
+	const __m256i prime32 = _mm256_set1_epi32((int)XXH_PRIME32_1);
+	unsigned i;
+
+	for (i = 0; i < 2; ++i) {
+		__m256i acc_vec = acc[i];
+		__m256i key_vec = _mm256_loadu_si256((const __m256i*)(secret + 32 * i));
+		__m256i data_key;
+		__m256i prod_lo;
+		__m256i prod_hi;
+
+		acc_vec = _mm256_xor_si256(acc_vec, _mm256_srli_epi64(acc_vec, 47));
+		data_key = _mm256_xor_si256(acc_vec, key_vec);
+		prod_lo = _mm256_mul_epu32(data_key, prime32);
+		prod_hi = _mm256_mul_epu32(_mm256_srli_epi64(data_key, 32), prime32);
+		acc[i] = _mm256_add_epi64(prod_lo, _mm256_slli_epi64(prod_hi, 32));
+	}
+}
+
+static __attribute__((target("avx2"))) void xxh3_loop_avx2(uint64_t* acc, const uint8_t* input, size_t len, const uint8_t* secret)
+{
+	size_t nblocks = (len - 1) / XXH_BLOCK_LEN;
+	size_t nstripes;
+	size_t n, s;
+	__m256i vacc[2];
+
+	vacc[0] = _mm256_loadu_si256((const __m256i*)acc);
+	vacc[1] = _mm256_loadu_si256((const __m256i*)(acc + 4));
+
+	/* full blocks */
+	for (n = 0; n < nblocks; ++n) {
+		const uint8_t* block = input + n * XXH_BLOCK_LEN;
+		for (s = 0; s < XXH_STRIPES_PER_BLOCK; ++s)
+			xxh3_accumulate_512_avx2(vacc, block + s * XXH_STRIPE_LEN, secret + s * XXH_SECRET_CONSUME_RATE);
+		xxh3_scramble_avx2(vacc, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);
+	}
+
+	/* last partial block */
+	nstripes = ((len - 1) - (XXH_BLOCK_LEN * nblocks)) / XXH_STRIPE_LEN;
+	for (s = 0; s < nstripes; ++s)
+		xxh3_accumulate_512_avx2(vacc, input + nblocks * XXH_BLOCK_LEN + s * XXH_STRIPE_LEN, secret + s * XXH_SECRET_CONSUME_RATE);
+
+	/* last stripe */
+	xxh3_accumulate_512_avx2(vacc, input + len - XXH_STRIPE_LEN, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - XXH_SECRET_LASTACC_START);
+
+	_mm256_storeu_si256((__m256i*)acc, vacc[0]);
+	_mm256_storeu_si256((__m256i*)(acc + 4), vacc[1]);
+}
+#endif
+
+static void xxh3_long(const uint8_t* input, size_t len, uint64_t seed, uint64_t* h)
+{
+	uint64_t acc[XXH_ACC_NB] = {
+		XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+		XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1
+	};
+	uint8_t secret[XXH_SECRET_SIZE];
+	size_t n;
+
+	/* derive the secret from the seed */
+	for (n = 0; n < XXH_SECRET_SIZE; n += 16) {
+		xxh_write64(secret + n, xxh_read64(XXH3_kSecret + n) + seed);
+		xxh_write64(secret + n + 8, xxh_read64(XXH3_kSecret + n + 8) - seed);
+	}
+
+#if HAVE_AVX2
+	if (tommy_likely(hash_avx2))
+		xxh3_loop_avx2(acc, input, len, secret);
+	else
+		xxh3_loop(acc, input, len, secret);
+#else
+	xxh3_loop(acc, input, len, secret);
+#endif
+
+	h[0] = xxh3_merge(acc, secret + XXH_SECRET_MERGEACCS_START, (uint64_t)len * XXH_PRIME64_1);
+	h[1] = xxh3_merge(acc, secret + XXH_SECRET_SIZE - sizeof(acc) - XXH_SECRET_MERGEACCS_START, ~((uint64_t)len * XXH_PRIME64_2));
+}
+
+void XXH3Hash128(const void* data, size_t size, const uint8_t* seed, uint8_t* digest)
+{
+	const uint8_t* input = data;
+	uint64_t seed64 = xxh_read64(seed) ^ xxh_read64(seed + 8);
+	uint64_t h[2];
+
+	if (size <= 16)
+		xxh3_len_0to16(input, size, XXH3_kSecret, seed64, h);
+	else if (size <= 128)
+		xxh3_len_17to128(input, size, XXH3_kSecret, seed64, h);
+	else if (size <= XXH_MIDSIZE_MAX)
+		xxh3_len_129to240(input, size, XXH3_kSecret, seed64, h);
+	else
+		xxh3_long(input, size, seed64, h);
+
+	xxh_write64(digest, h[0]);
+	xxh_write64(digest + 8, h[1]);
+}
@@ -15,6 +15,7 @@
 #include "internal.h"
 #include "combo.h"
 #include "gf.h"
+#include "memory.h"
 
 /**
  * Validate the provided failed blocks.
@@ -160,16 +161,152 @@ int raid_check(int nr, int *ir, int nd, int np, size_t size, void **v)
 	return raid_validate(rd, ir, vp, ip, nd, size, v);
 }
 
+/**
+ * Locate a single failed block using the syndromes.
+ *
+ * The parity is recomputed once with the vectorized raid_gen() and xored
+ * with the stored one to get the syndromes S[l] for each parity l.
+ *
+ * If only the data block x has the error e in a byte position, it results
+ * S[l] = A(l,x) * e for all the parities, and x is identified by the
+ * ratio S[1] / S[0] = A(1,x) / A(0,x), that is unique for each data block
+ * because all the square submatrices of the generator matrix are not
+ * singular. If instead only the parity block l is failed, S[l] is the only
+ * not zero syndrome.
+ *
+ * All the byte positions with a not zero syndrome must point to the same
+ * block, otherwise it's not a single failure.
+ *
+ * It requires at least two parities.
+ *
+ * @ir[] Vector of 1 element filled with the index of the failed block.
+ * @return 1 if a single failed block is located, 0 if there is no
+ *   failure, -1 if it's not a single failure, -2 if the localization
+ *   is not possible.
+ */
+static int raid_locate(int *ir, int nd, int np, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	uint8_t *w[RAID_PARITY_MAX];
+	uint8_t map[256];
+	void *buffer;
+	void *freeptr;
+	void *t[RAID_DATA_MAX + RAID_PARITY_MAX];
+	int pos;
+	size_t i, k;
+	int j, l;
+
+	if (np < 2 || nd > RAID_DATA_MAX)
+		return -2;
+
+	/* map the ratio A(1,x) / A(0,x) to the data block x */
+	memset(map, 0, sizeof(map));
+	for (j = 0; j < nd; ++j)
+		map[gfmul[A(1, j)][inv(A(0, j))]] = j + 1;
+
+	buffer = raid_malloc_align(np * size, &freeptr);
+	if (!buffer) {
+		/* LCOV_EXCL_START */
+		return -2;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* recompute the parity in the buffer */
+	for (j = 0; j < nd; ++j)
+		t[j] = v[j];
+	for (l = 0; l < np; ++l) {
+		w[l] = (uint8_t *)buffer + l * size;
+		t[nd + l] = w[l];
+	}
+	raid_gen(nd, np, size, t);
+
+	/* compute the syndromes */
+	for (l = 0; l < np; ++l)
+		for (i = 0; i < size; i += sizeof(uint64_t))
+			v_64(w[l][i]) ^= v_64(v[nd + l][i]);
+
+	pos = -1;
+	for (i = 0; i < size; i += sizeof(uint64_t)) {
+		uint64_t z = 0;
+
+		/* skip quickly the positions without errors */
+		for (l = 0; l < np; ++l)
+			z |= v_64(w[l][i]);
+		if (z == 0)
+			continue;
+
+		for (k = i; k < i + sizeof(uint64_t); ++k) {
+			uint8_t S[RAID_PARITY_MAX];
+			int count;
+			int c;
+
+			count = 0;
+			c = 0;
+			for (l = 0; l < np; ++l) {
+				S[l] = w[l][k];
+				if (S[l] != 0) {
+					++count;
+					c = nd + l;
+				}
+			}
+
+			if (count == 0) {
+				continue;
+			} else if (count == np) {
+				uint8_t e;
+
+				/* failed data block */
+				c = map[gfmul[S[1]][inv(S[0])]] - 1;
+				if (c < 0)
+					goto bail;
+
+				/* the error is consistent in all the parities */
+				e = gfmul[S[0]][inv(A(0, c))];
+				for (l = 2; l < np; ++l)
+					if (gfmul[e][A(l, c)] != S[l])
+						goto bail;
+			} else if (count != 1) {
+				goto bail;
+			}
+
+			/* all the errors must be in the same block */
+			if (pos < 0)
+				pos = c;
+			else if (pos != c)
+				goto bail;
+		}
+	}
+
+	free(freeptr);
+
+	if (pos < 0)
+		return 0;
+
+	ir[0] = pos;
+	return 1;
+
+bail:
+	free(freeptr);
+	return -1;
+}
+
 int raid_scan(int *ir, int nd, int np, size_t size, void **v)
 {
 	int r;
+	int ret;
 
 	/* check the special case of no failure */
 	if (np != 0 && raid_check(0, 0, nd, np, size, v) == 0)
 		return 0;
 
+	/* locate directly a single failure, the most common case */
+	ret = raid_locate(ir, nd, np, size, v);
+	if (ret == 1)
+		return 1;
+
 	/* for each number of possible failures */
-	for (r = 1; r < np; ++r) {
+	/* if the localization excluded a single failure, start from two */
+	for (r = ret == -1 ? 2 : 1; r < np; ++r) {
 		/* try all combinations of r failures on n disks */
 		combination_first(r, nd + np, ir);
 		do {
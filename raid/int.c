@@ -383,32 +383,24 @@ void raid_gen6_int8(int nd, size_t size, void **vv)
  *
  * Dx = A[ip[0],id[0]]^-1 * Pd
  */
-void raid_rec1_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec1_int8(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
+	int *id = rr->id;
+	int *ip = rr->ip;
 	uint8_t *p;
 	uint8_t *pa;
 	const uint8_t *T;
-	uint8_t G;
-	uint8_t V;
 	size_t i;
 
-	(void)nr; /* unused, it's always 1 */
-
 	/* if it's RAID5 uses the faster function */
 	if (ip[0] == 0) {
 		raid_rec1of1(id, nd, size, vv);
 		return;
 	}
 
-	/* setup the coefficients matrix */
-	G = A(ip[0], id[0]);
-
-	/* invert it to solve the system of linear equations */
-	V = inv(G);
-
 	/* get multiplication tables */
-	T = table(V);
+	T = table(rr->V[0]);
 
 	/* compute delta parity */
 	raid_delta_gen(1, id, ip, nd, size, vv);
@@ -436,36 +428,27 @@ void raid_rec1_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
  *
  * we solve inverting the coefficients matrix.
  */
-void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec2_int8(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t *V = rr->V;
 	uint8_t *p;
 	uint8_t *pa;
 	uint8_t *q;
 	uint8_t *qa;
 	const int N = 2;
 	const uint8_t *T[N][N];
-	uint8_t G[N * N];
-	uint8_t V[N * N];
 	size_t i;
 	int j, k;
 
-	(void)nr; /* unused, it's always 2 */
-
 	/* if it's RAID6 recovering with P and Q uses the faster function */
 	if (ip[0] == 0 && ip[1] == 1) {
 		raid_rec2of2_int8(id, ip, nd, size, vv);
 		return;
 	}
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
-
 	/* get multiplication tables */
 	for (j = 0; j < N; ++j)
 		for (k = 0; k < N; ++k)
@@ -504,25 +487,19 @@ void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
  * PD[0] = Pd, PD[1] = Qd, PD[2] = Rd, ...
  * D[0] = Dx, D[1] = Dy, D[2] = Dz, ...
  */
-void raid_recX_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_recX_int8(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
+	int nr = rr->nr;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t *V = rr->V;
 	uint8_t *p[RAID_PARITY_MAX];
 	uint8_t *pa[RAID_PARITY_MAX];
 	const uint8_t *T[RAID_PARITY_MAX][RAID_PARITY_MAX];
-	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
-	uint8_t V[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	size_t i;
 	int j, k;
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < nr; ++j)
-		for (k = 0; k < nr; ++k)
-			G[j * nr + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, nr);
-
 	/* get multiplication tables */
 	for (j = 0; j < nr; ++j)
 		for (k = 0; k < nr; ++k)
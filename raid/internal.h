@@ -151,15 +151,15 @@ void raid_gen6_int8(int nd, size_t size, void **vv);
 void raid_gen6_ssse3(int nd, size_t size, void **vv);
 void raid_gen6_ssse3ext(int nd, size_t size, void **vv);
 void raid_gen6_avx2ext(int nd, size_t size, void **vv);
-void raid_rec1_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_recX_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec1_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec2_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_recX_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_recX_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_rec1_int8(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_rec2_int8(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_recX_int8(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_rec1_ssse3(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_rec2_ssse3(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_recX_ssse3(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_rec1_avx2(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_rec2_avx2(struct raid_rec *rr, int nd, size_t size, void **vv);
+void raid_recX_avx2(struct raid_rec *rr, int nd, size_t size, void **vv);
 
 /*
  * Internal naming.
@@ -177,6 +177,12 @@ const char *raid_rec1_tag(void);
 const char *raid_rec2_tag(void);
 const char *raid_recX_tag(void);
 
+/*
+ * Default minimum size of the data and parity read in recovering
+ * to use non-temporal stores.
+ */
+#define RAID_REC_NT_SIZE (8 * 1024 * 1024)
+
 /*
  * Internal forwarders.
  */
@@ -185,7 +191,7 @@ extern void (*raid_genz_ptr)(int nd, size_t size, void **vv);
 extern void (*raid_gen_ptr[RAID_PARITY_MAX])(
 	int nd, size_t size, void **vv);
 extern void (*raid_rec_ptr[RAID_PARITY_MAX])(
-	int nr, int *id, int *ip, int nd, size_t size, void **vv);
+	struct raid_rec *rr, int nd, size_t size, void **vv);
 
 /*
  * Tables.
@@ -198,6 +204,7 @@ extern const uint8_t raid_gfcauchy[6][256] __aligned(256);
 extern const uint8_t raid_gfcauchypshufb[251][4][2][16] __aligned(256);
 extern const uint8_t raid_gfmulpshufb[256][2][16] __aligned(256);
 extern const uint8_t (*raid_gfgen)[256];
+extern size_t raid_rec_nt_size;
 #define gfmul raid_gfmul
 #define gfexp raid_gfexp
 #define gfinv raid_gfinv
@@ -445,6 +445,30 @@ int raid_selftest(void)
 			goto bail;
 			/* LCOV_EXCL_STOP */
 		}
+
+		if (np >= 2) {
+			/* scan test with a single broken data */
+			ir[0] = nd - 1;
+			memset(v[ir[0]], 0x55, size);
+
+			ret = raid_test_scan(1, ir, nd, np, size, v, ref);
+			if (ret != 0) {
+				/* LCOV_EXCL_START */
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* scan test with a single broken parity */
+			ir[0] = nd + np - 1;
+			memset(v[ir[0]], 0x55, size);
+
+			ret = raid_test_scan(1, ir, nd, np, size, v, ref);
+			if (ret != 0) {
+				/* LCOV_EXCL_START */
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+		}
 	}
 
 	/* scan test with no parity */
@@ -184,6 +184,17 @@ void raid_mode(int mode)
 	}
 }
 
+/**
+ * Minimum size of the data and parity read in recovering to use
+ * non-temporal stores.
+ *
+ * The recovered data is usually read again just after, to check it, and
+ * it's better to keep it in the cache. Only when all the data and parity
+ * blocks of the stripe don't fit, the recovered data would be evicted
+ * anyway, and the kernels that support it write it bypassing the cache.
+ */
+size_t raid_rec_nt_size = RAID_REC_NT_SIZE;
+
 /**
  * Buffer filled with 0 used in recovering.
  */
@@ -472,17 +483,15 @@ void raid_rec2of2_int8(int *id, int *ip, int nd, size_t size, void **vv)
  * These functions recover data blocks using the specified parity
  * to recompute the missing data.
  *
- * Note that the format of vectors @id/@ip is different than raid_rec().
- * For example, in the vector @ip the first parity is represented with the
- * value 0 and not @nd.
+ * The blocks to recover and the parity to use are specified in the
+ * recovering context, that also contains the already inverted
+ * coefficients matrix.
  *
- * @nr Number of failed data blocks to recover.
- * @id[] Vector of @nr indexes of the data blocks to recover.
- *   The indexes start from 0. They must be in order.
- * @ip[] Vector of @nr indexes of the parity blocks to use in the recovering.
- *   The indexes start from 0. They must be in order.
+ * The number of failed data blocks to recover is implicit in the position
+ * in the forwarder vector. Position at index #i, recovers (#i+1) blocks.
+ *
+ * @rr Recovering context initialized with raid_rec_init().
  * @nd Number of data blocks.
- * @np Number of parity blocks.
  * @size Size of the blocks pointed by @v. It must be a multipler of 64.
  * @v Vector of pointers to the blocks of data and parity.
  *   It has (@nd + @np) elements. The starting elements are the blocks
@@ -490,7 +499,45 @@ void raid_rec2of2_int8(int *id, int *ip, int nd, size_t size, void **vv)
  *   Each block has @size bytes.
  */
 void (*raid_rec_ptr[RAID_PARITY_MAX])(
-	int nr, int *id, int *ip, int nd, size_t size, void **vv);
+	struct raid_rec *rr, int nd, size_t size, void **vv);
+
+void raid_rec_init(struct raid_rec *rr, int nr, int *id, int *ip)
+{
+	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
+	int j, k;
+
+	/* enforce limit on number of failures */
+	BUG_ON(nr < 1);
+	BUG_ON(nr > RAID_PARITY_MAX);
+
+	rr->nr = nr;
+	for (j = 0; j < nr; ++j) {
+		rr->id[j] = id[j];
+		rr->ip[j] = ip[j];
+	}
+
+	/* setup the coefficients matrix */
+	for (j = 0; j < nr; ++j)
+		for (k = 0; k < nr; ++k)
+			G[j * nr + k] = A(ip[j], id[k]);
+
+	/* invert it to solve the system of linear equations */
+	raid_invert(G, rr->V, nr);
+}
+
+void raid_rec_data(struct raid_rec *rr, int nd, size_t size, void **v)
+{
+	/* enforce limit on size */
+	BUG_ON(size % 64 != 0);
+
+	/* enforce limit on number of failures */
+	BUG_ON(rr->nr > nd);
+
+	/* enforce limit on index vector for data */
+	BUG_ON(rr->id[rr->nr - 1] >= nd);
+
+	raid_rec_ptr[rr->nr - 1](rr, nd, size, v);
+}
 
 void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v)
 {
@@ -531,6 +578,8 @@ void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v)
 		int ip[RAID_PARITY_MAX];
 		int i, j, k;
 
+		struct raid_rec rr;
+
 		/* setup the vector of parities to use */
 		for (i = 0, j = 0, k = 0; i < np; ++i) {
 			if (j < nrp && ir[nrd + j] == nd + i) {
@@ -545,7 +594,8 @@ void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v)
 
 		/* recover the nrd data blocks specified in ir[], */
 		/* using the first nrd parity in ip[] for recovering */
-		raid_rec_ptr[nrd - 1](nrd, ir, ip, nd, size, v);
+		raid_rec_init(&rr, nrd, ir, ip);
+		raid_rec_ptr[nrd - 1](&rr, nd, size, v);
 	}
 
 	/* recompute all the parities up to the last bad one */
@@ -580,7 +630,11 @@ void raid_data(int nr, int *id, int *ip, int nd, size_t size, void **v)
 	BUG_ON(nr >= 6 && ip[4] >= ip[5]);
 
 	/* if failed data is present */
-	if (nr != 0)
-		raid_rec_ptr[nr - 1](nr, id, ip, nd, size, v);
+	if (nr != 0) {
+		struct raid_rec rr;
+
+		raid_rec_init(&rr, nr, id, ip);
+		raid_rec_ptr[nr - 1](&rr, nd, size, v);
+	}
 }
 
@@ -158,6 +158,56 @@ void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v);
  */
 void raid_data(int nr, int *id, int *ip, int nd, size_t size, void **v);
 
+/**
+ * Recovering context.
+ *
+ * It keeps the inverted coefficients matrix of a specific combination of
+ * failed data blocks and parity blocks used for recovering.
+ *
+ * Use it when the same combination has to be recovered for many blocks,
+ * to avoid to compute the matrix again for each one.
+ *
+ * The context is valid until the next raid_mode() call.
+ * You should not access the fields directly.
+ */
+struct raid_rec {
+	int nr; /**< Number of failed data blocks to recover. */
+	int id[RAID_PARITY_MAX]; /**< Indexes of the data blocks to recover. */
+	int ip[RAID_PARITY_MAX]; /**< Indexes of the parity blocks to use. */
+	unsigned char V[RAID_PARITY_MAX * RAID_PARITY_MAX]; /**< Inverted matrix. */
+};
+
+/**
+ * Initializes a recovering context for data blocks.
+ *
+ * It computes the inverted coefficients matrix to recover the data blocks
+ * in the @id vector using the parity blocks in the @ip vector.
+ *
+ * @rr Recovering context to initialize.
+ * @nr Number of failed data blocks to recover.
+ * @id[] Vector of @nr indexes of the data blocks to recover.
+ *   The indexes start from 0. They must be in order.
+ * @ip[] Vector of @nr indexes of the parity blocks to use for recovering.
+ *   The indexes start from 0. They must be in order.
+ */
+void raid_rec_init(struct raid_rec *rr, int nr, int *id, int *ip);
+
+/**
+ * Recovers failures in data blocks only, using a recovering context.
+ *
+ * It's equivalent at raid_data() with the @nr, @id and @ip arguments
+ * used to initialize the context with raid_rec_init().
+ *
+ * @rr Recovering context.
+ * @nd Number of data blocks.
+ * @size Size of the blocks pointed by @v. It must be a multiplier of 64.
+ * @v Vector of pointers to the blocks of data and parity.
+ *   It has (@nd + @ip[@nr - 1] + 1) elements. The starting elements are the
+ *   blocks for data, following with the parity blocks.
+ *   Each blocks has @size bytes.
+ */
+void raid_rec_data(struct raid_rec *rr, int nd, size_t size, void **v);
+
 /**
  * Check the provided failed blocks combination.
  *
@@ -200,6 +250,9 @@ int raid_check(int nr, int *ir, int nd, int np, size_t size, void **v);
  * (           )
  * (  @np - 1  )
  *
+ * A single failed block is instead located directly from the syndromes,
+ * with a single parity computation, without trying all the combinations.
+ *
  * No data or parity blocks are modified.
  *
  * The failed block indexes are returned in the @ir vector.
@@ -146,7 +146,7 @@ int raid_test_sort(void)
 int raid_test_rec(int mode, int nd, size_t size)
 {
 	void (*f[RAID_PARITY_MAX][4])(
-		int nr, int *id, int *ip, int nd, size_t size, void **vbuf);
+		struct raid_rec *rr, int nd, size_t size, void **vbuf);
 	void *v_alloc;
 	void **v;
 	void **data;
@@ -158,9 +158,11 @@ int raid_test_rec(int mode, int nd, size_t size)
 	int nv;
 	int id[RAID_PARITY_MAX];
 	int ip[RAID_PARITY_MAX];
+	struct raid_rec rr;
 	int i;
 	int j;
 	int nr;
+	int nt;
 	int nf[RAID_PARITY_MAX];
 	int np;
 
@@ -243,55 +245,68 @@ int raid_test_rec(int mode, int nd, size_t size)
 	for (i = 0; i < np; ++i)
 		parity[i] = waste;
 
-	/* all parity levels */
-	for (nr = 1; nr <= np; ++nr) {
-		/* all combinations (nr of nd) disks */
-		combination_first(nr, nd, id);
-		do {
-			/* all combinations (nr of np) parities */
-			combination_first(nr, np, ip);
+	/* with and without non-temporal stores */
+	for (nt = 0; nt < 2; ++nt) {
+		raid_rec_nt_size = nt ? 0 : RAID_REC_NT_SIZE;
+
+		/* all parity levels */
+		for (nr = 1; nr <= np; ++nr) {
+			/* all combinations (nr of nd) disks */
+			combination_first(nr, nd, id);
 			do {
-				/* for each recover function */
-				for (j = 0; j < nf[nr - 1]; ++j) {
-					/* set */
-					for (i = 0; i < nr; ++i) {
-						/* remove the missing data */
-						data_save[i] = data[id[i]];
-						data[id[i]] = test[i];
-						/* set the parity to use */
-						parity[ip[i]] = parity_save[ip[i]];
-					}
+				/* all combinations (nr of np) parities */
+				combination_first(nr, np, ip);
+				do {
+					/* setup the recovering context */
+					raid_rec_init(&rr, nr, id, ip);
+
+					/* for each recover function */
+					for (j = 0; j < nf[nr - 1]; ++j) {
+						/* set */
+						for (i = 0; i < nr; ++i) {
+							/* remove the missing data */
+							data_save[i] = data[id[i]];
+							data[id[i]] = test[i];
+							/* clear the result of a previous recovering */
+							memset(test[i], 0x55, size);
+							/* set the parity to use */
+							parity[ip[i]] = parity_save[ip[i]];
+						}
 
-					/* recover */
-					f[nr - 1][j](nr, id, ip, nd, size, v);
+						/* recover */
+						f[nr - 1][j](&rr, nd, size, v);
 
-					/* check */
-					for (i = 0; i < nr; ++i) {
-						if (memcmp(test[i], data_save[i], size) != 0) {
-							/* LCOV_EXCL_START */
-							goto bail;
-							/* LCOV_EXCL_STOP */
+						/* check */
+						for (i = 0; i < nr; ++i) {
+							if (memcmp(test[i], data_save[i], size) != 0) {
+								/* LCOV_EXCL_START */
+								goto bail;
+								/* LCOV_EXCL_STOP */
+							}
 						}
-					}
 
-					/* restore */
-					for (i = 0; i < nr; ++i) {
-						/* restore the data */
-						data[id[i]] = data_save[i];
-						/* restore the parity */
-						parity[ip[i]] = waste;
+						/* restore */
+						for (i = 0; i < nr; ++i) {
+							/* restore the data */
+							data[id[i]] = data_save[i];
+							/* restore the parity */
+							parity[ip[i]] = waste;
+						}
 					}
-				}
-			} while (combination_next(nr, np, ip));
-		} while (combination_next(nr, nd, id));
+				} while (combination_next(nr, np, ip));
+			} while (combination_next(nr, nd, id));
+		}
 	}
 
+	raid_rec_nt_size = RAID_REC_NT_SIZE;
+
 	free(v_alloc);
 	free(v);
 	return 0;
 
 bail:
 	/* LCOV_EXCL_START */
+	raid_rec_nt_size = RAID_REC_NT_SIZE;
 	free(v_alloc);
 	free(v);
 	return -1;
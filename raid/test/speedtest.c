@@ -75,6 +75,33 @@ static int64_t diffgettimeofday(struct timeval *start, struct timeval *stop)
 	ds = size * (int64_t)count * nd; \
 	dt = diffgettimeofday(&start, &stop);
 
+#if defined(CONFIG_X86) && defined(CONFIG_AVX2)
+/**
+ * Measure a recovering function forcing the non-temporal stores.
+ */
+static void speed_rec_nt(void (*rec)(struct raid_rec *rr, int nd, size_t size, void **vv), struct raid_rec *rr, int nd, int size, void **v)
+{
+	struct timeval start;
+	struct timeval stop;
+	int64_t ds;
+	int64_t dt;
+	int i, j;
+	int count;
+	int delta = TEST_DELTA;
+
+	raid_rec_nt_size = 0;
+
+	SPEED_START {
+		for (j = 0; j < nd; ++j)
+			rec(rr, nd, size, v);
+	} SPEED_STOP
+
+	raid_rec_nt_size = RAID_REC_NT_SIZE;
+
+	printf("%8" PRIu64, ds / dt);
+}
+#endif
+
 void speed(void)
 {
 	struct timeval start;
@@ -84,6 +111,7 @@ void speed(void)
 	int i, j;
 	int id[RAID_PARITY_MAX];
 	int ip[RAID_PARITY_MAX];
+	struct raid_rec rr;
 	int count;
 	int delta = TEST_DELTA;
 	int size = TEST_SIZE;
@@ -594,6 +622,7 @@ void speed(void)
 #ifdef CONFIG_X86
 	printf("%8s", "ssse3");
 	printf("%8s", "avx2");
+	printf("%8s", "avx2nt");
 #endif
 	printf("\n");
 
@@ -601,10 +630,12 @@ void speed(void)
 	printf("%8s", raid_rec1_tag());
 	fflush(stdout);
 
+	/* +1 to avoid GEN1 optimized case */
+	raid_rec_init(&rr, 1, id, ip + 1);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			/* +1 to avoid GEN1 optimized case */
-			raid_rec1_int8(1, id, ip + 1, nd, size, v);
+			raid_rec1_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -615,8 +646,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_ssse3(1, id, ip + 1, nd, size, v);
+				raid_rec1_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -626,11 +656,12 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_avx2(1, id, ip + 1, nd, size, v);
+				raid_rec1_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_rec1_avx2, &rr, nd, size, v);
 	}
 #endif
 #endif
@@ -640,10 +671,12 @@ void speed(void)
 	printf("%8s", raid_rec2_tag());
 	fflush(stdout);
 
+	/* +1 to avoid GEN2 optimized case */
+	raid_rec_init(&rr, 2, id, ip + 1);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			/* +1 to avoid GEN2 optimized case */
-			raid_rec2_int8(2, id, ip + 1, nd, size, v);
+			raid_rec2_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -654,8 +687,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN2 optimized case */
-				raid_rec2_ssse3(2, id, ip + 1, nd, size, v);
+				raid_rec2_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -665,11 +697,12 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				/* +1 to avoid GEN1 optimized case */
-				raid_rec2_avx2(2, id, ip + 1, nd, size, v);
+				raid_rec2_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_rec2_avx2, &rr, nd, size, v);
 	}
 #endif
 #endif
@@ -679,9 +712,11 @@ void speed(void)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 3, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(3, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -692,7 +727,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(3, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -702,10 +737,12 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(3, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v);
 	}
 #endif
 #endif
@@ -715,9 +752,11 @@ void speed(void)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 4, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(4, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -728,7 +767,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(4, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -738,10 +777,12 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(4, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v);
 	}
 #endif
 #endif
@@ -751,9 +792,11 @@ void speed(void)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 5, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(5, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -764,7 +807,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(5, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -774,10 +817,12 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(5, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v);
 	}
 #endif
 #endif
@@ -787,9 +832,11 @@ void speed(void)
 	printf("%8s", raid_recX_tag());
 	fflush(stdout);
 
+	raid_rec_init(&rr, 6, id, ip);
+
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(6, id, ip, nd, size, v);
+			raid_recX_int8(&rr, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -800,7 +847,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(6, id, ip, nd, size, v);
+				raid_recX_ssse3(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -810,10 +857,12 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(6, id, ip, nd, size, v);
+				raid_recX_avx2(&rr, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
+
+		speed_rec_nt(raid_recX_avx2, &rr, nd, size, v);
 	}
 #endif
 #endif
@@ -1984,29 +1984,22 @@ void raid_gen6_avx2ext(int nd, size_t size, void **vv)
 /*
  * RAID recovering for one disk SSSE3 implementation
  */
-void raid_rec1_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec1_ssse3(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t V = rr->V[0];
 	uint8_t *p;
 	uint8_t *pa;
-	uint8_t G;
-	uint8_t V;
 	size_t i;
 
-	(void)nr; /* unused, it's always 1 */
-
 	/* if it's RAID5 uses the faster function */
 	if (ip[0] == 0) {
 		raid_rec1of1(id, nd, size, vv);
 		return;
 	}
 
-	/* setup the coefficients matrix */
-	G = A(ip[0], id[0]);
-
-	/* invert it to solve the system of linear equations */
-	V = inv(G);
-
 	/* compute delta parity */
 	raid_delta_gen(1, id, ip, nd, size, vv);
 
@@ -2043,26 +2036,17 @@ void raid_rec1_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering for two disks SSSE3 implementation
  */
-void raid_rec2_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec2_ssse3(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t *V = rr->V;
 	const int N = 2;
 	uint8_t *p[N];
 	uint8_t *pa[N];
-	uint8_t G[N * N];
-	uint8_t V[N * N];
 	size_t i;
-	int j, k;
-
-	(void)nr; /* unused, it's always 2 */
-
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	int j;
 
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);
@@ -2149,27 +2133,20 @@ void raid_rec2_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering SSSE3 implementation
  */
-void raid_recX_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_recX_ssse3(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
-	int N = nr;
+	int N = rr->nr;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t *V = rr->V;
 	uint8_t *p[RAID_PARITY_MAX];
 	uint8_t *pa[RAID_PARITY_MAX];
-	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
-	uint8_t V[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t buffer[RAID_PARITY_MAX*16+16];
 	uint8_t *pd = __align_ptr(buffer, 16);
 	size_t i;
 	int j, k;
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
-
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);
 
@@ -2225,28 +2202,25 @@ void raid_recX_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering for one disk AVX2 implementation
  */
-void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec1_avx2(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t V = rr->V[0];
 	uint8_t *p;
 	uint8_t *pa;
-	uint8_t G;
-	uint8_t V;
+	int nt;
 	size_t i;
 
-	(void)nr; /* unused, it's always 1 */
-
 	/* if it's RAID5 uses the faster function */
 	if (ip[0] == 0) {
 		raid_rec1of1(id, nd, size, vv);
 		return;
 	}
 
-	/* setup the coefficients matrix */
-	G = A(ip[0], id[0]);
-
-	/* invert it to solve the system of linear equations */
-	V = inv(G);
+	/* if the data and parity read don't fit in the cache, bypass it */
+	nt = (nd + 1) * size >= raid_rec_nt_size;
 
 	/* compute delta parity */
 	raid_delta_gen(1, id, ip, nd, size, vv);
@@ -2270,7 +2244,18 @@ void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 		asm volatile ("vpshufb %ymm0,%ymm4,%ymm2");
 		asm volatile ("vpshufb %ymm1,%ymm5,%ymm3");
 		asm volatile ("vpxor   %ymm3,%ymm2,%ymm2");
-		asm volatile ("vmovdqa %%ymm2,%0" : "=m" (pa[i]));
+		if (!nt) {
+			asm volatile ("vmovdqa %%ymm2,%0" : "=m" (pa[i]));
+		} else if ((i & 32) == 0) {
+			/* keep the first half of the cache line in ymm6, */
+			/* as reading the second half of a line partially written */
+			/* with non-temporal stores is very slow */
+			asm volatile ("vmovdqa %ymm2,%ymm6");
+		} else {
+			/* write the full cache line */
+			asm volatile ("vmovntdq %%ymm6,%0" : "=m" (pa[i - 32]));
+			asm volatile ("vmovntdq %%ymm2,%0" : "=m" (pa[i]));
+		}
 	}
 
 	raid_avx_end();
@@ -2281,26 +2266,23 @@ void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering for two disks AVX2 implementation
  */
-void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec2_avx2(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t *V = rr->V;
 	const int N = 2;
 	uint8_t *p[N];
 	uint8_t *pa[N];
-	uint8_t G[N * N];
-	uint8_t V[N * N];
+	uint8_t buffer[2*32+32];
+	uint8_t *pr = __align_ptr(buffer, 32);
+	int nt;
 	size_t i;
-	int j, k;
-
-	(void)nr; /* unused, it's always 2 */
-
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
+	int j;
 
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	/* if the data and parity read don't fit in the cache, bypass it */
+	nt = (nd + N) * size >= raid_rec_nt_size;
 
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);
@@ -2344,7 +2326,17 @@ void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 		asm volatile ("vpxor   %ymm2,%ymm6,%ymm6");
 		asm volatile ("vpxor   %ymm3,%ymm6,%ymm6");
 
-		asm volatile ("vmovdqa %%ymm6,%0" : "=m" (pa[0][i]));
+		if (!nt) {
+			asm volatile ("vmovdqa %%ymm6,%0" : "=m" (pa[0][i]));
+		} else if ((i & 32) == 0) {
+			/* keep the first half of the cache line */
+			asm volatile ("vmovdqa %%ymm6,%0" : "=m" (pr[0]));
+		} else {
+			/* write the full cache line */
+			asm volatile ("vmovdqa %0,%%ymm2" : : "m" (pr[0]));
+			asm volatile ("vmovntdq %%ymm2,%0" : "=m" (pa[0][i - 32]));
+			asm volatile ("vmovntdq %%ymm6,%0" : "=m" (pa[0][i]));
+		}
 
 		asm volatile ("vpxor %ymm6,%ymm6,%ymm6");
 
@@ -2368,7 +2360,17 @@ void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 		asm volatile ("vpxor   %ymm2,%ymm6,%ymm6");
 		asm volatile ("vpxor   %ymm3,%ymm6,%ymm6");
 
-		asm volatile ("vmovdqa %%ymm6,%0" : "=m" (pa[1][i]));
+		if (!nt) {
+			asm volatile ("vmovdqa %%ymm6,%0" : "=m" (pa[1][i]));
+		} else if ((i & 32) == 0) {
+			/* keep the first half of the cache line */
+			asm volatile ("vmovdqa %%ymm6,%0" : "=m" (pr[32]));
+		} else {
+			/* write the full cache line */
+			asm volatile ("vmovdqa %0,%%ymm2" : : "m" (pr[32]));
+			asm volatile ("vmovntdq %%ymm2,%0" : "=m" (pa[1][i - 32]));
+			asm volatile ("vmovntdq %%ymm6,%0" : "=m" (pa[1][i]));
+		}
 	}
 
 	raid_avx_end();
@@ -2379,26 +2381,25 @@ void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering AVX2 implementation
  */
-void raid_recX_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_recX_avx2(struct raid_rec *rr, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
-	int N = nr;
+	int N = rr->nr;
+	int *id = rr->id;
+	int *ip = rr->ip;
+	uint8_t *V = rr->V;
 	uint8_t *p[RAID_PARITY_MAX];
 	uint8_t *pa[RAID_PARITY_MAX];
-	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
-	uint8_t V[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t buffer[RAID_PARITY_MAX*32+32];
 	uint8_t *pd = __align_ptr(buffer, 32);
+	uint8_t result[RAID_PARITY_MAX*32+32];
+	uint8_t *pr = __align_ptr(result, 32);
+	int nt;
 	size_t i;
 	int j, k;
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	/* if the data and parity read don't fit in the cache, bypass it */
+	nt = (nd + N) * size >= raid_rec_nt_size;
 
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);
@@ -2442,7 +2443,17 @@ void raid_recX_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 			}
 
 			asm volatile ("vpxor %ymm1,%ymm0,%ymm0");
-			asm volatile ("vmovdqa %%ymm0,%0" : "=m" (pa[j][i]));
+			if (!nt) {
+				asm volatile ("vmovdqa %%ymm0,%0" : "=m" (pa[j][i]));
+			} else if ((i & 32) == 0) {
+				/* keep the first half of the cache line */
+				asm volatile ("vmovdqa %%ymm0,%0" : "=m" (pr[j*32]));
+			} else {
+				/* write the full cache line */
+				asm volatile ("vmovdqa %0,%%ymm1" : : "m" (pr[j*32]));
+				asm volatile ("vmovntdq %%ymm1,%0" : "=m" (pa[j][i - 32]));
+				asm volatile ("vmovntdq %%ymm0,%0" : "=m" (pa[j][i]));
+			}
 		}
 	}
 